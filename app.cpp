@@ -1,13 +1,18 @@
 #include "app.hpp"
+#include "profiler.hpp"
+#include "project-meta.hpp"
 #include "save-wav.hpp"
 #include <SDL.h>
 #include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <fstream>
 #include <functional>
+#include <limits>
 #include <log/log.hpp>
 #include <ser/istrm.hpp>
 #include <ser/ser.hpp>
+#include <thread>
 
 extern "C" {
 #include <libavcodec/avcodec.h>
@@ -16,10 +21,25 @@ extern "C" {
 #include <libswresample/swresample.h>
 }
 
-static const auto preferredGrainSize = 1500;
+// the spectrogram caches live next to the project file, the first track keeps the name of the single
+// track projects
+static auto specCachePath(const std::string &saveName, size_t track) -> std::string
+{
+  return track == 0 ? saveName + ".spec" : saveName + "." + std::to_string(track) + ".spec";
+}
+
+// decompressed blocks of a compressed project kept besides the pinned ones, 32 MB
+static const auto BlockBudget = size_t{128};
+// seconds after the cursor whose compressed samples are kept decompressed
+static const auto PlaybackPinTime = 10.;
+// a wider view draws the waveform from the levels only
+static const auto MaxPinnedView = size_t{1} << 21;
+// the resampler reads this far around a grain
+static const auto MaxTaps = 32;
 
 auto App::draw() -> void
 {
+  pollLoader();
   std::function<void(void)> postponedAction = nullptr;
 
   if (ImGui::BeginMainMenuBar())
@@ -27,7 +47,16 @@ auto App::draw() -> void
     if (ImGui::BeginMenu("File"))
     {
       if (ImGui::MenuItem("Open..."))
-        postponedAction = [&]() { ImGui::OpenPopup("FileOpen"); };
+        postponedAction = [&]() {
+          isAddingTracks = false;
+          ImGui::OpenPopup("FileOpen");
+        };
+
+      if (ImGui::MenuItem("Add Track...", nullptr, false, audio != nullptr))
+        postponedAction = [&]() {
+          isAddingTracks = true;
+          ImGui::OpenPopup("FileOpen");
+        };
 
       if (ImGui::MenuItem("Save"))
       {
@@ -52,17 +81,24 @@ auto App::draw() -> void
     postponedAction();
 
   if (fileOpen.draw())
-    openFile(fileOpen.getSelectedFile());
+  {
+    if (isAddingTracks)
+      addTracks(fileOpen.getSelectedFile());
+    else
+      openFile(fileOpen.getSelectedFile());
+  }
 
   if (fileSaveAs.draw())
     saveMelonixFile(fileSaveAs.getSelectedFile());
 
   if (exportWavDlg.draw())
     exportWav(exportWavDlg.getSelectedFile());
+  pollExport();
+  pollPitchDetector();
 
   {
     ImGui::Begin("Control Center");
-    ImGui::Text("<%.2f %.2f %.2f>", startTime, cursorSec, startTime + rangeTime);
+    ImGui::Text("<%.2f %.2f %.2f>", startTime, cursorSec.load(), startTime + rangeTime);
     ImGui::SameLine();
     ImGui::Text("<%.2f %.2f>", startNote, startNote + rangeNote);
     ImGui::Checkbox("Follow", &followMode);
@@ -72,44 +108,90 @@ auto App::draw() -> void
       togglePlay();
     // brightnes
     ImGui::SliderFloat("Brightness", &brightness, 0.0f, 100.0f);
-    float newK = powf(2, brightness / 10 + 9);
-    if (std::fabs(k - newK) > 0.001f)
-    {
-      k = newK;
-      specCache = nullptr;
-    }
+    // k is a shader uniform, changing it does not touch the cached columns
+    k = powf(2, brightness / 10 + 9);
     // Tempo
     ImGui::SliderFloat("Tempo", &tempo, 30.0f, 250.0f);
+    if (ImGui::SliderInt("Spectrum uploads per frame", &specUploadBudget, 1, 256) && specCache)
+      specCache->setUploadBudget(specUploadBudget);
+    ImGui::Checkbox("Compress samples on save", &compressProject);
+    ImGui::Checkbox("Snap to pitch", &snapToPitch);
+    if (isDetectingPitch())
+    {
+      ImGui::SameLine();
+      ImGui::Text("detecting pitch...");
+    }
+    {
+      auto isHighQuality = isPlaybackHighQuality.load();
+      if (ImGui::Checkbox("High quality playback", &isHighQuality))
+        isPlaybackHighQuality = isHighQuality;
+    }
+    {
+      // in the order of WavWriter::Format
+      static const char *formats[] = {"16 bit PCM", "24 bit PCM", "32 bit float"};
+      auto format = static_cast<int>(exportFormat);
+      if (ImGui::Combo("Export format", &format, formats, 3))
+        exportFormat = static_cast<WavWriter::Format>(format);
+    }
     const auto &io = ImGui::GetIO();
     ImGui::Text("FPS: %.1f (%.3f ms)", io.Framerate, 1000.0f / io.Framerate);
+    ImGui::Checkbox("Profiler", &isProfilerOpen);
+    ImGui::End();
+  }
+  {
+    static auto &sample2TimeSize = profiler().gauge("timeMap/sample2Time cache size");
+    static auto &time2SampleSize = profiler().gauge("timeMap/time2Sample cache size");
+    static auto &time2PitchBendSize = profiler().gauge("timeMap/time2PitchBend cache size");
+    sample2TimeSize.set(sample2TimeCache.size());
+    time2SampleSize.set(time2SampleCache.size());
+    time2PitchBendSize.set(time2PitchBendCache.size());
+    // samples the counters even while the window is closed, so the plots start with this frame
+    profiler().draw(&isProfilerOpen);
+  }
+  if (audio)
+  {
+    ImGui::Begin("Tracks");
+    for (auto i = 0U; i < tracks.size(); ++i)
+    {
+      auto &t = *tracks[i];
+      const auto id = std::to_string(i);
+      auto isChanged = ImGui::Checkbox(("mute##" + id).c_str(), &t.isMuted);
+      ImGui::SameLine();
+      ImGui::SetNextItemWidth(100.f);
+      isChanged |= ImGui::SliderFloat(("gain##" + id).c_str(), &t.gain, 0.f, 2.f);
+      if (isChanged)
+        t.playbackGain = t.isMuted ? 0.f : t.gain;
+      ImGui::SameLine();
+      if (ImGui::Selectable((t.name + "##" + id).c_str(), i == activeTrack))
+        setActiveTrack(i);
+    }
     ImGui::End();
   }
-  if (selectedMarker != std::end(markers))
+  if (audio && selectedMarker != std::end(track().markers))
   {
+    auto &markers = track().markers;
     ImGui::Begin("Marker");
     if (ImGui::Button("0##dt"))
     {
       selectedMarker->dTime = 0;
-      invalidateCache();
+      invalidateCache(selectedMarker - std::begin(markers));
     }
     ImGui::SameLine();
     if (ImGui::InputDouble("dt", &selectedMarker->dTime, .1, .5, "%.2f s"))
-      invalidateCache();
+      invalidateCache(selectedMarker - std::begin(markers));
     if (ImGui::Button("0##pitchBend"))
     {
       selectedMarker->pitchBend = 0;
-      invalidateCache();
+      invalidateCache(selectedMarker - std::begin(markers));
     }
     ImGui::SameLine();
     if (ImGui::InputDouble("pitch bend", &selectedMarker->pitchBend, .1, 1., "%.2f"))
-      invalidateCache();
+      invalidateCache(selectedMarker - std::begin(markers));
     ImGui::End();
   }
   if (audio)
   {
-    audio->lock();
     displayCursor = cursorSec;
-    audio->unlock();
     if (displayCursor > startTime + rangeTime && isAudioPlaying)
       followMode = true;
     if (followMode)
@@ -124,11 +206,67 @@ auto App::draw() -> void
         waveformCache.clear();
       }
     }
+    updateSpecFocus();
+    pinSamples();
   }
 }
 
+auto App::pinSamples() -> void
+{
+  const auto cursor = cursorSec.load();
+  for (auto &t : tracks)
+  {
+    if (!t->wavData.blocks())
+      continue;
+    // the grains the callback plays in the next seconds, the time map can run backwards so the whole
+    // stretch is sampled
+    const auto &tm = *t->timeMap.get();
+    auto first = tm.time2Sample(cursor);
+    auto last = first;
+    for (auto dt = 1.; dt <= PlaybackPinTime; dt += 1.)
+    {
+      const auto sample = tm.time2Sample(cursor + dt);
+      first = std::min(first, sample);
+      last = std::max(last, sample);
+    }
+    const auto margin = 4 * PreferredGrainSize;
+    auto pin = t->wavData.pin(static_cast<size_t>(std::max(0, first - margin)),
+                              static_cast<size_t>(std::max(0, last + margin)));
+    // the new pin first, the blocks both cover stay decompressed
+    t->playbackPin = std::move(pin);
+  }
+
+  // only the active track is drawn
+  auto &t = track();
+  if (!t.wavData.blocks())
+    return;
+
+  // zoomed out the waveform comes from the levels and the spectrum pins its own columns, the few edge
+  // samples the levels do not cover may read as zeros
+  const auto visibleStart = std::max(0, time2Sample(startTime));
+  const auto visibleEnd = std::max(visibleStart, time2Sample(startTime + rangeTime));
+  if (static_cast<size_t>(visibleEnd - visibleStart) > MaxPinnedView)
+  {
+    t.viewPin = {};
+    return;
+  }
+  auto pin = t.wavData.pin(static_cast<size_t>(visibleStart), static_cast<size_t>(visibleEnd));
+  t.viewPin = std::move(pin);
+}
+
+auto App::updateSpecFocus() -> void
+{
+  if (!audio || !track().spec)
+    return;
+  const auto visibleStart = time2Sample(startTime);
+  const auto visibleEnd = time2Sample(startTime + rangeTime);
+  const auto cursor = time2Sample(cursorSec);
+  track().spec->setFocus(visibleStart, visibleEnd, cursor);
+}
+
 auto App::openFile(const std::string &fileName) -> void
 {
+  isDirty = true;
   // Get the extension of the file name
   const auto extension = fileName.substr(fileName.find_last_of(".") + 1);
   if (extension != "melonix")
@@ -137,104 +275,51 @@ auto App::openFile(const std::string &fileName) -> void
     loadMelonixFile(fileName);
 }
 
-static auto GrainSpectrSize = 2 * 4096;
-
 auto App::importFile(const std::string &fileName) -> void
 {
   LOG("import", fileName);
   cleanup();
   loadAudioFile(fileName);
-  markers.clear();
   saveName = "";
+  samplesFile = "";
 
   preproc();
 }
 
-auto App::preproc() -> void
+auto App::addTracks(const std::string &fileName) -> void
 {
-  selectedMarker = std::end(markers);
+  if (tracks.empty())
   {
-    // generate grains
-    grains.clear();
-    auto start = 0;
-    auto nextEstimation = GrainSpectrSize;
-    while (start < static_cast<int>(wavData.size() - preferredGrainSize - 1))
-    {
-      bool found = false;
-      for (auto i = 0; i < preferredGrainSize; ++i)
-      {
-        const auto idx = start + preferredGrainSize + (i % 2 == 0 ? i / 2 : -i / 2);
-        const auto isZeroCrossing = [&]() {
-          const auto lookAround = 7;
-          if (idx < lookAround)
-            return false;
-          if (idx >= static_cast<int>(wavData.size() - lookAround - 1))
-            return false;
-          for (int j = 0; j < lookAround; ++j)
-          {
-            if (wavData[idx - j] >= 0)
-              return false;
-            if (wavData[idx + 1 + j] < 0)
-              return false;
-          }
-          return true;
-        }();
-        if (isZeroCrossing)
-        {
-          grains.insert(
-            std::make_pair(start,
-                           std::make_tuple(std::span<float>(wavData.data() + start, idx - start),
-                                           idx - start - preferredGrainSize)));
-          LOG("good grain", start, idx - start);
-          start = idx;
-          found = true;
-          break;
-        }
-      }
-      if (!found)
-      {
-        LOG("bad grain", start, preferredGrainSize);
-        found = false;
-        for (auto i = start + preferredGrainSize + preferredGrainSize / 2;
-             i < static_cast<int>(wavData.size() - 1);
-             ++i)
-        {
-          const auto isZeroCrossing = [&]() {
-            const auto lookAround = 3;
-            if (i < lookAround)
-              return false;
-            if (i >= static_cast<int>(wavData.size() - lookAround - 1))
-              return false;
-            for (int j = 0; j < lookAround; ++j)
-            {
-              if (wavData[i - j] >= 0)
-                return false;
-              if (wavData[i + 1 + j] < 0)
-                return false;
-            }
-            return true;
-          }();
-          if (isZeroCrossing)
-          {
-            grains.insert(
-              std::make_pair(start,
-                             std::make_tuple(std::span<float>(wavData.data() + start, i - start),
-                                             i - start - preferredGrainSize)));
-            LOG("bad grain", start, i - start);
-            start = i;
-            found = true;
-            break;
-          }
-        }
-        if (!found)
-          break;
-      }
-      if (start > nextEstimation)
-        nextEstimation += GrainSpectrSize;
-    }
+    importFile(fileName);
+    return;
   }
+  LOG("add tracks", fileName);
+  isDirty = true;
+  // the audio callback iterates the tracks, preproc opens the device again
+  audio = nullptr;
+  isAudioPlaying = false;
+  loadAudioFile(fileName);
+  // the project file does not have the samples of the new tracks, the next save writes all of them
+  samplesFile = "";
+
+  preproc();
+}
+
+auto App::preproc() -> void
+{
+  if (tracks.empty())
+    return;
+  activeTrack = std::min(activeTrack, tracks.size() - 1);
+  // the tracks which were there before are analyzed already
+  for (auto i = 0U; i < tracks.size(); ++i)
+    if (!tracks[i]->timeMap.get())
+      preproc(i);
+  selectedMarker = std::end(track().markers);
+  invalidateCache();
+  if (isHeadless)
+    // nothing is drawn or played
+    return;
 
-  calcPicks();
   auto want = [&]() {
     SDL_AudioSpec ret;
     ret.freq = sampleRate;
@@ -247,13 +332,53 @@ auto App::preproc() -> void
   audio = std::make_unique<sdl::Audio>(nullptr, false, &want, &have, 0, [&](Uint8 *stream, int len) {
     playback(reinterpret_cast<float *>(stream), len / sizeof(float));
   });
+  // the device starts paused, the callback does not run before the buffer is there
+  mixBuffer.resize(static_cast<size_t>(have.samples) * have.channels);
+}
 
-  spec = std::make_unique<Spec>(std::span<float>{wavData.data(), wavData.data() + wavData.size()});
+auto App::preproc(size_t idx) -> void
+{
+  auto &t = *tracks[idx];
+  t.playbackGain = t.isMuted ? 0.f : t.gain;
+  // projects store the grain index, only imports and old projects need the search; while a file is
+  // decoding pollLoader extends the grains as the samples arrive
+  if (!t.loader && (t.grains.empty() || !t.grains.isValid(t.sampleCount)))
+  {
+    t.grains = findGrains(t.wavData.span(), PreferredGrainSize);
+    auto fallback = 0;
+    for (auto i = 0U; i < t.grains.size(); ++i)
+      if (t.grains[i].size >= PreferredGrainSize + PreferredGrainSize / 2)
+        ++fallback;
+    LOG(t.name, "grains", t.grains.size(), "fallback", fallback);
+  }
+  publishTimeMap(t, 0);
+  if (isHeadless)
+    return;
+  if (!t.loader)
+    startPitchDetection(t);
+
+  t.picks.reserve(t.wavData.size());
+  calcPicks(t);
+
+  t.spec = std::make_unique<Spec>(
+    t.wavData.span(), [this]() { onSpecJobDone(); }, Spec::defaultWorkers(), t.wavData.blocks());
+  if (t.loader)
+    t.spec->setAvailable(static_cast<size_t>(t.sampleCount), false);
+  else if (!saveName.empty())
+    t.spec->loadCache(specCachePath(saveName, idx));
 }
 
 auto App::playback(float *w, size_t dur) -> void
 {
-  if (cursorSec < 0 || cursorSec >= duration())
+  // the only shared state the callback reads is the published time map and the atomics, it never waits
+  // for the UI thread
+  static auto &timer = profiler().timer("playback");
+  static auto &misses = profiler().counter("playback/deadline misses");
+  // the callback has to be done before the device plays the buffer it fills
+  const auto scope = ProfileScope{timer, 1000. * dur / sampleRate, misses};
+
+  auto cursor = cursorSec.load();
+  if (cursor < 0 || cursor >= mixDuration)
     isAudioPlaying = false;
 
   if (!isAudioPlaying)
@@ -266,163 +391,115 @@ auto App::playback(float *w, size_t dur) -> void
       *w *= .01f * i;
       --w;
     }
-    restWav.clear();
+    for (auto &t : tracks)
+    {
+      t->restWav.clear();
+      t->restStep = {};
+    }
 
     return;
   }
 
-  auto tmpCursor = cursorSec + 1. * restWav.size() / sampleRate;
-  while (restWav.size() < dur + preferredGrainSize)
-    tmpCursor += process(tmpCursor, restWav);
-
-  if (!restWav.empty())
+  std::fill_n(w, dur, 0.f);
+  const auto quality = isPlaybackHighQuality ? Resampler::Quality::High : Resampler::Quality::Fast;
+  for (auto &t : tracks)
   {
-    auto sz = std::min(restWav.size(), dur);
-
-    for (auto i = 0U; i < sz; ++i)
+    const auto gain = t->playbackGain.load();
+    if (cursor != t->restWavCursor || gain == 0.f)
     {
-      *w = restWav[i];
-      ++w;
+      // the UI moved the cursor, the rendered tail belongs to the old position; a muted track renders
+      // nothing and starts at the cursor when it is unmuted
+      t->restWav.clear();
+      t->restStep = {};
     }
+    if (gain == 0.f)
+      continue;
+
+    auto tmpCursor = cursor + 1. * t->restWav.size() / sampleRate;
+    auto tmCursor = TimeMap::Cursor{*t->timeMap.acquire()};
+    auto grainCursor = GrainIndex::Cursor{t->grains};
+    const auto engine = GrainEngine{t->wavData.span(), t->grains, sampleRate, bias, quality};
+    while (t->restWav.size() < dur + PreferredGrainSize)
+      tmpCursor += process(*t, engine, tmCursor, grainCursor, tmpCursor);
 
-    dur -= sz;
-    restWav.erase(restWav.begin(), restWav.begin() + sz);
-    cursorSec += 1. * sz / sampleRate;
+    for (auto i = size_t{0}; i < dur;)
+    {
+      const auto sz = t->restWav.read(mixBuffer.data(), std::min(dur - i, mixBuffer.size()));
+      for (auto j = size_t{0}; j < sz; ++j)
+        w[i + j] += gain * mixBuffer[j];
+      i += sz;
+    }
   }
+
+  // if the UI scrubbed in the meantime its position wins
+  const auto newCursor = cursor + 1. * dur / sampleRate;
+  if (cursorSec.compare_exchange_strong(cursor, newCursor))
+    for (auto &t : tracks)
+      t->restWavCursor = newCursor;
 }
 
-auto App::process(double cursor, std::vector<float> &wav) -> double
+auto App::process(Track &t,
+                  const GrainEngine &engine,
+                  TimeMap::Cursor &tm,
+                  GrainIndex::Cursor &grainCursor,
+                  double cursor) -> double
 {
-  const auto pitchBend = time2PitchBend(cursor);
-  const auto rate = powf(2, pitchBend / 12);
-  auto it1 = [&]() {
-    const auto sample = time2Sample(cursor);
-    return grains.lower_bound(sample);
-  }();
-
-  if (it1 == std::end(grains))
+  // runs on the audio thread, must not allocate
+  static auto &underruns = profiler().counter("playback/underruns");
+  const auto out = t.restWav.writable();
+  const auto capacity = out[0].size() + out[1].size();
+  const auto step = engine.isPartial(t.restStep) ? engine.resume(t.restStep, capacity)
+                                                 : engine.plan(tm, grainCursor, cursor, capacity);
+  t.restStep = step;
+  if (engine.isEnd(step))
   {
-    isAudioPlaying = false;
-    for (auto i = 0; i < preferredGrainSize; ++i)
-      wav.push_back(0.f);
+    // the other tracks can still play, this one renders silence until the longest is done
+    const auto sz = std::min(capacity, static_cast<size_t>(PreferredGrainSize));
+    const auto first = std::min(sz, out[0].size());
+    std::fill_n(out[0].data(), first, 0.f);
+    std::fill_n(out[1].data(), sz - first, 0.f);
+    t.restWav.commit(sz);
     return 0;
   }
 
-  const auto grain = std::get<0>(it1->second);
-  const auto nextGrainFirstSample = [&]() {
-    auto sz = 0;
-    for (auto i = 0;; ++i)
-    {
-      auto idxF = double{};
-      std::modf(i * rate + bias, &idxF);
-      const auto idx = static_cast<size_t>(idxF);
-      if (idx >= grain.size())
-        break;
-      ++sz;
-    }
-    const auto sample = time2Sample(cursor + 1. * sz / sampleRate);
-    auto it2 = grains.lower_bound(sample);
-    if (it2 == std::end(grains))
-      return 0.f;
-
-    return std::get<0>(it2->second).front();
-  }();
-  prevGrain = grain;
-
-  auto sz = 0;
-  for (auto i = 0;; ++i)
+  const auto blocks = t.wavData.blocks();
+  const auto grain = t.grains[step.grain];
+  const auto first = static_cast<size_t>(std::max(0, grain.start - MaxTaps));
+  const auto last = std::max(static_cast<size_t>(grain.start + grain.size), step.next) + MaxTaps;
+  // the UI can drop its pins any time, the blocks are held while the grain is rendered
+  if (blocks && !blocks->tryRead(first, last))
   {
-    auto idxF = float{};
-    const auto curBias = std::modf(i * rate + bias, &idxF);
-    const auto idx = static_cast<size_t>(idxF);
-    if (idx >= grain.size())
-      break;
-    wav.push_back((1.f - curBias) * grain[idx] +
-                  curBias * (idx + 1 < grain.size() ? grain[idx + 1] : nextGrainFirstSample));
-    ++sz;
+    // the compressed samples of the grain are not decompressed yet, the callback never waits for them
+    underruns.add();
+    const auto head = std::min(step.size, out[0].size());
+    std::fill_n(out[0].data(), head, 0.f);
+    std::fill_n(out[1].data(), step.size - head, 0.f);
   }
-  return 1. * sz / sampleRate;
-}
-
-auto App::calcPicks() -> void
-{
-  picks.clear();
-  auto lvl = 0U;
-
-  if (wavData.size() <= (1 << (lvl + 1)))
-    return;
-  while (picks.size() <= lvl)
-    picks.push_back({});
-  for (auto i = 0U; i < wavData.size() / (1 << (lvl + 1)); ++i)
+  else
   {
-    const auto min = std::min(wavData[i * 2], wavData[i * 2 + 1]);
-    const auto max = std::max(wavData[i * 2], wavData[i * 2 + 1]);
-    picks[lvl].push_back(std::make_pair(min, max));
+    engine.render(step, out);
+    if (blocks)
+      blocks->endRead(first, last);
   }
+  t.restWav.commit(step.size);
+  return engine.duration(step);
+}
 
-  for (;;)
-  {
-    ++lvl;
-    if (wavData.size() <= (1 << (lvl + 1)))
-      break;
-    while (picks.size() <= lvl)
-      picks.push_back({});
-    for (auto i = 0U; i < wavData.size() / (1 << (lvl + 1)); ++i)
-    {
-      const auto min = std::min(picks[lvl - 1][i * 2].first, picks[lvl - 1][i * 2 + 1].first);
-      const auto max = std::max(picks[lvl - 1][i * 2].second, picks[lvl - 1][i * 2 + 1].second);
-      picks[lvl].push_back(std::make_pair(min, max));
-    }
-  }
+auto App::calcPicks(Track &t) -> void
+{
+  // only the blocks completed since the last call are computed
+  t.picks.extend({t.wavData.data(), static_cast<size_t>(t.sampleCount)});
   waveformCache.clear();
 }
 
-auto App::getMinMaxFromRange(int start, int end) -> std::pair<float, float>
+auto App::getMinMaxFromRange(int start, int end) const -> std::pair<float, float>
 {
-  if (start >= end)
-  {
-    if (start >= 0 && start < static_cast<int>(wavData.size()))
-      return {wavData[start], wavData[start]};
+  const auto &t = track();
+  if (start < 0 || start >= t.sampleCount)
     return {0.f, 0.f};
-  }
-
-  if (start < 0 || end < 0)
-    return {0.f, 0.f};
-
-  if (start >= static_cast<int>(wavData.size()) || end >= static_cast<int>(wavData.size()))
-    return {0.f, 0.f};
-
-  if (end - start == 1)
-    return {wavData[start], wavData[start]};
-
-  // calculate level
-  const auto lvl = static_cast<size_t>(std::log2(end - start));
-  // Get the minimum and maximum from the level
-  const auto lvlStart = start / (1 << lvl);
-  auto minMax = [&]() {
-    if (lvl - 1 >= picks.size())
-      return std::pair{0.f, 0.f};
-    if (lvlStart >= static_cast<int>(picks[lvl - 1].size()))
-      return std::pair{0.f, 0.f};
-    return picks[lvl - 1][lvlStart];
-  }();
-  // Get left range
-  const auto leftEnd = lvlStart * (1 << lvl);
-  if (leftEnd >= start)
-  {
-    const auto leftMinMax = getMinMaxFromRange(start, leftEnd);
-    minMax.first = std::min(minMax.first, leftMinMax.first);
-    minMax.second = std::max(minMax.second, leftMinMax.second);
-  }
-  // Get right range
-  const auto rightStart = (lvlStart + 1) * (1 << lvl);
-  if (rightStart < end)
-  {
-    const auto rightMinMax = getMinMaxFromRange(rightStart, end);
-    minMax.first = std::min(minMax.first, rightMinMax.first);
-    minMax.second = std::max(minMax.second, rightMinMax.second);
-  }
-  return minMax;
+  if (start >= end)
+    return {t.wavData[start], t.wavData[start]};
+  return t.picks.minMax(static_cast<size_t>(start), static_cast<size_t>(std::min(end, t.sampleCount)));
 }
 
 auto App::glDraw() -> void
@@ -434,316 +511,452 @@ auto App::glDraw() -> void
   if (!audio)
     return;
 
-  // Enable alpha blending
-  glEnable(GL_BLEND);
-  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-
-  glViewport(0, 0, (int)io.DisplaySize.x, static_cast<int>(.1f * Height));
-  glMatrixMode(GL_PROJECTION);
-  glLoadIdentity();
-  glOrtho(0, Width, 1., -1., -1, 1);
-  // Our state
-  ImVec4 clearColor = ImVec4(0.f, 0.f, 0.f, 1.f);
-  glClearColor(
-    clearColor.x * clearColor.w, clearColor.y * clearColor.w, clearColor.z * clearColor.w, clearColor.w);
-  glClear(GL_COLOR_BUFFER_BIT);
+  PROFILE("glDraw");
+  if (!gl)
+    gl = std::make_unique<Gl>();
+  isDirty = false;
+  const auto waveformHeight = static_cast<int>(.1f * Height);
+  const auto specHeight = static_cast<int>(Height * 0.9 - 20);
 
   if (waveformCache.size() != static_cast<size_t>(Width))
     waveformCache.clear();
 
+  auto isWaveformChanged = false;
   if (waveformCache.empty())
   {
+    PROFILE("glDraw/waveform cache");
     for (auto x = 0; x < Width; ++x)
     {
-      audio->lock();
       const auto left = time2Sample(1. * x / Width * rangeTime + startTime);
       const auto right = time2Sample(1. * (x + 1) / Width * rangeTime + startTime);
       auto minMax = getMinMaxFromRange(left, right);
       waveformCache.push_back(minMax);
-      audio->unlock();
     }
+    isWaveformChanged = true;
   }
-
-  // draw waveform
-  glColor3f(1.f, 0.f, 1.f);
-  glBegin(GL_LINE_STRIP);
-  for (auto x = 0; x < Width; ++x)
+  else if (waveformDirtyTime < startTime + rangeTime)
   {
-    const auto minMax = waveformCache[x];
-    glVertex2f(x, minMax.first);
-    glVertex2f(x + 1, minMax.second);
+    PROFILE("glDraw/waveform cache");
+    // only the pixels right of the edited marker's left neighbour moved
+    const auto first = std::max(0, static_cast<int>((waveformDirtyTime - startTime) * Width / rangeTime));
+    for (auto x = first; x < Width; ++x)
+    {
+      const auto left = time2Sample(1. * x / Width * rangeTime + startTime);
+      const auto right = time2Sample(1. * (x + 1) / Width * rangeTime + startTime);
+      waveformCache[x] = getMinMaxFromRange(left, right);
+    }
+    isWaveformChanged = true;
   }
-  glEnd();
-
-  // draw spectogram
-  glViewport(
-    0, static_cast<int>(.1 * Height), (int)io.DisplaySize.x, static_cast<int>(Height * 0.9 - 20));
-  glMatrixMode(GL_PROJECTION);
-  glLoadIdentity();
-  glOrtho(0, Width, 0., 1., -1, 1);
-  glEnable(GL_TEXTURE_1D);
-  glColor3f(1.f, 1.f, 1.f);
-
-  auto step = powf(2.f, 1.f / 12.f);
+  waveformDirtyTime = std::numeric_limits<double>::infinity();
 
-  for (auto x = 0; x < Width; ++x)
+  if (const auto &spec = track().spec)
+  {
+    PROFILE("glDraw/spectrogram columns");
+    if (!specCache)
+    {
+      specCache = std::make_unique<SpecCache>();
+      specCache->setUploadBudget(specUploadBudget);
+    }
+    specColumns.resize(static_cast<size_t>(Width));
+    for (auto x = 0U; x < specColumns.size(); ++x)
+    {
+      const auto time = startTime + x * rangeTime / Width;
+      specColumns[x][0] = specCache->getRow(*spec, time2Sample(time), time2Sample(time + rangeTime / Width));
+    }
+    for (auto x = 0U; x < specColumns.size(); ++x)
+      specColumns[x][1] = time2PitchBend(startTime + x * rangeTime / Width);
+    // the new rows go into the atlas even if the layers are not redrawn
+    specCache->flushUploads();
+  }
+  else
+    specColumns.clear();
+
+  // everything under the scrubber is drawn into the layers framebuffer only when something in it changed,
+  // during playback without follow mode a frame is a copy and one line
+  const auto &markers = track().markers;
+  const auto selected = selectedMarker == std::end(markers) ? -1 : selectedMarker - std::begin(markers);
+  const auto key = std::array{startTime,
+                              rangeTime,
+                              startNote,
+                              1. * rangeNote,
+                              1. * Width,
+                              1. * Height,
+                              1. * k,
+                              1. * tempo,
+                              1. * markersVersion,
+                              1. * selected,
+                              1. * pitchVersion};
+  const auto isResized = gl->layers.resize(static_cast<int>(Width), static_cast<int>(Height));
+  if (isResized || isWaveformChanged || key != layersKey || specColumns != layersColumns)
   {
-    auto texture = getTex(startTime + x * rangeTime / Width);
-    glBindTexture(GL_TEXTURE_1D, texture);
+    layersKey = key;
+    layersColumns = specColumns;
+    PROFILE("glDraw/layers");
+    gl->layers.bind();
+    drawLayers(waveformHeight, specHeight, isWaveformChanged);
+    gl->layers.unbind();
+  }
+  gl->layers.blit();
 
-    glBegin(GL_QUADS);
+  // Enable alpha blending
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-    audio->lock();
-    const auto pitchBend = time2PitchBend(startTime + x * rangeTime / Width);
-    audio->unlock();
-    const auto startFreq = 55. * pow(2., (startNote - 24) / 12.);
-    auto freq = static_cast<float>(startFreq / sampleRate * 2.);
-    for (auto i = 0; i < rangeNote; ++i)
-    {
-      glTexCoord1f(freq);
-      glVertex2f(x, (i + pitchBend) / rangeNote);
+  // draw a scrubber
+  const auto scrubberHeight = static_cast<int>(Height - 20);
+  glViewport(0, 0, (int)io.DisplaySize.x, scrubberHeight);
+  if (displayCursor != scrubberMeshCursor)
+  {
+    scrubberMeshCursor = displayCursor;
+    // the line is at the origin of its mesh
+    const auto scrubber = std::array{LineRenderer::Vertex{{0.f, 0.f}, {0.f, 0.f}, {1.f, 0.f, .5f, .25f}},
+                                     LineRenderer::Vertex{{0.f, 1.f}, {0.f, 0.f}, {1.f, 0.f, .5f, .25f}}};
+    gl->lineRenderer.upload(gl->scrubberMesh, scrubber, {displayCursor, 0.});
+  }
+  gl->lineRenderer.draw(gl->scrubberMesh,
+                        GL_LINES,
+                        {startTime, 0.},
+                        {static_cast<float>(Width / rangeTime), 1.f * scrubberHeight},
+                        {Width, 1.f * scrubberHeight});
+}
 
-      glTexCoord1f(freq * step);
-      glVertex2f(x, 1.f * (i + pitchBend + 1.f) / rangeNote);
+auto App::drawLayers(int waveformHeight, int specHeight, bool isWaveformChanged) -> void
+{
+  const auto &io = ImGui::GetIO();
+  const auto Height = io.DisplaySize.y;
+  const auto Width = io.DisplaySize.x;
 
-      glTexCoord1f(freq * step);
-      glVertex2f(x + 1.f, (i + pitchBend + 1.f) / rangeNote);
+  // Enable alpha blending
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-      glTexCoord1f(freq);
-      glVertex2f(x + 1.f, (i + pitchBend) / rangeNote);
+  glViewport(0, 0, (int)io.DisplaySize.x, waveformHeight);
+  // Our state
+  ImVec4 clearColor = ImVec4(0.f, 0.f, 0.f, 1.f);
+  glClearColor(
+    clearColor.x * clearColor.w, clearColor.y * clearColor.w, clearColor.z * clearColor.w, clearColor.w);
+  glClear(GL_COLOR_BUFFER_BIT);
 
-      freq *= step;
+  // draw waveform, x in pixels and the samples from 1 at the bottom to -1 at the top
+  {
+    PROFILE("glDraw/waveform");
+    if (isWaveformChanged)
+    {
+      lineVertices.clear();
+      for (auto x = 0U; x < waveformCache.size(); ++x)
+      {
+        const auto minMax = waveformCache[x];
+        lineVertices.push_back({{1.f * x, minMax.first}, {0.f, 0.f}, {1.f, 0.f, 1.f, 1.f}});
+        lineVertices.push_back({{x + 1.f, minMax.second}, {0.f, 0.f}, {1.f, 0.f, 1.f, 1.f}});
+      }
+      gl->lineRenderer.upload(gl->waveformMesh, lineVertices);
     }
-    glEnd();
+    gl->lineRenderer.draw(gl->waveformMesh,
+                          GL_LINE_STRIP,
+                          {0., 1.},
+                          {1.f, -.5f * waveformHeight},
+                          {Width, 1.f * waveformHeight});
   }
+
+  // draw spectogram
+  glViewport(0, static_cast<int>(.1 * Height), (int)io.DisplaySize.x, specHeight);
+  if (specCache)
+  {
+    PROFILE("glDraw/spectrogram");
+    specCache->draw(specColumns, startNote, rangeNote, sampleRate, k);
+  }
+
   // draw piano
-  glColor4f(1.f, 1.f, 1.f, .096f);
-  glBindTexture(GL_TEXTURE_1D, pianoTexture);
-  glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-  glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-  std::vector<std::array<unsigned char, 3>> pianoData;
-  pianoData.resize(static_cast<int>(.9f * Height - 20));
-  auto lastNote = 0;
-  for (auto i = 0U; i < pianoData.size(); ++i)
   {
-    const auto tmp = i * rangeNote + pianoData.size() / 2;
-    const auto note = static_cast<int>(tmp / pianoData.size() + startNote);
-    auto isBlack = std::array{
-      false, true, false, false, true, false, true, false, false, true, false, true}[note % 12];
-    unsigned char c = (note == lastNote) ? (isBlack ? 128 : 255) : 0;
-    pianoData[i] = std::array{c, c, c};
-    lastNote = note;
+    PROFILE("glDraw/piano");
+    gl->piano.draw(startNote, rangeNote, specHeight);
   }
-  glTexImage1D(GL_TEXTURE_1D,                          // target
-               0,                                      // level
-               3,                                      // internalFormat
-               static_cast<GLsizei>(pianoData.size()), // width
-               0,                                      // border
-               GL_RGB,                                 // format
-               GL_UNSIGNED_BYTE,                       // type
-               pianoData.data()                        // data
-  );
-
-  glBegin(GL_QUADS);
-  glTexCoord1f(0);
-  glVertex2f(0, 0);
-  glTexCoord1f(0);
-  glVertex2f(Width, 0);
-  glTexCoord1f(1);
-  glVertex2f(Width, 1);
-  glTexCoord1f(1);
-  glVertex2f(0, 1);
-  glEnd();
-
-  glDisable(GL_TEXTURE_1D);
-
-  // draw bars
-  const auto beatDuration = 60. / tempo;
-  glBegin(GL_LINES);
-  for (auto x = static_cast<int>(startTime / beatDuration); x * beatDuration < startTime + rangeTime;
-       ++x)
+
+  // draw bars, in pixels so they are only uploaded when the view or the tempo changes
+  PROFILE("glDraw/bars");
+  const auto barsKey = std::array{startTime, rangeTime, 1. * tempo, 1. * Width};
+  if (barsKey != barsMeshKey)
   {
-    if (x % 4 == 0)
-      glColor4f(1.f, 1.f, 1.f, .096f);
-    else
-      glColor4f(1.f, 1.f, 1.f, .04f);
-    const auto pxX = static_cast<float>((x * beatDuration - startTime) * Width / rangeTime);
-    glVertex2f(pxX, 0);
-    glVertex2f(pxX, 1);
+    barsMeshKey = barsKey;
+    const auto beatDuration = 60. / tempo;
+    lineVertices.clear();
+    for (auto x = static_cast<int>(startTime / beatDuration); x * beatDuration < startTime + rangeTime;
+         ++x)
+    {
+      const auto alpha = x % 4 == 0 ? .096f : .04f;
+      const auto pxX = static_cast<float>((x * beatDuration - startTime) * Width / rangeTime);
+      lineVertices.push_back({{pxX, 0.f}, {0.f, 0.f}, {1.f, 1.f, 1.f, alpha}});
+      lineVertices.push_back({{pxX, 1.f}, {0.f, 0.f}, {1.f, 1.f, 1.f, alpha}});
+    }
+    gl->lineRenderer.upload(gl->barsMesh, lineVertices);
   }
-  glEnd();
+  gl->lineRenderer.draw(
+    gl->barsMesh, GL_LINES, {0., 0.}, {1.f, 1.f * specHeight}, {Width, 1.f * specHeight});
 
-  drawMarkers();
+  drawNotes(specHeight);
+  drawMarkers(specHeight);
+}
 
-  // draw a scrubber
-  glViewport(0, 0, (int)io.DisplaySize.x, static_cast<int>(Height - 20));
-  glMatrixMode(GL_PROJECTION);
-  glLoadIdentity();
-  glOrtho(0, Width, 0.f, 1.f, -1, 1);
-
-  glColor4f(1.f, 0.f, 0.5f, 0.25f);
-  glBegin(GL_LINES);
-  glVertex2f(static_cast<float>((1.f * displayCursor - startTime) / rangeTime * Width), 0.f);
-  glVertex2f(static_cast<float>((1.f * displayCursor - startTime) / rangeTime * Width), 1.0f);
-  glEnd();
+auto App::isMeshFar(const LineRenderer::Mesh &mesh) const -> bool
+{
+  // float positions relative to the mesh origin keep a small fraction of a pixel within this many view
+  // widths of it, the mesh is uploaded again around the view before that
+  static const auto MaxMeshDistance = 64.;
+  return std::abs(startTime - mesh.origin()[0]) > MaxMeshDistance * rangeTime;
 }
 
-auto App::drawMarkers() -> void
+auto App::drawMarkers(int height) -> void
 {
+  PROFILE("glDraw/markers");
   const auto &io = ImGui::GetIO();
   const auto Width = io.DisplaySize.x;
-  glBegin(GL_LINES);
-  for (const auto &marker : markers)
+  // in seconds and notes, the view only changes the uniforms; the crosses are sized in pixels
+  const auto &markers = track().markers;
+  const auto selected = selectedMarker == std::end(markers) ? -1 : selectedMarker - std::begin(markers);
+  const auto key = std::array{markersVersion, static_cast<int64_t>(selected), static_cast<int64_t>(height)};
+  if (key != markersMeshKey || isMeshFar(gl->markersMesh))
   {
-    const auto x0 =
-      static_cast<float>((sample2Time(marker.sample) - startTime - marker.dTime) * Width / rangeTime);
-    const auto y0 = static_cast<float>((marker.note - startNote) / rangeNote);
-    const auto x = static_cast<float>((sample2Time(marker.sample) - startTime) * Width / rangeTime);
-    const auto y = static_cast<float>((marker.note - startNote + marker.pitchBend) / rangeNote);
-    glColor3f(0.5f, 0.5f, 0.5f);
-    glVertex2f(x0, y0);
-    glVertex2f(x, y);
-
-    glVertex2f(x0 - 2, y0 - 0.0025f);
-    glVertex2f(x0 + 2, y0 + 0.0025f);
-    glVertex2f(x0 + 2, y0 - 0.0025f);
-    glVertex2f(x0 - 2, y0 + 0.0025f);
-
-    if (selectedMarker != std::end(markers) && &marker == &(*selectedMarker))
-      glColor3f(0.f, 1.0f, 1.f);
-    else
-      glColor3f(0.f, 0.5f, 1.f);
-    glVertex2f(x - 2, y - 0.0025f);
-    glVertex2f(x + 2, y + 0.0025f);
-    glVertex2f(x + 2, y - 0.0025f);
-    glVertex2f(x - 2, y + 0.0025f);
+    markersMeshKey = key;
+    const auto h = 0.0025f * height;
+    lineVertices.clear();
+    for (auto i = 0U; i < markers.size(); ++i)
+    {
+      const auto &marker = markers[i];
+      const auto x0 = static_cast<float>(sample2Time(marker.sample) - marker.dTime - startTime);
+      const auto y0 = static_cast<float>(marker.note);
+      const auto x = static_cast<float>(sample2Time(marker.sample) - startTime);
+      const auto y = static_cast<float>(marker.note + marker.pitchBend);
+      const auto gray = std::array{0.5f, 0.5f, 0.5f, 1.f};
+      const auto blue = static_cast<int64_t>(i) == selected ? std::array{0.f, 1.f, 1.f, 1.f}
+                                                           : std::array{0.f, .5f, 1.f, 1.f};
+      lineVertices.push_back({{x0, y0}, {0.f, 0.f}, gray});
+      lineVertices.push_back({{x, y}, {0.f, 0.f}, gray});
+
+      lineVertices.push_back({{x0, y0}, {-2.f, -h}, gray});
+      lineVertices.push_back({{x0, y0}, {2.f, h}, gray});
+      lineVertices.push_back({{x0, y0}, {2.f, -h}, gray});
+      lineVertices.push_back({{x0, y0}, {-2.f, h}, gray});
+
+      lineVertices.push_back({{x, y}, {-2.f, -h}, blue});
+      lineVertices.push_back({{x, y}, {2.f, h}, blue});
+      lineVertices.push_back({{x, y}, {2.f, -h}, blue});
+      lineVertices.push_back({{x, y}, {-2.f, h}, blue});
+    }
+    gl->lineRenderer.upload(gl->markersMesh, lineVertices, {startTime, 0.});
   }
-  glEnd();
+  gl->lineRenderer.draw(gl->markersMesh,
+                        GL_LINES,
+                        {startTime, startNote},
+                        {static_cast<float>(Width / rangeTime), height / rangeNote},
+                        {Width, 1.f * height});
 }
 
-auto App::loadAudioFile(const std::string &path) -> void
+auto App::drawNotes(int height) -> void
 {
-  // get format from audio file
-  AVFormatContext *format = avformat_alloc_context();
-  if (avformat_open_input(&format, path.c_str(), NULL, NULL) != 0)
-  {
-    LOG("Could not open file", path);
-    return;
-  }
-  if (avformat_find_stream_info(format, NULL) < 0)
+  PROFILE("glDraw/notes");
+  const auto &io = ImGui::GetIO();
+  const auto Width = io.DisplaySize.x;
+  // every grain of a blob is a short bar at the blob's note moved by the pitch bend at the grain
+  const auto key = std::array{markersVersion, pitchVersion};
+  if (key != notesMeshKey || isMeshFar(gl->notesMesh))
   {
-    LOG("Could not retrieve stream info from file", path);
-    return;
+    notesMeshKey = key;
+    lineVertices.clear();
+    const auto color = std::array{1.f, .8f, .2f, .5f};
+    const auto &t = track();
+    for (const auto &blob : t.blobs)
+      for (auto i = blob.firstGrain; i < blob.endGrain; ++i)
+      {
+        const auto grain = t.grains[i];
+        const auto t0 = sample2Time(grain.start);
+        const auto t1 = sample2Time(grain.start + grain.size);
+        const auto y = static_cast<float>(blob.note + time2PitchBend(t0));
+        for (const auto dy : {-1.5f, 0.f, 1.5f})
+        {
+          lineVertices.push_back({{static_cast<float>(t0 - startTime), y}, {0.f, dy}, color});
+          lineVertices.push_back({{static_cast<float>(t1 - startTime), y}, {0.f, dy}, color});
+        }
+      }
+    gl->lineRenderer.upload(gl->notesMesh, lineVertices, {startTime, 0.});
   }
+  gl->lineRenderer.draw(gl->notesMesh,
+                        GL_LINES,
+                        {startTime, startNote},
+                        {static_cast<float>(Width / rangeTime), height / rangeNote},
+                        {Width, 1.f * height});
+}
 
-  // Find the index of the first audio stream
-  int stream_index = -1;
-  for (auto i = 0U; i < format->nb_streams; i++)
+auto App::loadAudioFile(const std::string &path) -> void
+{
+  // a file added to a project is converted to its sample rate
+  auto dec = std::make_shared<Decoder>(path, tracks.empty() ? 0 : sampleRate);
+  if (!dec->isOpen())
+    return;
+  sampleRate = dec->sampleRate();
+  const auto channels = dec->channels();
+  const auto name = std::filesystem::path(path).stem().string();
+  auto dst = std::vector<float *>{};
+  for (auto c = 0; c < channels; ++c)
   {
-    if (format->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_AUDIO)
-    {
-      stream_index = i;
-      break;
-    }
+    auto t = std::make_unique<Track>();
+    t->name = channels > 1 ? name + " " + std::to_string(c + 1) : name;
+    // the decoder writes into the buffer in place, so it is sized once and never moves while decoding
+    t->wavData.allocate(dec->estimatedSamples());
+    dst.push_back(t->wavData.data());
+    t->loader = dec;
+    t->channel = static_cast<size_t>(c);
+    tracks.push_back(std::move(t));
   }
-  if (stream_index == -1)
+  dec->start(std::move(dst), dec->estimatedSamples());
+  lastLoaderUpdate = SDL_GetTicks();
+  LOG("Decoding", path, "sample rate", sampleRate, "channels", channels);
+}
+
+auto App::pollExport() -> void
+{
+  if (!wavExport)
+    return;
+  if (wavExport->isDone())
   {
-    LOG("Could not retrieve audio stream from file", path);
+    LOG(wavExport->isOk() ? "export done" : "export failed");
+    wavExport = nullptr;
     return;
   }
-  AVStream *stream = format->streams[stream_index];
-
-// disable warnings about API calls that are deprecated
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+  ImGui::Begin("Export");
+  ImGui::ProgressBar(wavExport->progress());
+  if (ImGui::Button("Cancel"))
+    wavExport = nullptr;
+  ImGui::End();
+}
 
-  // find & open codec
-  AVCodecContext *codec = stream->codec;
-  if (avcodec_open2(codec, avcodec_find_decoder(codec->codec_id), NULL) < 0)
+auto App::pollPitchDetector() -> void
+{
+  for (auto &t : tracks)
   {
-    LOG("Failed to open decoder for stream #", stream_index, "in file", path);
-    return;
+    if (!t->pitchDetector || !t->pitchDetector->isDone())
+      continue;
+    t->pitchTrack = t->pitchDetector->take();
+    t->pitchDetector = nullptr;
+    t->pitchPin = {};
+    t->blobs = noteBlobs(t->pitchTrack);
+    ++pitchVersion;
+    isDirty = true;
   }
+}
 
-  // prepare resampler
-  struct SwrContext *swr = swr_alloc();
-  av_opt_set_int(swr, "in_channel_count", codec->channels, 0);
-  av_opt_set_int(swr, "out_channel_count", 1, 0);
-  av_opt_set_int(swr, "in_channel_layout", codec->channel_layout, 0);
-  av_opt_set_int(swr, "out_channel_layout", AV_CH_LAYOUT_MONO, 0);
-  av_opt_set_int(swr, "in_sample_rate", codec->sample_rate, 0);
-  sampleRate = codec->sample_rate;
-  av_opt_set_int(swr, "out_sample_rate", sampleRate, 0);
-  av_opt_set_sample_fmt(swr, "in_sample_fmt", codec->sample_fmt, 0);
-  av_opt_set_sample_fmt(swr, "out_sample_fmt", AV_SAMPLE_FMT_FLT, 0);
-  swr_init(swr);
-  if (!swr_is_initialized(swr))
+auto App::startPitchDetection(Track &t) -> void
+{
+  t.pitchDetector = nullptr;
+  if (t.pitchTrack.isValid(t.grains))
   {
-    fprintf(stderr, "Resampler has not been properly initialized\n");
+    t.blobs = noteBlobs(t.pitchTrack);
+    ++pitchVersion;
     return;
   }
+  t.pitchTrack.clear();
+  t.blobs.clear();
+  ++pitchVersion;
+  // the detector reads every grain once, a compressed project is decompressed until it is done
+  t.pitchPin = t.wavData.pin(0, static_cast<size_t>(t.sampleCount));
+  t.pitchDetector = std::make_unique<PitchDetector>(
+    t.wavData.span().first(static_cast<size_t>(t.sampleCount)), t.grains, sampleRate);
+}
 
-  // prepare to read data
-  AVPacket *packet = av_packet_alloc();
+auto App::snapNote(int sample, double time, double note, double range) const -> double
+{
+  const auto &grains = track().grains;
+  const auto &blobs = track().blobs;
+  // the grain containing the sample is the one before the first starting after it
+  const auto next = grains.find(sample + 1);
+  if (next == 0)
+    return note;
+  const auto blob = findBlob(blobs, next - 1);
+  if (blob == blobs.size())
+    return note;
+  const auto snapped = blobs[blob].note + time2PitchBend(time);
+  return std::abs(snapped - note) < range ? snapped : note;
+}
 
-  AVFrame *frame = av_frame_alloc();
-  if (!frame)
-  {
-    fprintf(stderr, "Error allocating the frame\n");
+auto App::pollLoader() -> void
+{
+  if (!isLoading())
     return;
-  }
+  // extending the grains and rebuilding the waveform levels is linear in the decoded length, the
+  // progress is picked up a few times a second
+  const auto now = SDL_GetTicks();
+  const auto isDone = std::any_of(std::begin(tracks), std::end(tracks), [](const auto &t) {
+    return t->loader && t->loader->isDone();
+  });
+  if (!isDone && now - lastLoaderUpdate < 500)
+    return;
+  lastLoaderUpdate = now;
+  for (auto i = 0U; i < tracks.size(); ++i)
+    if (tracks[i]->loader)
+      pollLoader(i);
+}
 
-  // iterate through frames
-  wavData.clear();
-  while (av_read_frame(format, packet) >= 0)
+auto App::pollLoader(size_t idx) -> void
+{
+  auto &t = *tracks[idx];
+  const auto isDone = t.loader->isDone();
+  const auto n = t.loader->available();
+  if (!isDone && n == static_cast<size_t>(t.sampleCount))
+    return;
+  if (isDone)
   {
-    // decode one frame
-    int gotFrame;
-
-    // skip frame if stream index does not match
-    if (packet->stream_index != stream_index)
-      continue;
-
-    if (avcodec_decode_audio4(codec, frame, &gotFrame, packet) < 0)
+    t.wavData.truncate(n);
+    const auto &rest = t.loader->overflow(t.channel);
+    if (!rest.empty())
     {
-      break;
+      // the duration was underestimated and the samples move, the spectrum holds a view of them; the
+      // atlas rows of the old one age out
+      LOG("decoded past the estimated duration", t.name, rest.size());
+      t.spec = nullptr;
+      t.wavData.append(rest);
     }
-    if (!gotFrame)
-    {
-      continue;
-    }
-    // resample frames
-    float *buffer;
-    av_samples_alloc((uint8_t **)&buffer, NULL, 1, frame->nb_samples, AV_SAMPLE_FMT_FLT, 0);
-    int frame_count =
-      swr_convert(swr,
-                  reinterpret_cast<uint8_t **>(&buffer),
-                  frame->nb_samples,
-                  const_cast<const uint8_t **>(reinterpret_cast<uint8_t **>(frame->data)),
-                  frame->nb_samples);
-    // append resampled frames to data
-    const auto sz = wavData.size();
-    wavData.resize(sz + frame->nb_samples);
-    memcpy(wavData.data() + sz, buffer, frame_count * sizeof(float));
+    // the tracks of the other channels can still hold the decoder
+    t.loader = nullptr;
   }
+  t.sampleCount = static_cast<int>(isDone ? t.wavData.size() : n);
 
-// enable warnings about API calls that are deprecated
-#pragma GCC diagnostic pop
-
-  // clean up
-  av_packet_unref(packet);
-  av_frame_free(&frame);
-  swr_free(&swr);
-  avcodec_close(codec);
-  avformat_free_context(format);
+  extendGrains(
+    t.grains, {t.wavData.data(), static_cast<size_t>(t.sampleCount)}, PreferredGrainSize, isDone);
+  if (!isHeadless)
+    calcPicks(t);
+  if (t.loader)
+  {
+    // the next pass of the grain search and the levels starts a little before the last grain end
+    const auto lastGrain = t.grains.empty() ? Grain{} : t.grains[t.grains.size() - 1];
+    const auto grainsEnd = std::min(t.sampleCount, lastGrain.start + lastGrain.size);
+    t.loader->release(static_cast<size_t>(std::max(0, grainsEnd - 2 * PreferredGrainSize)));
+  }
+  // the caches of the view only hold conversions of the active track
+  if (idx == activeTrack)
+    invalidateCache();
+  else
+    publishTimeMap(t, 0);
+  if (isHeadless)
+    return;
+  if (!t.spec)
+    t.spec = std::make_unique<Spec>(
+      t.wavData.span(), [this]() { onSpecJobDone(); }, Spec::defaultWorkers(), t.wavData.blocks());
+  t.spec->setAvailable(static_cast<size_t>(t.sampleCount), isDone);
 
-  LOG("File loaded", path, "duration", 1. * wavData.size() / sampleRate, "sample rate", sampleRate);
+  if (!isDone)
+    return;
+  LOG("Track loaded", t.name, "duration", 1. * t.sampleCount / sampleRate, "grains", t.grains.size());
+  startPitchDetection(t);
+  if (!saveName.empty())
+    t.spec->loadCache(specCachePath(saveName, idx));
 }
 
 auto App::mouseMotion(int x, int y, int dx, int dy, uint32_t state) -> void
 {
-  if (wavData.size() == 0)
+  isDirty = true;
+  if (tracks.empty() || track().sampleCount == 0)
     return;
+  const auto sampleCount = track().sampleCount;
+  auto &markers = track().markers;
 
   y -= 20;
 
@@ -753,9 +966,9 @@ auto App::mouseMotion(int x, int y, int dx, int dy, uint32_t state) -> void
   if (state & SDL_BUTTON_MMASK)
   {
     auto modState = SDL_GetModState();
-    const auto leftLimit = std::max(-rangeTime * 0.5, -.5 * wavData.size() / sampleRate);
+    const auto leftLimit = std::max(-rangeTime * 0.5, -.5 * sampleCount / sampleRate);
     const auto rightLimit =
-      std::min(wavData.size() / sampleRate + rangeTime * 0.5, 1.5 * wavData.size() / sampleRate);
+      std::min(sampleCount / sampleRate + rangeTime * 0.5, 1.5 * sampleCount / sampleRate);
     if ((modState & (KMOD_LCTRL | KMOD_RCTRL)) != 0)
     {
       // zoom in or zoom out
@@ -771,8 +984,8 @@ auto App::mouseMotion(int x, int y, int dx, int dy, uint32_t state) -> void
       else if (newEndTime > rightLimit)
         rangeTime = rightLimit - startTime;
       waveformCache.clear();
-      specCache = nullptr;
       followMode = false;
+      updateSpecFocus();
     }
     else if ((modState & (KMOD_LALT | KMOD_RALT)) != 0)
     {
@@ -814,6 +1027,7 @@ auto App::mouseMotion(int x, int y, int dx, int dy, uint32_t state) -> void
       startTime = newStartTime;
       waveformCache.clear();
       followMode = false;
+      updateSpecFocus();
     }
   }
   else if (state & SDL_BUTTON_LMASK)
@@ -822,9 +1036,7 @@ auto App::mouseMotion(int x, int y, int dx, int dy, uint32_t state) -> void
     {
       if (!audio)
         return;
-      audio->lock();
       cursorSec = std::clamp(x * rangeTime / Width + startTime, 0., duration());
-      audio->unlock();
     }
     else if (selectedMarker != std::end(markers))
     {
@@ -832,74 +1044,72 @@ auto App::mouseMotion(int x, int y, int dx, int dy, uint32_t state) -> void
       const auto dY = dy * rangeNote / Height;
       selectedMarker->dTime += dX;
       selectedMarker->pitchBend -= dY;
-      invalidateCache();
+      invalidateCache(selectedMarker - std::begin(markers));
     }
   }
 }
 
-auto App::invalidateCache() const -> void
+auto App::invalidateCache(size_t firstMarker) -> void
 {
-  if (audio)
-    audio->lock();
+  ++markersVersion;
   sample2TimeCache.clear();
   time2SampleCache.clear();
   time2PitchBendCache.clear();
-  waveformCache.clear();
-  if (specCache)
-    specCache->clear();
-  if (audio)
-    audio->unlock();
+  auto &t = track();
+  publishTimeMap(t, firstMarker);
+  // the spectrogram rows are keyed by sample ranges which a warp does not change, the columns pick up the
+  // new mapping on the next draw; only the waveform pixels after the unchanged prefix are recomputed
+  waveformDirtyTime = std::min(waveformDirtyTime, t.timeMap.get()->unchangedUntil(firstMarker));
 }
 
-auto App::getTex(double start) -> GLuint
+auto App::publishTimeMap(Track &t, size_t firstMarker) -> void
 {
-  const auto &io = ImGui::GetIO();
-  const auto Width = io.DisplaySize.x;
-  if (!spec)
-  {
-    static Texture nullTexture = []() {
-      Texture ret;
-      static std::vector<std::array<unsigned char, 3>> data;
-      data.resize(16);
-
-      glBindTexture(GL_TEXTURE_1D, ret.get());
-      glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-      glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-      glTexImage1D(GL_TEXTURE_1D,                     // target
-                   0,                                 // level
-                   3,                                 // internalFormat
-                   static_cast<GLsizei>(data.size()), // width
-                   0,                                 // border
-                   GL_RGB,                            // format
-                   GL_UNSIGNED_BYTE,                  // type
-                   data.data()                        // data
-      );
-      return ret;
-    }();
-    return nullTexture.get();
-  }
-  if (!specCache)
-    specCache = std::make_unique<SpecCache>(
-      *spec, k, Width, rangeTime, [this](double val) { return time2Sample(val); });
-  return specCache->getTex(start);
+  // the audio thread picks up the new version on its next callback
+  if (firstMarker > 0 && t.timeMap.get())
+    t.timeMap.publish(std::make_unique<TimeMap>(*t.timeMap.get(), firstMarker, t.markers));
+  else
+    t.timeMap.publish(std::make_unique<TimeMap>(t.markers, sampleRate, t.sampleCount));
+  // playback goes on until the longest track is done
+  auto longest = 0.;
+  for (const auto &track : tracks)
+    if (const auto tm = track->timeMap.get())
+      longest = std::max(longest, tm->duration());
+  mixDuration = longest;
+}
+
+auto App::setActiveTrack(size_t idx) -> void
+{
+  if (idx == activeTrack || idx >= tracks.size())
+    return;
+  isDirty = true;
+  activeTrack = idx;
+  selectedMarker = std::end(track().markers);
+  // the waveform, the notes and the conversions are of the old track
+  waveformCache.clear();
+  ++pitchVersion;
+  invalidateCache();
+  updateSpecFocus();
 }
 
 auto App::mouseButton(int x, int y, uint32_t state, uint8_t button) -> void
 {
+  isDirty = true;
   y -= 20;
   const auto &io = ImGui::GetIO();
   const auto Width = io.DisplaySize.x;
   const auto Height = io.DisplaySize.y * .9 - 20;
+  if (tracks.empty())
+    return;
+  const auto sampleCount = track().sampleCount;
+  auto &markers = track().markers;
 
-  audio->lock();
   std::sort(
     markers.begin(), markers.end(), [](const auto &a, const auto &b) { return a.sample < b.sample; });
-  audio->unlock();
   if (button == SDL_BUTTON_LEFT)
   {
     if (state != SDL_PRESSED)
       return;
-    if (wavData.size() < 2)
+    if (sampleCount < 2)
       return;
 
     if (y > Height)
@@ -908,16 +1118,12 @@ auto App::mouseButton(int x, int y, uint32_t state, uint8_t button) -> void
       followMode = false;
       if (!audio)
         return;
-      audio->lock();
       cursorSec = std::clamp(x * rangeTime / Width + startTime, 0., duration());
-      audio->unlock();
     }
     else
     {
       const auto time = x * rangeTime / Width + startTime;
-      audio->lock();
       const auto sample = time2Sample(time);
-      audio->unlock();
       const auto note = (Height - y) * rangeNote / Height + startNote;
       const auto dTime = 8 * rangeTime / Width;
       const auto dNote = 8 * rangeNote / Height;
@@ -930,17 +1136,17 @@ auto App::mouseButton(int x, int y, uint32_t state, uint8_t button) -> void
       if (it == std::end(markers))
       {
         // add marker
-        audio->lock();
         const auto pitchBend = time2PitchBend(time);
-        markers.push_back(Marker{sample, note - pitchBend, 0., pitchBend});
+        // within a note or 16 pixels of a blob
+        const auto snapped = snapToPitch ? snapNote(sample, time, note, std::max(1., 2 * dNote)) : note;
+        markers.push_back(Marker{sample, snapped - pitchBend, 0., pitchBend});
         std::sort(markers.begin(), markers.end(), [](const auto &a, const auto &b) {
           return a.sample < b.sample;
         });
-        audio->unlock();
-        invalidateCache();
         selectedMarker = std::find_if(std::begin(markers), std::end(markers), [sample](const auto &m) {
           return m.sample == sample;
         });
+        invalidateCache(selectedMarker - std::begin(markers));
       }
       else
       {
@@ -955,7 +1161,7 @@ auto App::mouseButton(int x, int y, uint32_t state, uint8_t button) -> void
     if (state != SDL_PRESSED)
       return;
     // remove marker
-    if (wavData.size() < 2)
+    if (sampleCount < 2)
       return;
     const auto time = x * rangeTime / Width + startTime;
     const auto note = (Height - y) * rangeNote / Height + startNote;
@@ -968,27 +1174,61 @@ auto App::mouseButton(int x, int y, uint32_t state, uint8_t button) -> void
       });
     if (it != std::end(markers))
     {
-      audio->lock();
+      const auto idx = it - std::begin(markers);
       markers.erase(it);
       selectedMarker = std::end(markers);
-      audio->unlock();
-      invalidateCache();
+      invalidateCache(idx);
     }
   }
 }
 
+auto App::needsRedraw() -> bool
+{
+  // playback moves the cursor, loading and exporting update their progress
+  const auto isSpec = isSpecUpdated.exchange(false);
+  const auto isUploading = specCache && specCache->hasPendingUploads();
+  // the profiler plots scroll every frame
+  return isDirty || isSpec || isUploading || isAudioPlaying || isLoading() || wavExport ||
+         isDetectingPitch() || isProfilerOpen;
+}
+
+auto App::isLoading() const -> bool
+{
+  return std::any_of(
+    std::begin(tracks), std::end(tracks), [](const auto &t) { return t->loader != nullptr; });
+}
+
+auto App::isDetectingPitch() const -> bool
+{
+  return std::any_of(
+    std::begin(tracks), std::end(tracks), [](const auto &t) { return t->pitchDetector != nullptr; });
+}
+
+auto App::onSpecJobDone() -> void
+{
+  // runs on a spectrum worker; one pending event is enough to wake the main loop for the next frame
+  if (isSpecUpdated.exchange(true))
+    return;
+  auto event = SDL_Event{};
+  event.type = SDL_USEREVENT;
+  SDL_PushEvent(&event);
+}
+
 auto App::togglePlay() -> void
 {
-  if (!audio)
+  isDirty = true;
+  // the grains and the samples only stop changing once the file is decoded
+  if (!audio || isLoading())
     return;
-  isAudioPlaying = !isAudioPlaying;
+  isAudioPlaying = !isAudioPlaying.load();
   if (isAudioPlaying)
     audio->pause(false);
 }
 
 auto App::cursorLeft() -> void
 {
-  if (wavData.size() < 2)
+  isDirty = true;
+  if (tracks.empty() || track().sampleCount < 2)
     return;
   ImGuiIO &io = ImGui::GetIO();
   (void)io;
@@ -996,141 +1236,185 @@ auto App::cursorLeft() -> void
   const auto Width = io.DisplaySize.x;
   if (!audio)
     return;
-  audio->lock();
-  cursorSec = std::clamp(cursorSec - 4 * rangeTime / Width, 0., duration());
-  audio->unlock();
+  cursorSec = std::clamp(cursorSec.load() - 4 * rangeTime / Width, 0., duration());
 }
 
 auto App::cursorRight() -> void
 {
-  if (wavData.size() < 2)
+  isDirty = true;
+  if (tracks.empty() || track().sampleCount < 2)
     return;
   const auto &io = ImGui::GetIO();
   followMode = false;
   const auto Width = io.DisplaySize.x;
   if (!audio)
     return;
-  audio->lock();
-  cursorSec = std::clamp(cursorSec + 4 * rangeTime / Width, 0., duration());
-  audio->unlock();
+  cursorSec = std::clamp(cursorSec.load() + 4 * rangeTime / Width, 0., duration());
 }
 
+// the UI thread caches the conversions of the active track on top of its latest published time map
+
 auto App::sample2Time(int val) const -> double
 {
-  // markers are sorted by sample
-
-  if (val <= 0)
-    return 1. * val / sampleRate;
-
-  const auto it = sample2TimeCache.find(val);
-  if (it != std::end(sample2TimeCache))
-    return it->second;
-
-  auto prevSample = 0;
-  auto prevTime = 0.0;
-  for (const auto &marker : markers)
-  {
-    const auto rightTime = prevTime + 1.0 * (marker.sample - prevSample) / sampleRate + marker.dTime;
-    if (val > prevSample && val <= marker.sample)
-    {
-      const auto ret =
-        prevTime + (val - prevSample) * (rightTime - prevTime) / (marker.sample - prevSample);
-      sample2TimeCache[val] = ret;
-      return ret;
-    }
-    prevSample = marker.sample;
-    prevTime = rightTime;
-  }
-
-  const auto ret = prevTime + 1. * (val - prevSample) / sampleRate;
-  sample2TimeCache[val] = ret;
-  return ret;
+  static auto &misses = profiler().counter("timeMap/sample2Time misses");
+  return sample2TimeCache.get(val, [&]() {
+    misses.add();
+    return track().timeMap.get()->sample2Time(val);
+  });
 }
 
 auto App::time2Sample(double val) const -> int
 {
-  // markers are sorted by sample
-
-  if (val <= 0)
-    return static_cast<int>(val * sampleRate);
-
-  const auto it = time2SampleCache.find(static_cast<int>(val * sampleRate));
-  if (it != std::end(time2SampleCache))
-    return it->second;
-
-  auto prevSample = 0;
-  auto prevTime = 0.0;
-  for (const auto &marker : markers)
-  {
-    const auto rightTime = prevTime + 1.0 * (marker.sample - prevSample) / sampleRate + marker.dTime;
-    if (val > prevTime && val <= rightTime)
-    {
-      const auto ret = static_cast<int>(prevSample + (val - prevTime) * (marker.sample - prevSample) /
-                                                       (rightTime - prevTime));
-      time2SampleCache[static_cast<int>(val * sampleRate)] = ret;
-      return ret;
-    }
-    prevSample = marker.sample;
-    prevTime = rightTime;
-  }
-
-  const auto ret = static_cast<int>(prevSample + (val - prevTime) * sampleRate);
-  time2SampleCache[static_cast<int>(val * sampleRate)] = ret;
-  return ret;
+  const auto key = static_cast<int>(val * sampleRate);
+  static auto &misses = profiler().counter("timeMap/time2Sample misses");
+  return time2SampleCache.get(key, [&]() {
+    misses.add();
+    return track().timeMap.get()->time2Sample(val);
+  });
 }
 
 auto App::duration() const -> double
 {
-  return sample2Time(static_cast<int>(wavData.size() - 1));
+  return mixDuration;
 }
 
 auto App::time2PitchBend(double val) const -> float
 {
-  if (val <= 0)
-    return 0;
-  const auto it = time2PitchBendCache.find(static_cast<int>(val * sampleRate));
-  if (it != std::end(time2PitchBendCache))
-    return it->second;
-
-  auto prevSample = 0;
-  auto prevTime = 0.0;
-  auto prevPitchBend = 0.0;
-  for (const auto &marker : markers)
-  {
-    const auto rightTime = prevTime + 1.0 * (marker.sample - prevSample) / sampleRate + marker.dTime;
-    if (val > prevTime && val <= rightTime)
-    {
-      const auto ret = static_cast<float>(
-        prevPitchBend + (val - prevTime) * (marker.pitchBend - prevPitchBend) / (rightTime - prevTime));
-      time2PitchBendCache[static_cast<int>(val * sampleRate)] = ret;
-      return ret;
-    }
-    prevSample = marker.sample;
-    prevTime = rightTime;
-    prevPitchBend = marker.pitchBend;
-  }
-
-  if (val > duration())
-    return 0;
-
-  const auto ret =
-    static_cast<float>(prevPitchBend + (val - prevTime) * (0 - prevPitchBend) / (duration() - prevTime));
-  time2PitchBendCache[static_cast<int>(val * sampleRate)] = ret;
-  return ret;
+  const auto key = static_cast<int>(val * sampleRate);
+  static auto &misses = profiler().counter("timeMap/time2PitchBend misses");
+  return time2PitchBendCache.get(key, [&]() {
+    misses.add();
+    return track().timeMap.get()->time2PitchBend(val);
+  });
 }
 
+namespace
+{
+  // a samples chunk per track in the order of the tracks, page aligned and used in place; the metadata
+  // goes last so a save after an edit only rewrites it
+  const auto SamplesChunk = ChunkTag{'S', 'M', 'P', 'L'};
+  const auto MetaChunk = ChunkTag{'M', 'E', 'T', 'A'};
+  // alternative to the samples chunk, block compressed and decompressed in the background on load
+  const auto CompressedSamplesChunk = ChunkTag{'C', 'S', 'M', 'P'};
+
+  // versions 1 and 2 were a single serialized blob with the samples first
+  struct LegacyV1
+  {
+    std::vector<float> &wavData;
+    int &sampleRate;
+    float &brightness;
+    std::vector<Marker> &markers;
+    float &tempo;
+
+#define SER_PROP_LIST   \
+  SER_PROP(wavData);    \
+  SER_PROP(sampleRate); \
+  SER_PROP(brightness); \
+  SER_PROP(markers);    \
+  SER_PROP(tempo);
+
+    SER_DEF_PROPS()
+#undef SER_PROP_LIST
+  };
+
+  struct LegacyV2
+  {
+    std::vector<float> &wavData;
+    int &sampleRate;
+    float &brightness;
+    std::vector<Marker> &markers;
+    float &tempo;
+    GrainIndex &grains;
+
+#define SER_PROP_LIST   \
+  SER_PROP(wavData);    \
+  SER_PROP(sampleRate); \
+  SER_PROP(brightness); \
+  SER_PROP(markers);    \
+  SER_PROP(tempo);      \
+  SER_PROP(grains);
+
+    SER_DEF_PROPS()
+#undef SER_PROP_LIST
+  };
+} // namespace
+
 auto App::loadMelonixFile(const std::string &fileName) -> void
 {
   LOG("loadMelonixFile", fileName);
 
   cleanup();
 
+  auto file = std::make_shared<ProjectFile>(fileName);
+  if (file->isOpen())
+  {
+    if (file->version() < 3 || file->version() > version)
+    {
+      LOG("version mismatch", file->version(), version);
+      return;
+    }
+    loadMeta(file->chunk(MetaChunk),
+             file->version(),
+             MetaSettings{sampleRate, brightness, tempo},
+             std::filesystem::path(fileName).stem().string(),
+             tracks);
+    auto chunks = std::vector<std::pair<ChunkTag, std::span<char>>>{};
+    for (const auto &chunk : file->all())
+      if (chunk.first == SamplesChunk || chunk.first == CompressedSamplesChunk)
+        chunks.push_back(chunk);
+    if (chunks.size() != tracks.size())
+    {
+      LOG("corrupted project", fileName, "tracks", tracks.size(), "samples chunks", chunks.size());
+      cleanup();
+      return;
+    }
+    isSamplesFileCompressed = false;
+    for (auto i = 0U; i < tracks.size(); ++i)
+    {
+      auto &t = *tracks[i];
+      const auto &[tag, chunk] = chunks[i];
+      if (tag == SamplesChunk)
+        t.wavData.map(
+          file, std::span<float>{reinterpret_cast<float *>(chunk.data()), chunk.size() / sizeof(float)});
+      else
+      {
+        if (compressedSampleCount(chunk) == 0)
+        {
+          LOG("corrupted samples chunk", fileName, t.name);
+          cleanup();
+          return;
+        }
+        auto blocks = std::make_unique<BlockCache>(file, chunk, BlockBudget);
+        if (blocks->size() == 0)
+        {
+          LOG("failed to map the samples", fileName, t.name);
+          cleanup();
+          return;
+        }
+        t.loader = std::make_shared<Decompressor>(*blocks);
+        t.wavData.attach(std::move(blocks));
+        isSamplesFileCompressed = true;
+        lastLoaderUpdate = SDL_GetTicks();
+      }
+      t.sampleCount = t.loader ? 0 : static_cast<int>(t.wavData.size());
+    }
+    samplesFile = std::filesystem::absolute(fileName).string();
+  }
+  else if (!loadLegacyMelonixFile(fileName))
+    return;
+
+  saveName = std::filesystem::absolute(fileName).string();
+  preproc();
+}
+
+auto App::loadLegacyMelonixFile(const std::string &fileName) -> bool
+{
   // load file into memory
   auto file = std::ifstream{fileName, std::ios::binary};
   if (!file.is_open())
   {
     LOG("failed to open file", fileName);
-    return;
+    return false;
   }
   auto buffer = std::vector<char>{};
   buffer.resize(static_cast<size_t>(file.seekg(0, std::ios::end).tellg()));
@@ -1140,22 +1424,52 @@ auto App::loadMelonixFile(const std::string &fileName) -> void
   IStrm st(buffer.data(), buffer.data() + buffer.size());
   int v;
   ::deser(st, v);
-  if (v != version)
+  auto samples = std::vector<float>{};
+  auto t = std::make_unique<Track>();
+  t->name = std::filesystem::path(fileName).stem().string();
+  if (v == 1)
+  {
+    // version 1 had no grain index, preproc recomputes it
+    auto legacy = LegacyV1{samples, sampleRate, brightness, t->markers, tempo};
+    ::deser(st, legacy);
+  }
+  else if (v == 2)
+  {
+    auto legacy = LegacyV2{samples, sampleRate, brightness, t->markers, tempo, t->grains};
+    ::deser(st, legacy);
+  }
+  else
   {
     LOG("version mismatch", v, version);
-    return;
+    return false;
   }
-  ::deser(st, *this);
-
-  saveName = std::filesystem::absolute(fileName).string();
-  preproc();
+  t->wavData.assign(std::move(samples));
+  t->sampleCount = static_cast<int>(t->wavData.size());
+  tracks.push_back(std::move(t));
+  // the next save writes the chunked format
+  samplesFile = "";
+  return true;
 }
 
 auto App::cleanup() -> void
 {
+  // stop decoding and exporting before anything they use goes away, the tracks of the channels of a file
+  // share its decoder
+  wavExport = nullptr;
+  for (auto &t : tracks)
+  {
+    t->pitchDetector = nullptr;
+    t->loader = nullptr;
+  }
+  for (auto i = 0U; i < tracks.size(); ++i)
+    if (tracks[i]->spec && !saveName.empty())
+      tracks[i]->spec->saveCache(specCachePath(saveName, i));
   specCache = nullptr;
-  spec = nullptr;
   audio = nullptr;
+  tracks.clear();
+  activeTrack = 0;
+  mixDuration = 0.;
+  ++pitchVersion;
   startTime = 0.;
   rangeTime = 10.;
   cursorSec = 0;
@@ -1167,45 +1481,125 @@ auto App::saveMelonixFile(std::string fileName) -> void
   if (ext != ".melonix")
     fileName += ".melonix";
 
+  if (isLoading())
+  {
+    LOG("the samples are still loading");
+    return;
+  }
+
   // save absolute path to the file
   saveName = std::filesystem::absolute(fileName).string();
 
   LOG("saveMelonixFile", saveName);
 
-  OStrm st;
-  ::ser(st, version);
-  ::ser(st, *this);
+  const auto metaData = saveMeta(MetaSettings{sampleRate, brightness, tempo}, tracks);
+  const auto meta = std::span<const char>{metaData};
 
-  auto file = std::ofstream{fileName, std::ios::binary};
-  if (!file.is_open())
+  // the samples never change after the import, a file which already has them only gets the new metadata
+  if (samplesFile != saveName || isSamplesFileCompressed != compressProject ||
+      !ProjectFile::replaceLast(saveName, MetaChunk, meta))
   {
-    LOG("failed to open file", fileName);
-    return;
+    // compressed samples are written as they are, raw ones are decompressed while they are written
+    auto compressed = std::vector<std::vector<char>>(tracks.size());
+    auto pins = std::vector<BlockCache::Pin>{};
+    auto chunks = std::vector<std::pair<ChunkTag, std::span<const char>>>{};
+    for (auto i = 0U; i < tracks.size(); ++i)
+    {
+      const auto &wavData = tracks[i]->wavData;
+      const auto blocks = wavData.blocks();
+      if (compressProject)
+      {
+        if (!blocks)
+          compressed[i] = compressSamples(wavData.span());
+        chunks.emplace_back(CompressedSamplesChunk,
+                            blocks ? blocks->chunk() : std::span<const char>{compressed[i]});
+        continue;
+      }
+      pins.push_back(wavData.pin(0, wavData.size()));
+      chunks.emplace_back(SamplesChunk,
+                          std::span<const char>{reinterpret_cast<const char *>(wavData.data()),
+                                                wavData.size() * sizeof(float)});
+    }
+    chunks.emplace_back(MetaChunk, meta);
+    if (!ProjectFile::save(saveName, version, chunks))
+      return;
+    samplesFile = saveName;
+    isSamplesFileCompressed = compressProject;
   }
-  file.write(st.str().data(), st.str().size());
+
+  for (auto i = 0U; i < tracks.size(); ++i)
+    if (tracks[i]->spec)
+      tracks[i]->spec->saveCache(specCachePath(saveName, i));
 }
 
-App::App() : fileSaveAs("Save As..."), exportWavDlg("Export WAV") {}
+App::App(bool aIsHeadless) : isHeadless(aIsHeadless), fileSaveAs("Save As..."), exportWavDlg("Export WAV")
+{
+}
 
-auto App::exportWav(const std::string &fileName) -> void
+App::~App()
 {
-  isAudioPlaying = false;
-  if (audio)
-    audio->pause(true);
+  // the tracks of a file share its decoder, it stops before the first of them goes away
+  for (auto &t : tracks)
+    t->loader = nullptr;
+  for (auto i = 0U; i < tracks.size(); ++i)
+    if (tracks[i]->spec && !saveName.empty())
+      tracks[i]->spec->saveCache(specCachePath(saveName, i));
+}
 
-  auto pcm = std::vector<float>{};
-  for (auto tmpCursor = 0.;;)
+auto App::exportWav(const std::string &fileName) -> void
+{
+  if (tracks.empty() || isLoading())
+    return;
+  if (wavExport)
   {
-    const auto dt = process(tmpCursor, pcm);
-    if (dt <= 0.)
-      break;
-    tmpCursor += dt;
+    LOG("an export is already running");
+    return;
   }
+  auto sources = std::vector<WavExport::Source>{};
+  for (const auto &t : tracks)
+    if (!t->isMuted)
+      sources.push_back(WavExport::Source{t->wavData.span().first(static_cast<size_t>(t->sampleCount)),
+                                          t->grains,
+                                          *t->timeMap.get(),
+                                          t->gain,
+                                          t->wavData.blocks()});
+  if (sources.empty())
+  {
+    LOG("every track is muted");
+    return;
+  }
+  LOG("exportWav", fileName, "tracks", sources.size());
+  // the trailing silence is what playback renders past the last grain
+  wavExport = std::make_unique<WavExport>(fileName,
+                                          std::move(sources),
+                                          sampleRate,
+                                          bias,
+                                          static_cast<size_t>(PreferredGrainSize),
+                                          exportFormat);
+}
 
-  auto pcm16 = std::vector<int16_t>{};
-  pcm16.resize(pcm.size());
-  for (auto i = 0U; i < pcm.size(); ++i)
-    pcm16[i] = static_cast<int16_t>(pcm[i] * 32767.);
-
-  saveWav(fileName, pcm16, sampleRate);
+auto App::render(const std::string &project, const std::string &wav, WavWriter::Format format) -> bool
+{
+  loadMelonixFile(project);
+  // a compressed project decompresses in the background
+  while (isLoading())
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    pollLoader();
+  }
+  if (tracks.empty() || mixDuration == 0.)
+  {
+    LOG("failed to load", project);
+    return false;
+  }
+  exportFormat = format;
+  exportWav(wav);
+  if (!wavExport)
+    return false;
+  while (!wavExport->isDone())
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  const auto isOk = wavExport->isOk();
+  wavExport = nullptr;
+  LOG(isOk ? "rendered" : "failed to render", project, wav);
+  return isOk;
 }
@@ -1,27 +1,38 @@
 #pragma once
+#include "decoder.hpp"
+#include "direct-mapped-cache.hpp"
 #include "file-open.hpp"
 #include "file-save-as.hpp"
+#include "framebuffer.hpp"
+#include "gl.hpp"
+#include "grain-engine.hpp"
+#include "grains.hpp"
+#include "line-renderer.hpp"
 #include "marker.hpp"
+#include "min-max-pyramid.hpp"
+#include "piano.hpp"
+#include "pitch-track.hpp"
 #include "range.hpp"
+#include "rcu.hpp"
+#include "ring-buffer.hpp"
+#include "sample-codec.hpp"
+#include "samples.hpp"
 #include "spec-cache.hpp"
 #include "spec.hpp"
+#include "time-map.hpp"
+#include "track.hpp"
+#include "wav-export.hpp"
+#include <atomic>
 #include <imgui/imgui.h>
 #include <list>
-#include <map>
 #include <sdlpp/sdlpp.hpp>
-#include <ser/macro.hpp>
-#include <unordered_map>
-
-#if defined(IMGUI_IMPL_OPENGL_ES2)
-#include <SDL_opengles2.h>
-#else
-#include <SDL_opengl.h>
-#endif
 
 class App
 {
 public:
-  App();
+  // a headless App has no window, audio or spectrum, it only loads and renders projects
+  explicit App(bool isHeadless = false);
+  ~App();
   auto draw() -> void;
   auto glDraw() -> void;
   auto mouseMotion(int x, int y, int dx, int dy, uint32_t state) -> void;
@@ -30,71 +41,149 @@ public:
   auto cursorLeft() -> void;
   auto cursorRight() -> void;
   auto openFile(const std::string &) -> void;
+  // the main loop sleeps on events while this is false
+  auto needsRedraw() -> bool;
+  // loads the project and exports it, blocks until the file is written
+  auto render(const std::string &project, const std::string &wav, WavWriter::Format) -> bool;
 
 private:
-  const int version = 1;
+  const int version = 5;
+  const bool isHeadless;
   FileOpen fileOpen;
   FileSaveAs fileSaveAs;
   FileSaveAs exportWavDlg;
-  std::vector<float> wavData;
-  std::map<int, std::tuple<std::span<float>, int>> grains;
+  // the audio callback reads the tracks, the list only changes while there is no audio device
+  std::vector<std::unique_ptr<Track>> tracks;
+  // the track which is drawn and edited
+  size_t activeTrack = 0;
+  // the project file whose samples chunks hold the tracks, saving to it only rewrites the metadata
+  std::string samplesFile;
+  bool isSamplesFileCompressed = false;
+  // lossless block compression of the samples chunk, smaller files but no mapping in place
+  bool compressProject = false;
+  bool isProfilerOpen = false;
+  // a new marker takes the detected pitch of the note under it
+  bool snapToPitch = true;
+  WavWriter::Format exportFormat = WavWriter::Format::Pcm16;
+  // bumped by every change of the pitch track and of the active track
+  int64_t pitchVersion = 0;
   int sampleRate = 0;
-  std::vector<std::vector<std::pair<float, float>>> picks;
   double startTime = 0.;
   double rangeTime = 10.;
   double startNote = 24.;
   float rangeNote = 60.f;
   mutable std::vector<std::pair<float, float>> waveformCache;
-  double cursorSec = 0.0;
-  bool isAudioPlaying = false;
+  // waveformCache pixels after this time are stale
+  mutable double waveformDirtyTime = 0.;
+  // shared with the audio callback
+  std::atomic<double> cursorSec = 0.0;
+  std::atomic<bool> isAudioPlaying = false;
+  // the export always uses the high quality resampler
+  std::atomic<bool> isPlaybackHighQuality = false;
+  // the longest track, published with the time maps
+  std::atomic<double> mixDuration = 0.;
+  // the callback mixes the tracks through it, sized with the device buffer
+  std::vector<float> mixBuffer;
   bool followMode = false;
 
-  std::unique_ptr<Spec> spec;
   float brightness = 50.f;
   float k = 0.01f;
   std::unique_ptr<sdl::Audio> audio;
   mutable std::unique_ptr<SpecCache> specCache;
+  // spectrum rows copied to the GPU per frame, more makes a pan fill in sooner but stutter
+  int specUploadBudget = 32;
+  std::vector<std::array<float, 2>> specColumns;
   double displayCursor;
-  Texture pianoTexture;
-  std::vector<Marker> markers;
+  // the GL objects are created by the first glDraw(), a headless App never has a context
+  struct Gl
+  {
+    Piano piano;
+    LineRenderer lineRenderer;
+    LineRenderer::Mesh waveformMesh;
+    LineRenderer::Mesh barsMesh;
+    LineRenderer::Mesh markersMesh;
+    LineRenderer::Mesh scrubberMesh;
+    LineRenderer::Mesh notesMesh;
+    // the waveform, spectrogram, piano, bars and markers as of the last time they were drawn
+    Framebuffer layers;
+  };
+  std::unique_ptr<Gl> gl;
+  // what the meshes were uploaded for
+  std::array<double, 4> barsMeshKey = {};
+  std::array<int64_t, 3> markersMeshKey = {-1, -1, -1};
+  std::array<int64_t, 2> notesMeshKey = {-1, -1};
+  double scrubberMeshCursor = -1.;
+  // bumped by every marker edit and change of the active track
+  int64_t markersVersion = 0;
+  // reused for every upload
+  std::vector<LineRenderer::Vertex> lineVertices;
+  std::array<double, 11> layersKey = {};
+  std::vector<std::array<float, 2>> layersColumns;
+  // input or a state change since the last frame
+  bool isDirty = true;
+  // set by the spectrum workers, cleared by the frame which shows the new columns
+  std::atomic<bool> isSpecUpdated = false;
+  // into the markers of the active track
   std::vector<Marker>::iterator selectedMarker;
-  mutable std::unordered_map<int, double> sample2TimeCache;
-  mutable std::unordered_map<int, int> time2SampleCache;
-  mutable std::unordered_map<int, float> time2PitchBendCache;
+  // the conversions of the active track
+  mutable DirectMappedCache<double> sample2TimeCache;
+  mutable DirectMappedCache<int> time2SampleCache;
+  mutable DirectMappedCache<float> time2PitchBendCache;
   float tempo = 130.f;
   std::string saveName;
   float bias = 0.f;
-  std::vector<float> restWav;
-  std::span<float> prevGrain;
-
-public:
-#define SER_PROP_LIST   \
-  SER_PROP(wavData);    \
-  SER_PROP(sampleRate); \
-  SER_PROP(brightness); \
-  SER_PROP(markers);    \
-  SER_PROP(tempo);
+  uint32_t lastLoaderUpdate = 0;
+  // the file dialog adds tracks to the project instead of opening a new one
+  bool isAddingTracks = false;
+  // background export reading the tracks, declared after them so it is stopped first
+  std::unique_ptr<WavExport> wavExport;
 
-  SER_DEF_PROPS()
-#undef SER_PROP_LIST
-private:
-  auto calcPicks() -> void;
+  // adds a track per channel of the audio file to the project
+  auto addTracks(const std::string &) -> void;
+  auto calcPicks(Track &) -> void;
   auto cleanup() -> void;
-  auto drawMarkers() -> void;
+  auto drawLayers(int waveformHeight, int specHeight, bool isWaveformChanged) -> void;
+  auto drawMarkers(int height) -> void;
+  auto drawNotes(int height) -> void;
   auto duration() const -> double;
   auto estimateGrainSize(int start) const -> int;
   auto exportWav(const std::string &) -> void;
-  auto getMinMaxFromRange(int start, int end) -> std::pair<float, float>;
-  auto getTex(double start) -> GLuint;
+  auto getMinMaxFromRange(int start, int end) const -> std::pair<float, float>;
   auto importFile(const std::string &) -> void;
-  auto invalidateCache() const -> void;
+  // markers of the active track before firstMarker are unchanged since the last call
+  auto invalidateCache(size_t firstMarker = 0) -> void;
+  auto isDetectingPitch() const -> bool;
+  // a track is still loading
+  auto isLoading() const -> bool;
+  // the view moved too far from the origin of a mesh in seconds for its float positions
+  auto isMeshFar(const LineRenderer::Mesh &) const -> bool;
   auto loadAudioFile(const std::string &) -> void;
+  auto loadLegacyMelonixFile(const std::string &) -> bool;
   auto loadMelonixFile(const std::string &) -> void;
+  auto onSpecJobDone() -> void;
+  // keeps the compressed samples around the cursor and in the zoomed in view decompressed
+  auto pinSamples() -> void;
   auto playback(float *, size_t) -> void;
+  auto pollExport() -> void;
+  auto pollLoader() -> void;
+  auto pollLoader(size_t track) -> void;
+  auto pollPitchDetector() -> void;
+  // analyzes the new tracks and opens the audio device
   auto preproc() -> void;
-  auto process(double cursor, std::vector<float> &wav) -> double;
+  auto preproc(size_t track) -> void;
+  auto process(Track &, const GrainEngine &, TimeMap::Cursor &, GrainIndex::Cursor &, double) -> double;
+  auto publishTimeMap(Track &, size_t firstMarker) -> void;
   auto sample2Time(int) const -> double;
   auto saveMelonixFile(std::string) -> void;
+  // the displayed note of the blob at the sample if it is within range of note, note otherwise
+  auto snapNote(int sample, double time, double note, double range) const -> double;
+  auto setActiveTrack(size_t) -> void;
+  // starts the detector unless the project came with a pitch track for its grains
+  auto startPitchDetection(Track &) -> void;
   auto time2PitchBend(double) const -> float;
   auto time2Sample(double) const -> int;
+  // the active track, there is one whenever the audio device is open
+  auto track() -> Track & { return *tracks[activeTrack]; }
+  auto track() const -> const Track & { return *tracks[activeTrack]; }
+  auto updateSpecFocus() -> void;
 };
@@ -0,0 +1,117 @@
+#include "batch-render.hpp"
+#include "app.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <filesystem>
+#include <log/log.hpp>
+#include <memory>
+#include <thread>
+
+auto renderProjects(const std::vector<RenderJob> &jobs, WavWriter::Format format, int threadCount) -> int
+{
+  auto next = std::atomic<size_t>{0};
+  auto failed = std::atomic<int>{0};
+  const auto worker = [&]() {
+    // a worker takes the next project when it is done with one, long projects do not hold up the rest
+    for (auto i = next++; i < jobs.size(); i = next++)
+    {
+      auto app = std::make_unique<App>(true);
+      if (!app->render(jobs[i].project, jobs[i].wav, format))
+        ++failed;
+    }
+  };
+  auto threads = std::vector<std::thread>{};
+  for (auto i = 1; i < std::min(threadCount, static_cast<int>(jobs.size())); ++i)
+    threads.emplace_back(worker);
+  worker();
+  for (auto &thread : threads)
+    thread.join();
+  return failed;
+}
+
+auto directoryJobs(const std::string &dir, const std::string &outDir) -> std::vector<RenderJob>
+{
+  auto ret = std::vector<RenderJob>{};
+  auto ec = std::error_code{};
+  for (const auto &entry : std::filesystem::directory_iterator{dir, ec})
+  {
+    const auto &path = entry.path();
+    if (!entry.is_regular_file() || path.extension() != ".melonix")
+      continue;
+    auto wav = std::filesystem::path{outDir} / path.filename();
+    wav.replace_extension(".wav");
+    ret.push_back(RenderJob{path.string(), wav.string()});
+  }
+  if (ec)
+    LOG("failed to list", dir, ec.message());
+  // the same order on every run
+  std::sort(
+    std::begin(ret), std::end(ret), [](const auto &a, const auto &b) { return a.project < b.project; });
+  return ret;
+}
+
+auto batchMain(int argc, const char *argv[]) -> std::optional<int>
+{
+  auto jobs = std::vector<RenderJob>{};
+  auto isBatch = false;
+  auto format = WavWriter::Format::Pcm16;
+  auto threadCount = static_cast<int>(std::max(1U, std::thread::hardware_concurrency()));
+  for (auto i = 1; i < argc; ++i)
+  {
+    const auto arg = std::string{argv[i]};
+    const auto hasValues = [&](int n) {
+      if (i + n < argc)
+        return true;
+      LOG(arg, "needs", n, "arguments");
+      return false;
+    };
+    if (arg == "--render" || arg == "--render-dir")
+    {
+      isBatch = true;
+      if (!hasValues(2))
+        return 1;
+      if (arg == "--render")
+        jobs.push_back(RenderJob{argv[i + 1], argv[i + 2]});
+      else
+      {
+        auto ec = std::error_code{};
+        std::filesystem::create_directories(argv[i + 2], ec);
+        const auto dirJobs = directoryJobs(argv[i + 1], argv[i + 2]);
+        jobs.insert(std::end(jobs), std::begin(dirJobs), std::end(dirJobs));
+      }
+      i += 2;
+    }
+    else if (arg == "--format")
+    {
+      if (!hasValues(1))
+        return 1;
+      const auto value = std::string{argv[++i]};
+      if (value == "pcm16")
+        format = WavWriter::Format::Pcm16;
+      else if (value == "pcm24")
+        format = WavWriter::Format::Pcm24;
+      else if (value == "float")
+        format = WavWriter::Format::Float32;
+      else
+      {
+        LOG("unknown format", value);
+        return 1;
+      }
+    }
+    else if (arg == "--jobs")
+    {
+      if (!hasValues(1))
+        return 1;
+      threadCount = std::max(1, std::atoi(argv[++i]));
+    }
+  }
+  if (!isBatch)
+    return std::nullopt;
+
+  LOG("rendering", jobs.size(), "projects on", threadCount, "threads");
+  const auto failed = renderProjects(jobs, format, threadCount);
+  if (failed > 0)
+    LOG(failed, "of", jobs.size(), "projects failed");
+  return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include "save-wav.hpp"
+#include <optional>
+#include <string>
+#include <vector>
+
+// Renders projects to WAV files without a window, a GL context or an audio device:
+//
+//   melonix --render in.melonix out.wav [--format pcm16|pcm24|float] [--jobs n]
+//   melonix --render-dir projects/ wavs/ [--format pcm16|pcm24|float] [--jobs n]
+//
+// projects are rendered concurrently, one per job, each export also splits its windows across the cores
+struct RenderJob
+{
+  std::string project;
+  std::string wav;
+};
+
+// number of jobs which failed
+auto renderProjects(const std::vector<RenderJob> &, WavWriter::Format, int jobs) -> int;
+// every .melonix file in dir, rendered to a WAV file with the same name in outDir
+auto directoryJobs(const std::string &dir, const std::string &outDir) -> std::vector<RenderJob>;
+// the exit code if the command line asks for a batch render, nullopt to start the UI
+auto batchMain(int argc, const char *argv[]) -> std::optional<int>;
@@ -0,0 +1,300 @@
+// Headless benchmarks of the DSP and the caches, no window and no audio device.
+//
+// The benchmarked modules are the app's own sources: coddle builds all .cpp files of a directory into
+// one target, so every file next to this one forwards to the source in the parent directory.
+//
+//   bench [file...]
+//
+// runs every benchmark on a synthetic signal and on each decoded file. Every result is one JSON object
+// per line on stdout, the log goes to stderr.
+#include "../decoder.hpp"
+#include "../grain-engine.hpp"
+#include "../grains.hpp"
+#include "../min-max-pyramid.hpp"
+#include "../spec.hpp"
+#include "../time-map.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <log/log.hpp>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const auto SampleRate = 44100;
+// long enough for the timer resolution and the frequency scaling to settle
+static const auto MinSeconds = .5;
+
+// keeps the results alive, so the measured code is not optimized away
+static volatile double sink = 0.;
+
+struct Input
+{
+  std::string name;
+  std::vector<float> wav;
+  int sampleRate;
+};
+
+static auto report(const std::string &bench,
+                   const Input &input,
+                   int64_t param,
+                   int64_t iterations,
+                   double seconds,
+                   double items) -> void
+{
+  const auto perSecond = items / seconds;
+  printf("{\"bench\": \"%s\", \"input\": \"%s\", \"param\": %lld, \"iterations\": %lld, \"seconds\": %.6f, "
+         "\"nsPerItem\": %.3f, \"itemsPerSecond\": %.1f}\n",
+         bench.c_str(),
+         input.name.c_str(),
+         static_cast<long long>(param),
+         static_cast<long long>(iterations),
+         seconds,
+         1e9 / perSecond,
+         perSecond);
+  fflush(stdout);
+}
+
+// calls f until MinSeconds passed, after one untimed call for the caches; f returns the number of items
+// it processed
+template <typename F>
+static auto measure(const std::string &bench, const Input &input, int64_t param, F &&f) -> void
+{
+  f();
+  const auto start = std::chrono::steady_clock::now();
+  auto n = int64_t{0};
+  auto items = 0.;
+  auto seconds = 0.;
+  do
+  {
+    items += f();
+    ++n;
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  } while (seconds < MinSeconds);
+  report(bench, input, param, n, seconds, items);
+}
+
+// a sung note with vibrato, harmonics and a bit of noise, its zero crossings look like a voice's
+static auto synthetic(double seconds) -> Input
+{
+  auto ret = Input{"synthetic", std::vector<float>(static_cast<size_t>(seconds * SampleRate)), SampleRate};
+  auto rng = std::mt19937{42};
+  auto noise = std::uniform_real_distribution<float>{-.01f, .01f};
+  auto phase = 0.;
+  for (auto i = 0U; i < ret.wav.size(); ++i)
+  {
+    const auto t = 1. * i / SampleRate;
+    // a slow glide over an octave with a 5 Hz vibrato
+    const auto octaves = std::sin(2. * M_PI * .1 * t) / 2. + .03 * std::sin(2. * M_PI * 5. * t);
+    const auto f0 = 220. * std::pow(2., octaves);
+    phase += 2. * M_PI * f0 / SampleRate;
+    auto v = 0.;
+    for (auto h = 1; h <= 8; ++h)
+      v += std::sin(h * phase) / h;
+    ret.wav[i] = static_cast<float>(.3 * v) + noise(rng);
+  }
+  return ret;
+}
+
+static auto decode(const std::string &path) -> std::optional<Input>
+{
+  auto dec = Decoder{path};
+  if (!dec.isOpen())
+  {
+    LOG("cannot open", path);
+    return std::nullopt;
+  }
+  auto ret = Input{path, std::vector<float>(dec.estimatedSamples()), dec.sampleRate()};
+  // only the first channel is measured, the others are decoded into scratch buffers
+  auto others = std::vector<std::vector<float>>(static_cast<size_t>(std::max(0, dec.channels() - 1)),
+                                                std::vector<float>(ret.wav.size()));
+  auto dst = std::vector<float *>{ret.wav.data()};
+  for (auto &other : others)
+    dst.push_back(other.data());
+  dec.start(std::move(dst), ret.wav.size());
+  while (!dec.isDone())
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  ret.wav.resize(dec.available());
+  ret.wav.insert(std::end(ret.wav), std::begin(dec.overflow()), std::end(dec.overflow()));
+  return ret;
+}
+
+// markers spread evenly over the file with random warps and bends, like a heavily edited take
+static auto makeMarkers(const Input &input, int count) -> std::vector<Marker>
+{
+  auto rng = std::mt19937{static_cast<uint32_t>(count)};
+  auto dTime = std::uniform_real_distribution<double>{-.02, .02};
+  auto pitchBend = std::uniform_real_distribution<double>{-2., 2.};
+  auto ret = std::vector<Marker>{};
+  for (auto i = 0; i < count; ++i)
+  {
+    const auto sample = static_cast<int>((i + 1.) * input.wav.size() / (count + 1));
+    ret.push_back(Marker{sample, 60., dTime(rng), pitchBend(rng)});
+  }
+  return ret;
+}
+
+static auto benchSpec(Input &input) -> void
+{
+  const auto spec = Spec{input.wav, nullptr, 1};
+  auto out = std::vector<float>(static_cast<size_t>(Spec::binCount()));
+  const auto columns = static_cast<int>(input.wav.size()) / Spec::samples(std::make_pair(0, 1)).first;
+  // a screen width of consecutive columns
+  const auto batch = 1024;
+  auto column = 0;
+  measure("spec/column", input, Spec::binCount(), [&]() {
+    for (auto i = 0; i < batch; ++i, column = (column + 1) % columns)
+    {
+      spec.computeColumn(std::make_pair(0, column), out.data());
+      sink = sink + out[static_cast<size_t>(i) % out.size()];
+    }
+    return batch;
+  });
+}
+
+static auto benchGrains(const Input &input) -> GrainIndex
+{
+  auto grains = GrainIndex{};
+  measure("grains/find", input, PreferredGrainSize, [&]() {
+    grains = findGrains(input.wav, PreferredGrainSize);
+    return input.wav.size();
+  });
+  return grains;
+}
+
+static auto benchPicks(const Input &input) -> void
+{
+  auto picks = MinMaxPyramid<int16_t>{};
+  measure("picks/build", input, 0, [&]() {
+    picks.clear();
+    picks.reserve(input.wav.size());
+    picks.extend(input.wav);
+    return input.wav.size();
+  });
+
+  // one query per pixel of a 1920 pixels wide waveform, from the sample level zoom to the whole file
+  for (const auto width : {size_t{16}, size_t{1} << 10, input.wav.size() / 1920})
+  {
+    if (width == 0 || width > input.wav.size())
+      continue;
+    auto rng = std::mt19937{1};
+    auto starts = std::vector<size_t>(1920);
+    for (auto &s : starts)
+      s = std::uniform_int_distribution<size_t>{0, input.wav.size() - width}(rng);
+    measure("picks/query", input, static_cast<int64_t>(width), [&]() {
+      for (const auto s : starts)
+        sink = sink + picks.minMax(s, s + width).first;
+      return starts.size();
+    });
+  }
+}
+
+static auto benchRender(const Input &input, const GrainIndex &grains) -> void
+{
+  // items are output samples, itemsPerSecond / sampleRate is the real-time factor on one core
+  const auto tm = TimeMap{makeMarkers(input, 100), input.sampleRate, static_cast<int>(input.wav.size())};
+  for (const auto quality : {Resampler::Quality::Fast, Resampler::Quality::High})
+  {
+    const auto engine = GrainEngine{input.wav, grains, input.sampleRate, 0.f, quality};
+    auto out = std::vector<float>(MaxGrainOutput);
+    // a few seconds of output per call, rendered like the export does
+    const auto chunk = 4 * static_cast<size_t>(input.sampleRate);
+    auto cursor = 0.;
+    const auto name = quality == Resampler::Quality::Fast ? "render/grains fast" : "render/grains high";
+    measure(name, input, input.sampleRate, [&]() {
+      auto tmCursor = TimeMap::Cursor{tm};
+      auto grainCursor = GrainIndex::Cursor{grains};
+      auto total = size_t{0};
+      auto last = GrainStep{};
+      while (total < chunk)
+      {
+        const auto step = engine.isPartial(last)
+                            ? engine.resume(last, MaxGrainOutput)
+                            : engine.plan(tmCursor, grainCursor, cursor, MaxGrainOutput);
+        last = step;
+        if (engine.isEnd(step) || step.size == 0)
+        {
+          // start over from the beginning of the timeline
+          cursor = 0.;
+          break;
+        }
+        engine.render(step, {std::span{out.data(), step.size}, std::span<float>{}});
+        sink = sink + out[0];
+        total += step.size;
+        cursor += engine.duration(step);
+      }
+      return total;
+    });
+  }
+}
+
+static auto benchTimeMap(const Input &input) -> void
+{
+  const auto sampleCount = static_cast<int>(input.wav.size());
+  for (const auto markers : {10, 1000, 10000})
+  {
+    const auto tm = TimeMap{makeMarkers(input, markers), input.sampleRate, sampleCount};
+    // random queries like the UI's, the caches in the app only help with the repeated ones
+    const auto queries = 4096;
+    auto rng = std::mt19937{2};
+    auto samples = std::vector<int>(queries);
+    for (auto &s : samples)
+      s = std::uniform_int_distribution<int>{0, sampleCount - 1}(rng);
+    auto times = std::vector<double>(queries);
+    for (auto &t : times)
+      t = std::uniform_real_distribution<double>{0., tm.duration()}(rng);
+    {
+      measure("timeMap/sample2Time", input, markers, [&]() {
+        for (const auto s : samples)
+          sink = sink + tm.sample2Time(s);
+        return queries;
+      });
+    }
+    {
+      measure("timeMap/time2Sample", input, markers, [&]() {
+        for (const auto t : times)
+          sink = sink + tm.time2Sample(t);
+        return queries;
+      });
+    }
+    {
+      // playback and export walk forward through the timeline
+      auto sorted = times;
+      std::sort(std::begin(sorted), std::end(sorted));
+      measure("timeMap/cursor time2Sample", input, markers, [&]() {
+        auto cursor = TimeMap::Cursor{tm};
+        for (const auto t : sorted)
+          sink = sink + cursor.time2Sample(t);
+        return queries;
+      });
+    }
+  }
+}
+
+static auto run(Input &input) -> void
+{
+  if (input.wav.size() < size_t{1} << 16)
+  {
+    LOG(input.name, "is too short");
+    return;
+  }
+  LOG("benchmarking", input.name, input.wav.size(), "samples");
+  benchSpec(input);
+  const auto grains = benchGrains(input);
+  benchPicks(input);
+  benchRender(input, grains);
+  benchTimeMap(input);
+}
+
+auto main(int argc, char **argv) -> int
+{
+  auto input = synthetic(60.);
+  run(input);
+  for (auto i = 1; i < argc; ++i)
+    if (auto file = decode(argv[i]))
+      run(*file);
+  return 0;
+}
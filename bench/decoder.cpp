@@ -0,0 +1 @@
+#include "../decoder.cpp"
@@ -0,0 +1 @@
+#include "../profiler.cpp"
@@ -0,0 +1 @@
+#include "../spec.cpp"
@@ -0,0 +1 @@
+#include "../time-map.cpp"
@@ -0,0 +1,11 @@
+#pragma once
+
+#if defined(__x86_64__) || defined(__i386__)
+// the AVX2 kernels are compiled with a target attribute and picked at run time; the CPU is queried on the
+// first call, not in a static initializer which can run before the CPU model is initialized
+inline auto cpuHasAvx2() -> bool
+{
+  static const auto ret = __builtin_cpu_supports("avx2") != 0;
+  return ret;
+}
+#endif
@@ -0,0 +1,197 @@
+#include "decoder.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <log/log.hpp>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/opt.h>
+#include <libswresample/swresample.h>
+}
+
+Decoder::Decoder(const std::string &path, int sampleRate)
+{
+  if (avformat_open_input(&format, path.c_str(), nullptr, nullptr) != 0)
+  {
+    LOG("Could not open file", path);
+    format = nullptr;
+    return;
+  }
+  if (avformat_find_stream_info(format, nullptr) < 0)
+  {
+    LOG("Could not retrieve stream info from file", path);
+    return;
+  }
+
+  // Find the index of the first audio stream
+  for (auto i = 0U; i < format->nb_streams; i++)
+  {
+    if (format->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_AUDIO)
+    {
+      streamIndex = static_cast<int>(i);
+      break;
+    }
+  }
+  if (streamIndex == -1)
+  {
+    LOG("Could not retrieve audio stream from file", path);
+    return;
+  }
+  const auto stream = format->streams[streamIndex];
+
+  // find & open codec
+  const auto decoder = avcodec_find_decoder(stream->codecpar->codec_id);
+  auto ctx = avcodec_alloc_context3(decoder);
+  if (!ctx || avcodec_parameters_to_context(ctx, stream->codecpar) < 0 ||
+      avcodec_open2(ctx, decoder, nullptr) < 0)
+  {
+    LOG("Failed to open decoder for stream #", streamIndex, "in file", path);
+    avcodec_free_context(&ctx);
+    return;
+  }
+
+// disable warnings about API calls that are deprecated
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+
+  // prepare resampler, the channels are kept and only split into planes; the rate is converted for a
+  // track added to a project of another rate
+  outRate = sampleRate > 0 ? sampleRate : ctx->sample_rate;
+  swr = swr_alloc();
+  av_opt_set_int(swr, "in_channel_count", ctx->channels, 0);
+  av_opt_set_int(swr, "out_channel_count", ctx->channels, 0);
+  av_opt_set_int(swr, "in_channel_layout", static_cast<int64_t>(ctx->channel_layout), 0);
+  av_opt_set_int(swr, "out_channel_layout", static_cast<int64_t>(ctx->channel_layout), 0);
+  av_opt_set_int(swr, "in_sample_rate", ctx->sample_rate, 0);
+  av_opt_set_int(swr, "out_sample_rate", outRate, 0);
+  av_opt_set_sample_fmt(swr, "in_sample_fmt", ctx->sample_fmt, 0);
+  av_opt_set_sample_fmt(swr, "out_sample_fmt", AV_SAMPLE_FMT_FLTP, 0);
+
+// enable warnings about API calls that are deprecated
+#pragma GCC diagnostic pop
+
+  swr_init(swr);
+  if (!swr_is_initialized(swr))
+  {
+    LOG("Resampler has not been properly initialized");
+    avcodec_free_context(&ctx);
+    return;
+  }
+  codec = ctx;
+}
+
+Decoder::~Decoder()
+{
+  isStopping = true;
+  if (thread.joinable())
+    thread.join();
+  swr_free(&swr);
+  avcodec_free_context(&codec);
+  if (format)
+    avformat_close_input(&format);
+}
+
+auto Decoder::channels() const -> int
+{
+// disable warnings about API calls that are deprecated
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+  return codec->channels;
+#pragma GCC diagnostic pop
+}
+
+auto Decoder::estimatedSamples() const -> size_t
+{
+  const auto stream = format->streams[streamIndex];
+  auto duration = 0.;
+  if (stream->duration != AV_NOPTS_VALUE)
+    duration = 1. * stream->duration * stream->time_base.num / stream->time_base.den;
+  else if (format->duration != AV_NOPTS_VALUE)
+    duration = 1. * format->duration / AV_TIME_BASE;
+  // the container duration is not exact, one percent and a second of slack avoid the overflow path
+  return static_cast<size_t>(duration * 1.01 * sampleRate()) + static_cast<size_t>(sampleRate());
+}
+
+auto Decoder::start(std::vector<float *> aDst, size_t aCapacity) -> void
+{
+  dst = std::move(aDst);
+  capacity = aCapacity;
+  resampled.resize(dst.size());
+  planes.resize(dst.size());
+  rest.resize(dst.size());
+  thread = std::thread(&Decoder::run, this);
+}
+
+auto Decoder::append(size_t n) -> void
+{
+  const auto pos = written.load(std::memory_order_relaxed);
+  const auto fits = std::min(n, capacity - pos);
+  for (auto c = 0U; c < dst.size(); ++c)
+  {
+    const auto src = resampled[c].data();
+    memcpy(dst[c] + pos, src, fits * sizeof(float));
+    rest[c].insert(std::end(rest[c]), src + fits, src + n);
+  }
+  // all channels are written before the count is published
+  written.store(pos + fits, std::memory_order_release);
+}
+
+auto Decoder::convert(const uint8_t **data, int n) -> void
+{
+  const auto outMax = swr_get_out_samples(swr, n);
+  if (outMax <= 0)
+    return;
+  for (auto c = 0U; c < resampled.size(); ++c)
+  {
+    if (resampled[c].size() < static_cast<size_t>(outMax))
+      resampled[c].resize(static_cast<size_t>(outMax));
+    planes[c] = reinterpret_cast<uint8_t *>(resampled[c].data());
+  }
+  const auto cnt = swr_convert(swr, planes.data(), outMax, data, n);
+  if (cnt > 0)
+    append(static_cast<size_t>(cnt));
+}
+
+auto Decoder::receiveFrames(AVFrame *frame) -> bool
+{
+  for (;;)
+  {
+    const auto ret = avcodec_receive_frame(codec, frame);
+    if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
+      return true;
+    if (ret < 0)
+    {
+      LOG("Error decoding audio frame", ret);
+      return false;
+    }
+    convert(const_cast<const uint8_t **>(frame->extended_data), frame->nb_samples);
+    av_frame_unref(frame);
+  }
+}
+
+auto Decoder::run() -> void
+{
+  auto packet = av_packet_alloc();
+  auto frame = av_frame_alloc();
+  if (packet && frame)
+  {
+    while (!isStopping && av_read_frame(format, packet) >= 0)
+    {
+      // skip packet if stream index does not match
+      const auto isOk = packet->stream_index != streamIndex ||
+                        (avcodec_send_packet(codec, packet) >= 0 && receiveFrames(frame));
+      av_packet_unref(packet);
+      if (!isOk)
+        break;
+    }
+    // drain the decoder and the resampler
+    avcodec_send_packet(codec, nullptr);
+    receiveFrames(frame);
+    convert(nullptr, 0);
+  }
+  av_frame_free(&frame);
+  av_packet_free(&packet);
+  done.store(true, std::memory_order_release);
+}
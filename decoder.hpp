@@ -0,0 +1,57 @@
+#pragma once
+#include "sample-loader.hpp"
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct AVCodecContext;
+struct AVFormatContext;
+struct SwrContext;
+
+// Decodes the first audio stream of a file to float on a background thread, every channel into its own
+// buffer. The samples go straight into the caller's buffers.
+class Decoder final : public SampleLoader
+{
+public:
+  // converts to sampleRate, 0 keeps the rate of the file
+  explicit Decoder(const std::string &path, int sampleRate = 0);
+  ~Decoder() override;
+  // disable copy
+  Decoder(const Decoder &) = delete;
+  Decoder &operator=(const Decoder &) = delete;
+
+  auto isOpen() const -> bool { return codec != nullptr; }
+  auto channels() const -> int;
+  // of the decoded samples
+  auto sampleRate() const -> int { return outRate; }
+  // per channel, from the stream duration with some margin; the buffers passed to start() should be
+  // this large
+  auto estimatedSamples() const -> size_t;
+  // one buffer of capacity samples per channel, they have to stay valid until the decoder is destroyed
+  auto start(std::vector<float *> dst, size_t capacity) -> void;
+  auto available() const -> size_t override { return written.load(std::memory_order_acquire); }
+  auto isDone() const -> bool override { return done.load(std::memory_order_acquire); }
+
+private:
+  AVFormatContext *format = nullptr;
+  AVCodecContext *codec = nullptr;
+  SwrContext *swr = nullptr;
+  int streamIndex = -1;
+  int outRate = 0;
+  std::vector<float *> dst;
+  size_t capacity = 0;
+  std::atomic<size_t> written = 0;
+  std::atomic<bool> done = false;
+  std::atomic<bool> isStopping = false;
+  // one plane per channel, reused for every frame
+  std::vector<std::vector<float>> resampled;
+  std::vector<uint8_t *> planes;
+  std::thread thread;
+
+  auto append(size_t) -> void;
+  auto convert(const uint8_t **data, int n) -> void;
+  auto receiveFrames(struct AVFrame *) -> bool;
+  auto run() -> void;
+};
@@ -0,0 +1,56 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <memory>
+
+// Fixed size memoization table for int keys. Every key maps to exactly one slot, a colliding key
+// overwrites it. clear() bumps the generation instead of touching the slots, so it is O(1) and the
+// memory stays the same however many distinct keys are queried.
+template <typename V, int Bits = 16>
+class DirectMappedCache
+{
+public:
+  DirectMappedCache() : slots(std::make_unique<std::array<Slot, Size>>()) {}
+
+  template <typename F>
+  auto get(int key, F &&calc) -> V
+  {
+    // fibonacci hashing, neighbouring keys land in different slots
+    auto &slot = (*slots)[(static_cast<uint32_t>(key) * 2654435769U) >> (32 - Bits)];
+    if (slot.gen == gen && slot.key == key)
+      return slot.val;
+    if (slot.gen != gen)
+      ++filled;
+    slot.val = calc();
+    slot.key = key;
+    slot.gen = gen;
+    return slot.val;
+  }
+
+  // slots holding a value of the current generation
+  auto size() const -> int { return filled; }
+  static constexpr auto capacity() -> int { return Size; }
+
+  auto clear() -> void
+  {
+    filled = 0;
+    if (++gen != 0)
+      return;
+    // the generation wrapped around, stale slots could look valid again
+    for (auto &slot : *slots)
+      slot.gen = 0;
+    gen = 1;
+  }
+
+private:
+  static constexpr auto Size = 1 << Bits;
+  struct Slot
+  {
+    int key = 0;
+    uint32_t gen = 0;
+    V val{};
+  };
+  std::unique_ptr<std::array<Slot, Size>> slots;
+  uint32_t gen = 1;
+  int filled = 0;
+};
@@ -0,0 +1,49 @@
+#include "framebuffer.hpp"
+#include <log/log.hpp>
+
+Framebuffer::Framebuffer()
+{
+  glGenFramebuffers(1, &fbo);
+  glGenRenderbuffers(1, &color);
+}
+
+Framebuffer::~Framebuffer()
+{
+  glDeleteRenderbuffers(1, &color);
+  glDeleteFramebuffers(1, &fbo);
+}
+
+auto Framebuffer::resize(int aWidth, int aHeight) -> bool
+{
+  if (aWidth == width && aHeight == height)
+    return false;
+  width = aWidth;
+  height = aHeight;
+  glBindRenderbuffer(GL_RENDERBUFFER, color);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    LOG("framebuffer is incomplete", width, height);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  return true;
+}
+
+auto Framebuffer::bind() const -> void
+{
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+}
+
+auto Framebuffer::unbind() const -> void
+{
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+auto Framebuffer::blit() const -> void
+{
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+  glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+}
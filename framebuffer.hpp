@@ -0,0 +1,27 @@
+#pragma once
+#include "gl.hpp"
+
+// offscreen color buffer, layers which did not change are drawn once into it and copied to the screen
+class Framebuffer
+{
+public:
+  Framebuffer();
+  ~Framebuffer();
+  // disable copy
+  Framebuffer(const Framebuffer &) = delete;
+  Framebuffer &operator=(const Framebuffer &) = delete;
+
+  // reallocates when the size changes, returns true if it did and the contents are lost
+  auto resize(int width, int height) -> bool;
+  // draws go into the framebuffer until unbind()
+  auto bind() const -> void;
+  auto unbind() const -> void;
+  // copies the contents to the same pixels of the default framebuffer
+  auto blit() const -> void;
+
+private:
+  GLuint fbo = 0;
+  GLuint color = 0;
+  int width = 0;
+  int height = 0;
+};
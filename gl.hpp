@@ -0,0 +1,9 @@
+#pragma once
+
+#if defined(IMGUI_IMPL_OPENGL_ES2)
+#include <SDL_opengles2.h>
+#else
+// the spectrogram and the timeline are drawn with shaders, so we need the GL 2.0+ entry points
+#define GL_GLEXT_PROTOTYPES 1
+#include <SDL_opengl.h>
+#endif
@@ -0,0 +1,65 @@
+#include "grain-engine.hpp"
+#include <algorithm>
+#include <cmath>
+
+// number of output samples the resampling loop produces for a grain: all i with i * rate + bias < size
+static auto grainOutputSize(size_t size, float rate, float bias) -> size_t
+{
+  if (bias >= size)
+    return 0;
+  auto ret = static_cast<size_t>(std::ceil((size - bias) / rate));
+  // fix the rounding so the count matches the float arithmetic of the loop exactly
+  while (ret > 0 && static_cast<size_t>((ret - 1) * rate + bias) >= size)
+    --ret;
+  while (static_cast<size_t>(ret * rate + bias) < size)
+    ++ret;
+  return ret;
+}
+
+GrainEngine::GrainEngine(std::span<const float> aWav,
+                         const GrainIndex &aGrains,
+                         int aSampleRate,
+                         float aBias,
+                         Resampler::Quality quality)
+  : wav(aWav), grains(aGrains), sampleRate(aSampleRate), bias(aBias), resampler(quality)
+{
+}
+
+auto GrainEngine::plan(TimeMap::Cursor &tm,
+                       GrainIndex::Cursor &grainCursor,
+                       double cursor,
+                       size_t maxSize) const -> GrainStep
+{
+  const auto pitchBend = tm.time2PitchBend(cursor);
+  const auto rate = powf(2, pitchBend / 12);
+  const auto idx1 = grainCursor.find(tm.time2Sample(cursor));
+  if (idx1 == grains.size())
+    return GrainStep{idx1, rate, 0, 0, 0, wav.size()};
+
+  const auto total = grainOutputSize(static_cast<size_t>(grains[idx1].size), rate, bias);
+  // the grain which plays after the whole grain, also when only a part of it fits
+  const auto idx2 = grainCursor.find(tm.time2Sample(cursor + 1. * total / sampleRate));
+  const auto next = idx2 == grains.size() ? wav.size() : static_cast<size_t>(grains[idx2].start);
+  return GrainStep{idx1, rate, 0, std::min(maxSize, total), total, next};
+}
+
+auto GrainEngine::resume(const GrainStep &step, size_t maxSize) const -> GrainStep
+{
+  auto ret = step;
+  ret.first = step.first + step.size;
+  ret.size = std::min(maxSize, step.total - ret.first);
+  return ret;
+}
+
+auto GrainEngine::render(const GrainStep &step, std::array<std::span<float>, 2> out) const -> void
+{
+  if (isEnd(step))
+    return;
+  const auto grain = Resampler::Grain{wav,
+                                      static_cast<size_t>(grains[step.grain].start),
+                                      static_cast<size_t>(grains[step.grain].size),
+                                      step.next};
+  const auto first = std::min(step.size, out[0].size());
+  resampler.resample(grain, step.rate, bias, step.first, out[0].first(first));
+  resampler.resample(grain, step.rate, bias, step.first + first, out[1].first(step.size - first));
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include "grains.hpp"
+#include "resampler.hpp"
+#include "time-map.hpp"
+#include <array>
+#include <span>
+
+// room for the audio buffer plus the longest grain after a large downward pitch bend
+static const auto MaxGrainOutput = size_t{1} << 18;
+
+// one grain resampled to the output at a given time
+struct GrainStep
+{
+  // grains.size() past the end of the timeline
+  size_t grain;
+  float rate;
+  // output samples of the grain before this step, a grain longer than the room for it is rendered in
+  // several steps
+  size_t first;
+  // number of output samples of this step
+  size_t size;
+  // number of output samples of the whole grain
+  size_t total;
+  // start of the grain which plays next, wav.size() if there is none; the resampler reads past the end
+  // of the grain from it
+  size_t next;
+};
+
+// Turns the timeline into grains. It keeps no state between grains: the position of a grain only
+// follows from the sizes of the ones before it, so planning is a cheap serial pass and the planned grains
+// can be rendered in any order on any thread.
+class GrainEngine
+{
+public:
+  GrainEngine(std::span<const float> wav,
+              const GrainIndex &,
+              int sampleRate,
+              float bias,
+              Resampler::Quality = Resampler::Quality::Fast);
+  // the grain playing at the output time cursor, at most maxSize output samples of it
+  auto plan(TimeMap::Cursor &, GrainIndex::Cursor &, double cursor, size_t maxSize) const -> GrainStep;
+  // the next at most maxSize output samples of a partial step's grain, they play right after the step
+  auto resume(const GrainStep &, size_t maxSize) const -> GrainStep;
+  auto isEnd(const GrainStep &step) const -> bool { return step.grain >= grains.size(); }
+  // the grain has output left after the step, the next step has to resume() it
+  auto isPartial(const GrainStep &step) const -> bool
+  {
+    return !isEnd(step) && step.first + step.size < step.total;
+  }
+  // writes the step.size output samples, out is one or two contiguous regions like a ring buffer
+  auto render(const GrainStep &, std::array<std::span<float>, 2> out) const -> void;
+  auto duration(const GrainStep &step) const -> double { return 1. * step.size / sampleRate; }
+
+private:
+  std::span<const float> wav;
+  const GrainIndex &grains;
+  int sampleRate;
+  float bias;
+  Resampler resampler;
+};
@@ -0,0 +1,338 @@
+#include "grains.hpp"
+#include "cpu-features.hpp"
+#include "parallel-for.hpp"
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <optional>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define GRAINS_AVX2 1
+#endif
+
+namespace
+{
+  // a negative-to-positive crossing between idx and idx + 1 needs LookAround negative samples up to idx
+  // and LookAround non-negative samples after it, the fallback search accepts a shorter run
+  const auto LookAround = 7;
+  const auto FallbackLookAround = 3;
+
+  auto negativeMaskScalar(const float *wav, size_t n, uint64_t *mask) -> void
+  {
+    for (auto w = size_t{0}; w * 64 < n; ++w)
+    {
+      auto bits = uint64_t{0};
+      const auto end = std::min<size_t>(64, n - w * 64);
+      for (auto i = size_t{0}; i < end; ++i)
+        bits |= static_cast<uint64_t>(wav[w * 64 + i] < 0) << i;
+      mask[w] = bits;
+    }
+  }
+
+#if defined(GRAINS_AVX2)
+  __attribute__((target("avx2"))) auto negativeMaskAvx2(const float *wav, size_t n, uint64_t *mask) -> void
+  {
+    const auto zero = _mm256_setzero_ps();
+    auto w = size_t{0};
+    for (; (w + 1) * 64 <= n; ++w)
+    {
+      auto bits = uint64_t{0};
+      for (auto i = 0; i < 8; ++i)
+      {
+        const auto v = _mm256_loadu_ps(wav + w * 64 + i * 8);
+        const auto m = _mm256_movemask_ps(_mm256_cmp_ps(v, zero, _CMP_LT_OQ));
+        bits |= static_cast<uint64_t>(static_cast<uint32_t>(m)) << (i * 8);
+      }
+      mask[w] = bits;
+    }
+    negativeMaskScalar(wav + w * 64, n - w * 64, mask + w);
+  }
+#endif
+
+  // bit i of the result is set when the samples i - lookAround + 1 .. i are negative and i + 1 .. i +
+  // lookAround are not, computed 64 samples at a time
+  auto zeroCrossings(const std::vector<uint64_t> &neg, int lookAround, size_t w) -> uint64_t
+  {
+    const auto prev = w > 0 ? neg[w - 1] : 0;
+    const auto next = w + 1 < neg.size() ? neg[w + 1] : 0;
+    auto ret = neg[w];
+    for (auto k = 1; k < lookAround; ++k)
+      ret &= (neg[w] << k) | (prev >> (64 - k));
+    for (auto k = 1; k <= lookAround; ++k)
+      ret &= ~((neg[w] >> k) | (next << (64 - k)));
+    return ret;
+  }
+
+  class Finder
+  {
+  public:
+    // only the samples from about `from` on are looked at
+    Finder(std::span<const float> wav, int from, int preferredSize)
+      : wav(wav), preferredSize(preferredSize), firstWord(from >= 64 ? static_cast<size_t>(from / 64 - 1) : 0)
+    {
+      const auto words = (wav.size() + 63) / 64 - std::min(firstWord, (wav.size() + 63) / 64);
+      auto neg = std::vector<uint64_t>(words);
+      crossings.resize(words);
+      fallbackCrossings.resize(words);
+      const auto samples = wav.subspan(std::min(wav.size(), firstWord * 64));
+      parallelFor(words, 1024, [&](size_t begin, size_t end) {
+        const auto n = std::min(end * 64, samples.size()) - begin * 64;
+#if defined(GRAINS_AVX2)
+        if (cpuHasAvx2())
+          return negativeMaskAvx2(samples.data() + begin * 64, n, neg.data() + begin);
+#endif
+        negativeMaskScalar(samples.data() + begin * 64, n, neg.data() + begin);
+      });
+      parallelFor(words, 1024, [&](size_t begin, size_t end) {
+        for (auto w = begin; w < end; ++w)
+        {
+          crossings[w] = zeroCrossings(neg, LookAround, w);
+          fallbackCrossings[w] = zeroCrossings(neg, FallbackLookAround, w);
+        }
+      });
+    }
+
+    // the last sample a grain can start at
+    auto last() const -> int { return static_cast<int>(wav.size()) - preferredSize - 1; }
+
+    // the serial algorithm: the crossing closest to start + preferredSize, at equal distance the later
+    // one, and if there is none within half a grain the first weaker crossing after one and a half grains
+    auto next(int start) const -> std::optional<Grain>
+    {
+      const auto center = start + preferredSize;
+      const auto maxAfter = (preferredSize - 1 - (preferredSize - 1) % 2) / 2;
+      const auto maxBefore = (preferredSize - 1 - preferredSize % 2) / 2;
+      const auto after = nextSet(crossings, LookAround, center, center + maxAfter + 1);
+      const auto before = nextSetBackward(crossings, LookAround, center - maxBefore, center);
+      if (after >= 0 && (before < 0 || after - center <= center - before))
+        return Grain{start, after - start, after - start - preferredSize};
+      if (before >= 0)
+        return Grain{start, before - start, before - start - preferredSize};
+
+      const auto idx = nextSet(fallbackCrossings,
+                               FallbackLookAround,
+                               start + preferredSize + preferredSize / 2,
+                               static_cast<int>(wav.size()) - 1);
+      if (idx < 0)
+        return std::nullopt;
+      return Grain{start, idx - start, idx - start - preferredSize};
+    }
+
+    // walks from start while the grain starts are before stop, returns where the walk ended or -1 if no
+    // grain could be found
+    auto walk(int start, int stop, std::vector<Grain> &out) const -> int
+    {
+      while (start < last() && start < stop)
+      {
+        const auto grain = next(start);
+        if (!grain)
+          return -1;
+        out.push_back(*grain);
+        start = grain->start + grain->size;
+      }
+      return start;
+    }
+
+    auto firstCrossing(int from) const -> int
+    {
+      return nextSet(crossings, LookAround, from, static_cast<int>(wav.size()));
+    }
+
+  private:
+    std::span<const float> wav;
+    int preferredSize;
+    // the masks start at this word of the samples, the first word has no left neighbour and is not used
+    size_t firstWord;
+    std::vector<uint64_t> crossings;
+    std::vector<uint64_t> fallbackCrossings;
+
+    // valid crossing positions: the look around window has to fit into the samples
+    auto clip(int lookAround, int &from, int &to) const -> void
+    {
+      from = std::max({from, lookAround, firstWord > 0 ? static_cast<int>(firstWord + 1) * 64 : 0});
+      to = std::min(to, static_cast<int>(wav.size()) - lookAround - 1);
+    }
+
+    // first set bit in [from, to) or -1
+    auto nextSet(const std::vector<uint64_t> &bits, int lookAround, int from, int to) const -> int
+    {
+      clip(lookAround, from, to);
+      if (from >= to)
+        return -1;
+      auto w = static_cast<size_t>(from / 64);
+      auto word = bits[w - firstWord] & (~uint64_t{0} << (from % 64));
+      for (;;)
+      {
+        if (word != 0)
+        {
+          const auto ret = static_cast<int>(w * 64) + std::countr_zero(word);
+          return ret < to ? ret : -1;
+        }
+        if (++w * 64 >= static_cast<size_t>(to))
+          return -1;
+        word = bits[w - firstWord];
+      }
+    }
+
+    // last set bit in [from, to) or -1
+    auto nextSetBackward(const std::vector<uint64_t> &bits, int lookAround, int from, int to) const -> int
+    {
+      clip(lookAround, from, to);
+      if (from >= to)
+        return -1;
+      const auto lastBit = to - 1;
+      auto w = static_cast<size_t>(lastBit / 64);
+      auto word = bits[w - firstWord] & (~uint64_t{0} >> (63 - lastBit % 64));
+      for (;;)
+      {
+        if (word != 0)
+        {
+          const auto ret = static_cast<int>(w * 64) + 63 - std::countl_zero(word);
+          return ret >= from ? ret : -1;
+        }
+        if (w == 0 || static_cast<int>(w * 64) <= from)
+          return -1;
+        word = bits[--w - firstWord];
+      }
+    }
+  };
+
+  struct Chunk
+  {
+    int end;
+    std::vector<Grain> grains;
+    int next;
+  };
+} // namespace
+
+auto GrainIndex::push_back(const Grain &grain) -> void
+{
+  starts.push_back(grain.start);
+  sizes.push_back(grain.size);
+  deviations.push_back(grain.deviation);
+}
+
+auto GrainIndex::reserve(size_t n) -> void
+{
+  starts.reserve(n);
+  sizes.reserve(n);
+  deviations.reserve(n);
+}
+
+auto GrainIndex::clear() -> void
+{
+  starts.clear();
+  sizes.clear();
+  deviations.clear();
+}
+
+auto GrainIndex::find(int sample) const -> size_t
+{
+  return static_cast<size_t>(std::lower_bound(std::begin(starts), std::end(starts), sample) -
+                             std::begin(starts));
+}
+
+auto GrainIndex::isValid(int sampleCount) const -> bool
+{
+  if (sizes.size() != starts.size() || deviations.size() != starts.size())
+    return false;
+  // every grain ends where the next one starts
+  auto end = 0;
+  for (auto i = 0U; i < starts.size(); ++i)
+  {
+    if (starts[i] != end || sizes[i] <= 0)
+      return false;
+    end += sizes[i];
+  }
+  return end <= sampleCount;
+}
+
+GrainIndex::Cursor::Cursor(const GrainIndex &index) : index(index) {}
+
+auto GrainIndex::Cursor::find(int sample) -> size_t
+{
+  // pos is the answer when starts[pos - 1] < sample <= starts[pos]
+  const auto &starts = index.starts;
+  const auto isAt = [&](size_t i) {
+    return (i == 0 || starts[i - 1] < sample) && (i == starts.size() || sample <= starts[i]);
+  };
+  if (pos <= starts.size() && isAt(pos))
+    return pos;
+  if (pos < starts.size() && isAt(pos + 1))
+    return ++pos;
+  pos = index.find(sample);
+  return pos;
+}
+
+auto findGrains(std::span<const float> wav, int preferredSize) -> GrainIndex
+{
+  auto ret = GrainIndex{};
+  extendGrains(ret, wav, preferredSize, true);
+  return ret;
+}
+
+auto extendGrains(GrainIndex &grains, std::span<const float> wav, int preferredSize, bool isComplete) -> void
+{
+  const auto from = grains.empty() ? 0 : grains[grains.size() - 1].start + grains[grains.size() - 1].size;
+  const auto finder = Finder{wav, from, preferredSize};
+  if (finder.last() <= from)
+    return;
+
+  // every chunk is walked independently from its first zero crossing. The greedy walk from the previous
+  // chunk almost always lands on one of the grain starts found there within a few grains, from that grain
+  // on both walks are identical.
+  const auto ChunkSize = 1 << 20;
+  auto chunks = std::vector<Chunk>((finder.last() - from + ChunkSize - 1) / ChunkSize);
+  parallelFor(chunks.size(), 1, [&](size_t first, size_t last) {
+    for (auto c = first; c < last; ++c)
+    {
+      const auto begin = from + static_cast<int>(c) * ChunkSize;
+      auto &chunk = chunks[c];
+      chunk.end = std::min(begin + ChunkSize, finder.last());
+      const auto sync = c == 0 ? from : finder.firstCrossing(begin);
+      chunk.grains.reserve(ChunkSize / preferredSize + 1);
+      chunk.next = sync < 0 ? -1 : finder.walk(sync, chunk.end, chunk.grains);
+    }
+  });
+
+  auto found = std::vector<Grain>{};
+  found.reserve((wav.size() - from) / preferredSize + 1);
+  auto start = from;
+  for (const auto &chunk : chunks)
+  {
+    while (start >= 0 && start < finder.last() && start < chunk.end)
+    {
+      const auto it = std::lower_bound(std::begin(chunk.grains),
+                                       std::end(chunk.grains),
+                                       start,
+                                       [](const auto &grain, int val) { return grain.start < val; });
+      if (it != std::end(chunk.grains) && it->start == start)
+      {
+        found.insert(std::end(found), it, std::end(chunk.grains));
+        start = chunk.next;
+        break;
+      }
+      // not in sync yet, continue the serial walk by one grain
+      const auto grain = finder.next(start);
+      if (!grain)
+      {
+        start = -1;
+        break;
+      }
+      found.push_back(*grain);
+      start = grain->start + grain->size;
+    }
+  }
+
+  // with more samples to come only the grains whose search window is complete are final
+  const auto n = static_cast<int>(wav.size());
+  const auto margin = 2 * LookAround + 2;
+  for (const auto &grain : found)
+  {
+    if (!isComplete &&
+        (grain.start + 2 * preferredSize + margin >= n || grain.start + grain.size + margin >= n))
+      break;
+    grains.push_back(grain);
+  }
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <ser/macro.hpp>
+#include <span>
+#include <vector>
+
+struct Grain
+{
+  int start;
+  int size;
+  // size minus the preferred grain size
+  int deviation;
+};
+
+// grains sorted by start, kept as separate arrays so the search only touches the starts
+class GrainIndex
+{
+public:
+  auto size() const -> size_t { return starts.size(); }
+  auto empty() const -> bool { return starts.empty(); }
+  auto operator[](size_t i) const -> Grain { return Grain{starts[i], sizes[i], deviations[i]}; }
+  auto push_back(const Grain &) -> void;
+  auto reserve(size_t) -> void;
+  auto clear() -> void;
+  // index of the first grain starting at or after the sample, size() if there is none
+  auto find(int sample) const -> size_t;
+  // the grains cover [0, end) of a file with sampleCount samples
+  auto isValid(int sampleCount) const -> bool;
+
+  // remembers the last grain, playback and export mostly ask for the same or the next one
+  class Cursor
+  {
+  public:
+    Cursor(const GrainIndex &);
+    auto find(int sample) -> size_t;
+
+  private:
+    const GrainIndex &index;
+    size_t pos = 0;
+  };
+
+private:
+  std::vector<int> starts;
+  std::vector<int> sizes;
+  std::vector<int> deviations;
+
+public:
+#define SER_PROP_LIST  \
+  SER_PROP(starts);    \
+  SER_PROP(sizes);     \
+  SER_PROP(deviations);
+
+  SER_DEF_PROPS()
+#undef SER_PROP_LIST
+};
+
+// the grain size the search aims for, in samples
+static const auto PreferredGrainSize = 1500;
+
+// Splits the samples into grains of about preferredSize samples which end at a zero crossing. The result
+// is the same as a serial scan from the first sample, the work is split across all cores.
+auto findGrains(std::span<const float> wav, int preferredSize) -> GrainIndex;
+// continues the grains after the last one, wav is the part of the file decoded so far; unless isComplete
+// the grains near its end which could change with more samples are left out
+auto extendGrains(GrainIndex &, std::span<const float> wav, int preferredSize, bool isComplete) -> void;
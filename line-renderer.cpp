@@ -0,0 +1,96 @@
+#include "line-renderer.hpp"
+#include <cstddef>
+
+static const auto vertexSource = R"(
+uniform vec2 origin;
+uniform vec2 scale;
+uniform vec2 size;
+in vec2 position;
+in vec2 offset;
+in vec4 color;
+out vec4 vertexColor;
+void main()
+{
+  vec2 px = (position - origin) * scale + offset;
+  gl_Position = vec4(px / size * 2.0 - 1.0, 0.0, 1.0);
+  vertexColor = color;
+}
+)";
+
+static const auto fragmentSource = R"(
+in vec4 vertexColor;
+out vec4 fragColor;
+void main()
+{
+  fragColor = vertexColor;
+}
+)";
+
+LineRenderer::Mesh::Mesh()
+{
+  glGenVertexArrays(1, &vao);
+  glGenBuffers(1, &vbo);
+}
+
+LineRenderer::Mesh::~Mesh()
+{
+  glDeleteBuffers(1, &vbo);
+  glDeleteVertexArrays(1, &vao);
+}
+
+LineRenderer::LineRenderer() : shader(vertexSource, fragmentSource) {}
+
+auto LineRenderer::upload(Mesh &mesh, std::span<const Vertex> vertices, std::array<double, 2> origin) const
+  -> void
+{
+  glBindVertexArray(mesh.vao);
+  glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo);
+  // a new store each time, the driver does not wait for the draws of the previous frame
+  glBufferData(GL_ARRAY_BUFFER,
+               static_cast<GLsizeiptr>(vertices.size_bytes()),
+               vertices.data(),
+               GL_DYNAMIC_DRAW);
+  if (!mesh.hasLayout)
+  {
+    const auto attrib = [this](const char *name, GLint n, size_t offset) {
+      const auto location = glGetAttribLocation(shader, name);
+      if (location < 0)
+        return;
+      glEnableVertexAttribArray(static_cast<GLuint>(location));
+      glVertexAttribPointer(static_cast<GLuint>(location),
+                            n,
+                            GL_FLOAT,
+                            GL_FALSE,
+                            sizeof(Vertex),
+                            reinterpret_cast<const void *>(offset));
+    };
+    attrib("position", 2, offsetof(Vertex, position));
+    attrib("offset", 2, offsetof(Vertex, offset));
+    attrib("color", 4, offsetof(Vertex, color));
+    mesh.hasLayout = true;
+  }
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  mesh.count = static_cast<GLsizei>(vertices.size());
+  mesh.meshOrigin = origin;
+}
+
+auto LineRenderer::draw(const Mesh &mesh,
+                        GLenum mode,
+                        std::array<double, 2> origin,
+                        std::array<float, 2> scale,
+                        std::array<float, 2> size) const -> void
+{
+  if (mesh.count == 0)
+    return;
+  glUseProgram(shader);
+  glUniform2f(shader.uniform("origin"),
+              static_cast<float>(origin[0] - mesh.meshOrigin[0]),
+              static_cast<float>(origin[1] - mesh.meshOrigin[1]));
+  glUniform2f(shader.uniform("scale"), scale[0], scale[1]);
+  glUniform2f(shader.uniform("size"), size[0], size[1]);
+  glBindVertexArray(mesh.vao);
+  glDrawArrays(mode, 0, mesh.count);
+  glBindVertexArray(0);
+  glUseProgram(0);
+}
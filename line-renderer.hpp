@@ -0,0 +1,57 @@
+#pragma once
+#include "gl.hpp"
+#include "shader.hpp"
+#include <array>
+#include <span>
+
+// Colored lines from persistent vertex buffers, drawn with one shader so it works on the core profile.
+//
+// A vertex is at (position - origin) * scale + offset pixels of the current viewport, so meshes stored in
+// time and note units only have to be uploaded again when they change, not when the view scrolls.
+// Positions are floats relative to the origin of their mesh; the difference between the mesh and the view
+// origin is taken in double, so a mesh uploaded near the view stays precise at any zoom and file length.
+class LineRenderer
+{
+public:
+  struct Vertex
+  {
+    std::array<float, 2> position;
+    // in pixels, keeps the marker crosses the same size at every zoom
+    std::array<float, 2> offset;
+    std::array<float, 4> color;
+  };
+
+  // a vertex buffer with its layout
+  class Mesh
+  {
+  public:
+    Mesh();
+    ~Mesh();
+    // disable copy
+    Mesh(const Mesh &) = delete;
+    Mesh &operator=(const Mesh &) = delete;
+
+    auto origin() const -> std::array<double, 2> { return meshOrigin; }
+
+  private:
+    friend class LineRenderer;
+    GLuint vao = 0;
+    GLuint vbo = 0;
+    GLsizei count = 0;
+    bool hasLayout = false;
+    std::array<double, 2> meshOrigin = {};
+  };
+
+  LineRenderer();
+  // the positions of the vertices are relative to origin
+  auto upload(Mesh &, std::span<const Vertex>, std::array<double, 2> origin = {}) const -> void;
+  // mode is GL_LINES or GL_LINE_STRIP, size is the viewport in pixels
+  auto draw(const Mesh &,
+            GLenum mode,
+            std::array<double, 2> origin,
+            std::array<float, 2> scale,
+            std::array<float, 2> size) const -> void;
+
+private:
+  Shader shader;
+};
@@ -4,6 +4,7 @@
 // Read online: https://github.com/ocornut/imgui/tree/master/docs
 
 #include "app.hpp"
+#include "batch-render.hpp"
 #include "file-open.hpp"
 #include "imgui-impl-opengl3.h"
 #include "imgui-impl-sdl.h"
@@ -16,6 +17,10 @@
 // Main code
 int main(int argc, const char *argv[])
 {
+  // --render and --render-dir need no window
+  if (const auto ret = batchMain(argc, argv))
+    return *ret;
+
   // Setup SDL
   // (Some versions of SDL before <2.0.10 appears to have performance/stalling issues on a minority of Windows systems,
   // depending on whether SDL_INIT_GAMECONTROLLER is enabled or disabled.. updating to latest version of SDL is recommended!)
@@ -109,6 +114,8 @@ int main(int argc, const char *argv[])
   if (argc > 1)
     app.openFile(argv[1]);
 
+  // frames ImGui still gets after the last event, hover and popups settle over a couple of frames
+  auto framesToDraw = 3;
   while (!done)
   {
     // Poll and handle events (inputs, window resize, etc.)
@@ -117,9 +124,15 @@ int main(int argc, const char *argv[])
     // data.
     // - When io.WantCaptureKeyboard is true, do not dispatch keyboard input data to your main application, or clear/overwrite your copy of the
     // keyboard data. Generally you may always pass all inputs to dear imgui, and hide them from your application based on those two flags.
+    // - Nothing is drawn while nothing changes: the loop sleeps until an event arrives, the spectrum workers
+    // push one when they finish a column. The timeout only bounds how long a missed wake up can last.
+    if (app.needsRedraw())
+      framesToDraw = 3;
     SDL_Event event;
-    while (SDL_PollEvent(&event))
+    for (auto hasEvent = framesToDraw > 0 ? SDL_PollEvent(&event) : SDL_WaitEventTimeout(&event, 500); hasEvent;
+         hasEvent = SDL_PollEvent(&event))
     {
+      framesToDraw = 3;
       switch (event.type)
       {
       case SDL_KEYDOWN:
@@ -180,6 +193,10 @@ int main(int argc, const char *argv[])
       }
     }
 
+    if (framesToDraw == 0)
+      continue;
+    --framesToDraw;
+
     // Start the Dear ImGui frame
     ImGui_ImplOpenGL3_NewFrame();
     ImGui_ImplSDL2_NewFrame();
@@ -0,0 +1,172 @@
+#include "min-max-pyramid.hpp"
+#include "cpu-features.hpp"
+#include "parallel-for.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PYRAMID_AVX2 1
+#endif
+
+namespace
+{
+  template <typename T>
+  auto roundDown(float v) -> T
+  {
+    if constexpr (std::is_same_v<T, int16_t>)
+      return static_cast<int16_t>(std::clamp(std::floor(v * 32767.f), -32768.f, 32767.f));
+    else
+      return v;
+  }
+
+  template <typename T>
+  auto roundUp(float v) -> T
+  {
+    if constexpr (std::is_same_v<T, int16_t>)
+      return static_cast<int16_t>(std::clamp(std::ceil(v * 32767.f), -32768.f, 32767.f));
+    else
+      return v;
+  }
+
+  template <typename T>
+  auto toFloat(T v) -> float
+  {
+    if constexpr (std::is_same_v<T, int16_t>)
+      return v / 32767.f;
+    else
+      return v;
+  }
+
+  // the first stored level, blocks of 2^FirstLevel samples
+  template <typename T>
+  auto firstLevelScalar(const float *wav, size_t n, typename MinMaxPyramid<T>::MinMax *dst) -> void
+  {
+    const auto size = size_t{1} << MinMaxPyramid<T>::FirstLevel;
+    for (auto b = size_t{0}; b < n; ++b)
+    {
+      const auto [min, max] = std::minmax_element(wav + b * size, wav + (b + 1) * size);
+      dst[b] = {roundDown<T>(*min), roundUp<T>(*max)};
+    }
+  }
+
+#if defined(PYRAMID_AVX2)
+  template <typename T>
+  __attribute__((target("avx2"))) auto firstLevelAvx2(const float *wav,
+                                                      size_t n,
+                                                      typename MinMaxPyramid<T>::MinMax *dst) -> void
+  {
+    static_assert(MinMaxPyramid<T>::FirstLevel == 3, "one block is one vector");
+    for (auto b = size_t{0}; b < n; ++b)
+    {
+      const auto v = _mm256_loadu_ps(wav + b * 8);
+      auto lo = _mm_min_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+      auto hi = _mm_max_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+      lo = _mm_min_ps(lo, _mm_movehl_ps(lo, lo));
+      hi = _mm_max_ps(hi, _mm_movehl_ps(hi, hi));
+      lo = _mm_min_ss(lo, _mm_shuffle_ps(lo, lo, 1));
+      hi = _mm_max_ss(hi, _mm_shuffle_ps(hi, hi, 1));
+      dst[b] = {roundDown<T>(_mm_cvtss_f32(lo)), roundUp<T>(_mm_cvtss_f32(hi))};
+    }
+  }
+#endif
+} // namespace
+
+template <typename T>
+auto MinMaxPyramid<T>::clear() -> void
+{
+  wav = {};
+  capacity = 0;
+  offsets.clear();
+  blocks.clear();
+}
+
+template <typename T>
+auto MinMaxPyramid<T>::reserve(size_t aCapacity) -> void
+{
+  wav = {};
+  capacity = aCapacity;
+  offsets.clear();
+  auto total = size_t{0};
+  for (auto l = FirstLevel; (capacity >> l) > 0; ++l)
+  {
+    offsets.push_back(total);
+    total += capacity >> l;
+  }
+  blocks.resize(total);
+}
+
+template <typename T>
+auto MinMaxPyramid<T>::extend(std::span<const float> samples) -> void
+{
+  if (samples.size() > capacity)
+    reserve(samples.size());
+  const auto prev = std::min(wav.size(), samples.size());
+  wav = samples;
+
+  const auto n = wav.size();
+  for (auto l = size_t{0}; l < offsets.size(); ++l)
+  {
+    const auto level = static_cast<int>(l) + FirstLevel;
+    const auto first = prev >> level;
+    const auto last = n >> level;
+    if (first >= last)
+      break;
+    auto dst = blocks.data() + offsets[l];
+    if (l == 0)
+    {
+      parallelFor(last - first, 1 << 16, [&](size_t begin, size_t end) {
+        const auto src = wav.data() + ((first + begin) << FirstLevel);
+#if defined(PYRAMID_AVX2)
+        if (cpuHasAvx2())
+          return firstLevelAvx2<T>(src, end - begin, dst + first + begin);
+#endif
+        firstLevelScalar<T>(src, end - begin, dst + first + begin);
+      });
+      continue;
+    }
+    const auto src = blocks.data() + offsets[l - 1];
+    parallelFor(last - first, 1 << 16, [&](size_t begin, size_t end) {
+      for (auto i = first + begin; i < first + end; ++i)
+        dst[i] = {std::min(src[2 * i].min, src[2 * i + 1].min), std::max(src[2 * i].max, src[2 * i + 1].max)};
+    });
+  }
+}
+
+template <typename T>
+auto MinMaxPyramid<T>::minMax(size_t start, size_t end) const -> std::pair<float, float>
+{
+  end = std::min(end, wav.size());
+  auto min = std::numeric_limits<float>::infinity();
+  auto max = -std::numeric_limits<float>::infinity();
+  const auto take = [&](int level, size_t i) {
+    if (level < FirstLevel)
+    {
+      for (auto s = i << level; s < (i + 1) << level; ++s)
+      {
+        min = std::min(min, wav[s]);
+        max = std::max(max, wav[s]);
+      }
+      return;
+    }
+    const auto &b = blocks[offsets[static_cast<size_t>(level - FirstLevel)] + i];
+    min = std::min(min, toFloat(b.min));
+    max = std::max(max, toFloat(b.max));
+  };
+  // the blocks of a level which are not covered by the next coarser level, at most one on each side
+  for (auto level = 0; start < end; ++level, start >>= 1, end >>= 1)
+  {
+    if (start & 1)
+      take(level, start++);
+    if (end & 1)
+      take(level, --end);
+  }
+  if (min > max)
+    return {0.f, 0.f};
+  return {min, max};
+}
+
+template class MinMaxPyramid<float>;
+template class MinMaxPyramid<int16_t>;
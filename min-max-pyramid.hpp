@@ -0,0 +1,40 @@
+#pragma once
+#include <cstdint>
+#include <span>
+#include <utility>
+#include <vector>
+
+// Min and max of the samples for power-of-two blocks, all levels in one flat buffer.
+//
+// Level l holds the blocks [i * 2^l, (i + 1) * 2^l) which are complete. The lowest levels are not stored,
+// the queries read the samples for them instead. T is float, or int16_t for a quarter of the memory with
+// the min rounded down and the max rounded up.
+template <typename T>
+class MinMaxPyramid
+{
+public:
+  struct MinMax
+  {
+    T min;
+    T max;
+  };
+
+  auto clear() -> void;
+  // lays the levels out for up to capacity samples, extend() reallocates if there are more
+  auto reserve(size_t capacity) -> void;
+  // wav starts with the samples of the previous call, only the blocks completed since are computed,
+  // wav has to stay valid until the next call
+  auto extend(std::span<const float> wav) -> void;
+  // min and max of the samples [start, end), in O(log(end - start))
+  auto minMax(size_t start, size_t end) const -> std::pair<float, float>;
+
+  // the samples the stored levels start from
+  static const auto FirstLevel = 3;
+
+private:
+  std::span<const float> wav;
+  size_t capacity = 0;
+  // offsets[l - FirstLevel] is the first block of level l in blocks
+  std::vector<size_t> offsets;
+  std::vector<MinMax> blocks;
+};
@@ -0,0 +1,10 @@
+#pragma once
+#include "thread-pool.hpp"
+
+// calls f(begin, end) for about equal ranges of [0, n) on the process thread pool, ranges are at least
+// minChunk long
+template <typename F>
+auto parallelFor(size_t n, size_t minChunk, F &&f) -> void
+{
+  threadPool().parallelFor(n, minChunk, std::ref(f));
+}
@@ -0,0 +1,81 @@
+#include "piano.hpp"
+
+static const auto vertexSource = R"(
+out float v;
+void main()
+{
+  // full viewport quad as a triangle strip, no vertex buffer needed
+  vec2 uv = vec2(float(gl_VertexID & 1), float((gl_VertexID >> 1) & 1));
+  v = uv.y;
+  gl_Position = vec4(uv * 2.0 - 1.0, 0.0, 1.0);
+}
+)";
+
+static const auto fragmentSource = R"(
+uniform sampler1D keys;
+in float v;
+out vec4 fragColor;
+void main()
+{
+  fragColor = vec4(texture(keys, v).rgb, 0.096);
+}
+)";
+
+Piano::Piano() : shader(vertexSource, fragmentSource)
+{
+  glBindTexture(GL_TEXTURE_1D, texture);
+  glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  // the core profile does not draw without a vertex array object
+  glGenVertexArrays(1, &vao);
+}
+
+Piano::~Piano()
+{
+  glDeleteVertexArrays(1, &vao);
+}
+
+auto Piano::draw(double startNote, float rangeNote, int height) -> void
+{
+  if (height <= 0)
+    return;
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_1D, texture);
+  if (startNote != textureStartNote || rangeNote != textureRangeNote || height != textureHeight)
+  {
+    textureStartNote = startNote;
+    textureRangeNote = rangeNote;
+    textureHeight = height;
+    rows.resize(static_cast<size_t>(height));
+    auto lastNote = 0;
+    for (auto i = 0U; i < rows.size(); ++i)
+    {
+      const auto tmp = i * rangeNote + rows.size() / 2;
+      const auto note = static_cast<int>(tmp / rows.size() + startNote);
+      auto isBlack = std::array{
+        false, true, false, false, true, false, true, false, false, true, false, true}[note % 12];
+      unsigned char c = (note == lastNote) ? (isBlack ? 128 : 255) : 0;
+      rows[i] = std::array{c, c, c};
+      lastNote = note;
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage1D(GL_TEXTURE_1D,                     // target
+                 0,                                 // level
+                 GL_RGB8,                           // internalFormat
+                 static_cast<GLsizei>(rows.size()), // width
+                 0,                                 // border
+                 GL_RGB,                            // format
+                 GL_UNSIGNED_BYTE,                  // type
+                 rows.data()                        // data
+    );
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  }
+
+  glUseProgram(shader);
+  glUniform1i(shader.uniform("keys"), 0);
+  glBindVertexArray(vao);
+  glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+  glBindVertexArray(0);
+  glUseProgram(0);
+}
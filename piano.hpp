@@ -0,0 +1,30 @@
+#pragma once
+#include "gl.hpp"
+#include "shader.hpp"
+#include "texture.hpp"
+#include <array>
+#include <vector>
+
+// the piano keys behind the spectrogram, one texel per pixel row uploaded only when the rows change
+class Piano
+{
+public:
+  Piano();
+  ~Piano();
+  // disable copy
+  Piano(const Piano &) = delete;
+  Piano &operator=(const Piano &) = delete;
+
+  // fills the current viewport of height pixels
+  auto draw(double startNote, float rangeNote, int height) -> void;
+
+private:
+  Texture texture;
+  GLuint vao = 0;
+  Shader shader;
+  // what the texture was made for
+  double textureStartNote = 0.;
+  float textureRangeNote = 0.f;
+  int textureHeight = 0;
+  std::vector<std::array<unsigned char, 3>> rows;
+};
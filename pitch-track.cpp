@@ -0,0 +1,173 @@
+#include "pitch-track.hpp"
+#include "parallel-for.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <log/log.hpp>
+
+namespace
+{
+  // the range of a singing voice
+  const auto MinFreq = 60.;
+  const auto MaxFreq = 1200.;
+  // samples summed per lag
+  const auto Window = 1024;
+  // first dip of the normalized difference below this is the period
+  const auto Threshold = .15f;
+  // grains quieter than this are unvoiced
+  const auto MinRms = 1e-3f;
+  // grains further apart than this are in different blobs
+  const auto BlobTolerance = .5f;
+
+  auto freq2Note(double freq) -> float
+  {
+    return static_cast<float>(24. + 12. * std::log2(freq / 55.));
+  }
+
+  // sum of x[i] * y[i], in independent partial sums so the compiler can vectorize it
+  auto dot(const float *x, const float *y, int n) -> float
+  {
+    auto acc = std::array<float, 8>{};
+    auto i = 0;
+    for (; i + 8 <= n; i += 8)
+      for (auto k = 0; k < 8; ++k)
+        acc[static_cast<size_t>(k)] += x[i + k] * y[i + k];
+    auto ret = 0.f;
+    for (; i < n; ++i)
+      ret += x[i] * y[i];
+    for (const auto a : acc)
+      ret += a;
+    return ret;
+  }
+
+  // note of the window starting at x, x has Window + maxLag samples; 0 if it is unvoiced
+  auto yin(const float *x, int minLag, int maxLag, int sampleRate, std::vector<float> &d) -> float
+  {
+    const auto energy = dot(x, x, Window);
+    if (energy < MinRms * MinRms * Window)
+      return 0.f;
+
+    // d(lag) = sum (x[i] - x[i + lag])^2 = e(0) + e(lag) - 2 r(lag), the energies slide along
+    d.resize(static_cast<size_t>(maxLag) + 2);
+    d[0] = 1.f;
+    auto shifted = energy;
+    auto sum = 0.f;
+    for (auto lag = 1; lag <= maxLag + 1; ++lag)
+    {
+      shifted += x[lag + Window - 1] * x[lag + Window - 1] - x[lag - 1] * x[lag - 1];
+      const auto diff = std::max(0.f, energy + shifted - 2.f * dot(x, x + lag, Window));
+      // cumulative mean normalized difference, removes the dip at lag 0
+      sum += diff;
+      d[static_cast<size_t>(lag)] = sum > 0.f ? diff * lag / sum : 1.f;
+    }
+
+    auto lag = minLag;
+    while (lag <= maxLag && d[static_cast<size_t>(lag)] >= Threshold)
+      ++lag;
+    if (lag > maxLag)
+      return 0.f;
+    while (lag + 1 <= maxLag && d[static_cast<size_t>(lag) + 1] < d[static_cast<size_t>(lag)])
+      ++lag;
+
+    // parabola through the minimum and its neighbours
+    const auto a = d[static_cast<size_t>(lag) - 1];
+    const auto b = d[static_cast<size_t>(lag)];
+    const auto c = d[static_cast<size_t>(lag) + 1];
+    const auto den = a - 2.f * b + c;
+    const auto offset = den > 0.f ? std::clamp(.5f * (a - c) / den, -.5f, .5f) : 0.f;
+    return freq2Note(1. * sampleRate / (lag + offset));
+  }
+} // namespace
+
+auto PitchTrack::set(size_t grain, float note) -> void
+{
+  cents[grain] = static_cast<int16_t>(std::lround(note * 100.f));
+}
+
+auto detectPitch(std::span<const float> wav,
+                 const GrainIndex &grains,
+                 int sampleRate,
+                 const std::atomic<bool> *isStopping) -> PitchTrack
+{
+  auto ret = PitchTrack{};
+  ret.resize(grains.size());
+  const auto minLag = std::max(2, static_cast<int>(sampleRate / MaxFreq));
+  const auto maxLag = static_cast<int>(sampleRate / MinFreq);
+  const auto length = static_cast<size_t>(Window + maxLag + 2);
+  if (wav.size() < length)
+    return ret;
+  parallelFor(grains.size(), 64, [&](size_t begin, size_t end) {
+    auto d = std::vector<float>{};
+    for (auto i = begin; i < end; ++i)
+    {
+      if (isStopping && isStopping->load(std::memory_order_relaxed))
+        return;
+      // the window is centered on the grain and moved inside the file at its ends
+      const auto grain = grains[i];
+      const auto center = static_cast<size_t>(grain.start) + static_cast<size_t>(grain.size) / 2;
+      const auto first = std::min(center - std::min(center, length / 2), wav.size() - length);
+      ret.set(i, yin(wav.data() + first, minLag, maxLag, sampleRate, d));
+    }
+  });
+  return ret;
+}
+
+auto noteBlobs(const PitchTrack &track) -> std::vector<NoteBlob>
+{
+  auto ret = std::vector<NoteBlob>{};
+  auto notes = std::vector<float>{};
+  const auto close = [&]() {
+    if (notes.empty())
+      return;
+    const auto mid = std::begin(notes) + static_cast<ptrdiff_t>(notes.size() / 2);
+    std::nth_element(std::begin(notes), mid, std::end(notes));
+    ret.back().note = *mid;
+    notes.clear();
+  };
+  for (auto i = size_t{0}; i < track.size(); ++i)
+  {
+    if (!track.isVoiced(i))
+    {
+      close();
+      continue;
+    }
+    const auto note = track.note(i);
+    // a blob follows a vibrato but breaks at a jump to the next note
+    if (notes.empty() || std::abs(note - notes.back()) > BlobTolerance)
+    {
+      close();
+      ret.push_back(NoteBlob{i, i + 1, note});
+    }
+    notes.push_back(note);
+    ret.back().endGrain = i + 1;
+  }
+  close();
+  return ret;
+}
+
+auto findBlob(const std::vector<NoteBlob> &blobs, size_t grain) -> size_t
+{
+  const auto it = std::upper_bound(
+    std::begin(blobs), std::end(blobs), grain, [](size_t g, const NoteBlob &b) { return g < b.firstGrain; });
+  if (it == std::begin(blobs) || std::prev(it)->endGrain <= grain)
+    return blobs.size();
+  return static_cast<size_t>(std::prev(it) - std::begin(blobs));
+}
+
+PitchDetector::PitchDetector(std::span<const float> wav, GrainIndex aGrains, int sampleRate)
+  : grains(std::move(aGrains))
+{
+  thread = std::thread([this, wav, sampleRate]() {
+    track = detectPitch(wav, grains, sampleRate, &isStopping);
+    if (!isStopping)
+      LOG("pitch detected", "grains", grains.size());
+    done.store(true, std::memory_order_release);
+  });
+}
+
+PitchDetector::~PitchDetector()
+{
+  isStopping = true;
+  if (thread.joinable())
+    thread.join();
+}
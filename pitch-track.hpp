@@ -0,0 +1,78 @@
+#pragma once
+#include "grains.hpp"
+#include <atomic>
+#include <cstdint>
+#include <ser/macro.hpp>
+#include <span>
+#include <thread>
+#include <vector>
+
+// The detected pitch of every grain, in the notes of the view (55 Hz is note 24). Stored in hundredths
+// of a note, two bytes per grain; 0 is an unvoiced grain.
+class PitchTrack
+{
+public:
+  auto size() const -> size_t { return cents.size(); }
+  auto empty() const -> bool { return cents.empty(); }
+  auto clear() -> void { cents.clear(); }
+  // 0 if the grain is unvoiced
+  auto note(size_t grain) const -> float { return cents[grain] / 100.f; }
+  auto isVoiced(size_t grain) const -> bool { return cents[grain] != 0; }
+  // the track was computed for these grains
+  auto isValid(const GrainIndex &grains) const -> bool { return cents.size() == grains.size(); }
+  auto resize(size_t n) -> void { cents.resize(n); }
+  auto set(size_t grain, float note) -> void;
+
+private:
+  std::vector<int16_t> cents;
+
+public:
+#define SER_PROP_LIST SER_PROP(cents);
+  SER_DEF_PROPS()
+#undef SER_PROP_LIST
+};
+
+// consecutive voiced grains at about the same pitch, drawn as one note and used for snapping
+struct NoteBlob
+{
+  size_t firstGrain;
+  // one past the last grain
+  size_t endGrain;
+  // median of the grains
+  float note;
+};
+
+// YIN on a window around the middle of every grain, the grains are split across all cores; the grains
+// left when isStopping is set stay unvoiced
+auto detectPitch(std::span<const float> wav,
+                 const GrainIndex &,
+                 int sampleRate,
+                 const std::atomic<bool> *isStopping = nullptr) -> PitchTrack;
+// sorted by firstGrain
+auto noteBlobs(const PitchTrack &) -> std::vector<NoteBlob>;
+// the blob containing the grain, blobs.size() if the grain is in none
+auto findBlob(const std::vector<NoteBlob> &blobs, size_t grain) -> size_t;
+
+// Runs detectPitch on a background thread, the UI keeps working with the track it has
+class PitchDetector
+{
+public:
+  // wav has to stay valid until the detector is destroyed
+  PitchDetector(std::span<const float> wav, GrainIndex grains, int sampleRate);
+  // cancels an unfinished detection
+  ~PitchDetector();
+  // disable copy
+  PitchDetector(const PitchDetector &) = delete;
+  PitchDetector &operator=(const PitchDetector &) = delete;
+
+  auto isDone() const -> bool { return done.load(std::memory_order_acquire); }
+  // only valid once isDone()
+  auto take() -> PitchTrack { return std::move(track); }
+
+private:
+  GrainIndex grains;
+  PitchTrack track;
+  std::atomic<bool> done = false;
+  std::atomic<bool> isStopping = false;
+  std::thread thread;
+};
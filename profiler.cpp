@@ -0,0 +1,190 @@
+#include "profiler.hpp"
+#include <algorithm>
+#include <cfloat>
+#include <fstream>
+#include <imgui/imgui.h>
+#include <log/log.hpp>
+#include <numeric>
+#include <thread>
+
+auto profiler() -> Profiler &
+{
+  static auto instance = Profiler{};
+  return instance;
+}
+
+auto Profiler::Timer::add(double ms) -> void
+{
+  const auto i = next.fetch_add(1, std::memory_order_relaxed) % HistorySize;
+  history[static_cast<size_t>(i)].store(static_cast<float>(ms), std::memory_order_relaxed);
+  count.fetch_add(1, std::memory_order_relaxed);
+}
+
+auto Profiler::timer(const std::string &name) -> Timer &
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  const auto it =
+    std::find_if(std::begin(timers), std::end(timers), [&](const auto &t) { return t.name == name; });
+  if (it != std::end(timers))
+    return *it;
+  return timers.emplace_back(name);
+}
+
+auto Profiler::counter(const std::string &name) -> Counter &
+{
+  return findCounter(name, false);
+}
+
+auto Profiler::gauge(const std::string &name) -> Counter &
+{
+  return findCounter(name, true);
+}
+
+auto Profiler::findCounter(const std::string &name, bool isGauge) -> Counter &
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  const auto it =
+    std::find_if(std::begin(counters), std::end(counters), [&](const auto &c) { return c.name == name; });
+  if (it != std::end(counters))
+    return *it;
+  return counters.emplace_back(name, isGauge);
+}
+
+auto Profiler::threadId() -> uint32_t
+{
+  // small numbers in the order the threads first record, the trace viewer shows one track per thread
+  thread_local const auto id = nextThreadId++;
+  return id;
+}
+
+auto Profiler::record(Timer &timer,
+                      std::chrono::steady_clock::time_point start,
+                      std::chrono::steady_clock::time_point end) -> void
+{
+  timer.add(std::chrono::duration<double, std::milli>(end - start).count());
+  // the cheap check first, the writer count is only touched while tracing
+  if (!tracing.load(std::memory_order_relaxed))
+    return;
+  // seq_cst from here: either saveTrace() sees this writer or this writer sees the stop
+  ++writers;
+  if (tracing.load())
+  {
+    const auto i = eventCount.fetch_add(1, std::memory_order_relaxed);
+    if (i < MaxEvents)
+    {
+      const auto ns = [](auto d) { return std::chrono::duration_cast<std::chrono::nanoseconds>(d).count(); };
+      events[i] = Event{&timer, threadId(), ns(start.time_since_epoch()) - origin.load(), ns(end - start)};
+    }
+  }
+  --writers;
+}
+
+auto Profiler::startTrace() -> void
+{
+  if (isTracing())
+    return;
+  if (!events)
+    events = std::make_unique<Event[]>(MaxEvents);
+  // saveTrace() drained the writers of the last trace, nothing writes into the buffer here
+  eventCount = 0;
+  origin = std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+             .count();
+  tracing = true;
+}
+
+auto Profiler::saveTrace(const std::string &path) -> bool
+{
+  if (!isTracing())
+    return false;
+  tracing = false;
+  // the scopes which saw the trace running finish writing their slot
+  while (writers.load() > 0)
+    std::this_thread::yield();
+  const auto n = std::min(eventCount.load(), MaxEvents);
+
+  auto f = std::ofstream{path};
+  if (!f)
+  {
+    LOG("cannot open", path);
+    return false;
+  }
+  f << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+  for (auto i = size_t{0}; i < n; ++i)
+  {
+    const auto &e = events[i];
+    if (i > 0)
+      f << ",\n";
+    // complete events, the timestamps are in microseconds
+    f << "{\"name\":\"" << e.timer->name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << e.thread
+      << ",\"ts\":" << e.start / 1000. << ",\"dur\":" << e.duration / 1000. << "}";
+  }
+  f << "\n]}\n";
+  if (eventCount.load() > MaxEvents)
+    LOG("the trace buffer was full,", eventCount.load() - MaxEvents, "events are missing");
+  LOG("saved trace", path, n, "events");
+  return static_cast<bool>(f);
+}
+
+auto Profiler::draw(bool *isOpen) -> void
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  for (auto &c : counters)
+  {
+    const auto value = c.value.load(std::memory_order_relaxed);
+    const auto sample = c.isGauge ? value : value - c.lastValue;
+    c.history[static_cast<size_t>(c.next++ % HistorySize)] = static_cast<float>(sample);
+    c.lastValue = value;
+  }
+
+  if (!isOpen || !*isOpen)
+    return;
+  ImGui::Begin("Profiler", isOpen);
+  if (!isTracing())
+  {
+    if (ImGui::Button("Record trace"))
+      startTrace();
+  }
+  else
+  {
+    ImGui::Text("recording, %zu events", std::min(eventCount.load(), MaxEvents));
+    ImGui::SameLine();
+    if (ImGui::Button("Save trace"))
+      saveTrace("melonix-trace.json");
+  }
+
+  if (ImGui::CollapsingHeader("Timers"))
+  {
+    auto values = std::array<float, HistorySize>{};
+    for (auto &t : timers)
+    {
+      const auto n = static_cast<int>(std::min<uint64_t>(t.count.load(), HistorySize));
+      if (n == 0)
+        continue;
+      // oldest first
+      const auto next = t.next.load(std::memory_order_relaxed);
+      for (auto i = 0; i < n; ++i)
+      {
+        const auto slot = static_cast<size_t>((next - static_cast<uint32_t>(n - i)) % HistorySize);
+        values[static_cast<size_t>(i)] = t.history[slot].load(std::memory_order_relaxed);
+      }
+      const auto sum = std::accumulate(std::begin(values), std::begin(values) + n, 0.);
+      const auto max = *std::max_element(std::begin(values), std::begin(values) + n);
+      ImGui::Text("%s: %.3f ms avg, %.3f ms max", t.name.c_str(), sum / n, max);
+      ImGui::PlotHistogram(("##" + t.name).c_str(), values.data(), n, 0, nullptr, 0.f, max, ImVec2(0, 40));
+    }
+  }
+  if (ImGui::CollapsingHeader("Counters"))
+  {
+    auto values = std::array<float, HistorySize>{};
+    for (auto &c : counters)
+    {
+      for (auto i = 0; i < HistorySize; ++i)
+        values[static_cast<size_t>(i)] = c.history[static_cast<size_t>((c.next + i) % HistorySize)];
+      ImGui::Text("%s: %.0f%s", c.name.c_str(), values[HistorySize - 1], c.isGauge ? "" : " per frame");
+      ImGui::PlotLines(
+        ("##" + c.name).c_str(), values.data(), HistorySize, 0, nullptr, FLT_MAX, FLT_MAX, ImVec2(0, 40));
+    }
+  }
+  ImGui::End();
+}
@@ -0,0 +1,133 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+
+// Scoped timers and counters for the hot paths, shown in an ImGui window and exportable as a Chrome
+// trace (chrome://tracing, ui.perfetto.dev).
+//
+// Recording never locks or allocates, so it can be used on the audio thread: a timer or a counter is
+// registered once, usually into a function-local static, and after that only touches atomics. Trace
+// events go into a preallocated buffer while a trace is recording.
+class Profiler
+{
+public:
+  static const auto HistorySize = 128;
+
+  // durations in ms of the last HistorySize scopes
+  class Timer
+  {
+  public:
+    explicit Timer(std::string name) : name(std::move(name)) {}
+    auto add(double ms) -> void;
+
+    const std::string name;
+    std::array<std::atomic<float>, HistorySize> history = {};
+    std::atomic<uint32_t> next = 0;
+    std::atomic<uint64_t> count = 0;
+  };
+
+  // events counted with add() or a value set with set(), the window samples it once per frame
+  class Counter
+  {
+  public:
+    Counter(std::string name, bool isGauge) : name(std::move(name)), isGauge(isGauge) {}
+    auto add(int64_t n = 1) -> void { value.fetch_add(n, std::memory_order_relaxed); }
+    auto set(int64_t n) -> void { value.store(n, std::memory_order_relaxed); }
+
+    const std::string name;
+    // a gauge shows its value, a counter the increase per frame
+    const bool isGauge;
+    std::atomic<int64_t> value = 0;
+    // written by the UI thread only
+    std::array<float, HistorySize> history = {};
+    int next = 0;
+    int64_t lastValue = 0;
+  };
+
+  auto timer(const std::string &name) -> Timer &;
+  auto counter(const std::string &name) -> Counter &;
+  auto gauge(const std::string &name) -> Counter &;
+  // called by ProfileScope
+  auto record(Timer &, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end)
+    -> void;
+
+  // the window, samples the counters; call once per frame
+  auto draw(bool *isOpen) -> void;
+  auto startTrace() -> void;
+  // stops recording and writes the events recorded since startTrace()
+  auto saveTrace(const std::string &path) -> bool;
+  auto isTracing() const -> bool { return tracing.load(std::memory_order_relaxed); }
+
+private:
+  struct Event
+  {
+    const Timer *timer;
+    uint32_t thread;
+    // ns since startTrace()
+    int64_t start;
+    int64_t duration;
+  };
+  // one Event is 32 bytes, this is 32 MB while a trace is recording
+  static constexpr auto MaxEvents = size_t{1} << 20;
+
+  std::mutex mutex;
+  // stable addresses, callers keep references
+  std::deque<Timer> timers;
+  std::deque<Counter> counters;
+  // steady_clock ns of startTrace(), read by the recording threads
+  std::atomic<int64_t> origin = 0;
+  std::atomic<bool> tracing = false;
+  std::unique_ptr<Event[]> events;
+  // claimed slots, some of them can be past MaxEvents
+  std::atomic<size_t> eventCount = 0;
+  // record() calls between their check of tracing and the end of their write; saveTrace() waits for them,
+  // so no write of a trace lands after the next startTrace()
+  std::atomic<int> writers = 0;
+  std::atomic<uint32_t> nextThreadId = 0;
+
+  auto findCounter(const std::string &name, bool isGauge) -> Counter &;
+  auto threadId() -> uint32_t;
+};
+
+auto profiler() -> Profiler &;
+
+// times the enclosing scope
+class ProfileScope
+{
+public:
+  explicit ProfileScope(Profiler::Timer &timer) : timer(timer), start(std::chrono::steady_clock::now()) {}
+  // counts the scopes which take longer than deadlineMs in misses
+  ProfileScope(Profiler::Timer &timer, double deadlineMs, Profiler::Counter &misses)
+    : timer(timer), start(std::chrono::steady_clock::now()), deadlineMs(deadlineMs), misses(&misses)
+  {
+  }
+  ~ProfileScope()
+  {
+    const auto end = std::chrono::steady_clock::now();
+    profiler().record(timer, start, end);
+    if (misses && std::chrono::duration<double, std::milli>(end - start).count() > deadlineMs)
+      misses->add();
+  }
+  // disable copy
+  ProfileScope(const ProfileScope &) = delete;
+  ProfileScope &operator=(const ProfileScope &) = delete;
+
+private:
+  Profiler::Timer &timer;
+  std::chrono::steady_clock::time_point start;
+  double deadlineMs = 0.;
+  Profiler::Counter *misses = nullptr;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+// PROFILE("glDraw/waveform"); times the rest of the scope
+#define PROFILE(name)                                                                           \
+  static auto &PROFILE_CONCAT(profileTimer, __LINE__) = profiler().timer(name);                 \
+  const auto PROFILE_CONCAT(profileScope, __LINE__) = ProfileScope(PROFILE_CONCAT(profileTimer, __LINE__))
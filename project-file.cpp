@@ -0,0 +1,191 @@
+#include "project-file.hpp"
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <log/log.hpp>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+  const auto Magic = std::array<char, 8>{'M', 'E', 'L', 'O', 'N', 'I', 'X', '\0'};
+  const auto PageSize = size_t{4096};
+  // a samples chunk per track and the metadata, the header still fits into the first page
+  const auto MaxChunks = 64;
+
+  struct Chunk
+  {
+    ChunkTag tag;
+    uint32_t reserved;
+    uint64_t offset;
+    uint64_t size;
+  };
+
+  struct Header
+  {
+    std::array<char, 8> magic;
+    uint32_t version;
+    uint32_t count;
+    std::array<Chunk, MaxChunks> chunks;
+  };
+  static_assert(sizeof(Header) <= PageSize);
+
+  auto alignUp(uint64_t v) -> uint64_t
+  {
+    return (v + PageSize - 1) / PageSize * PageSize;
+  }
+
+  auto isValid(const Header &header, uint64_t fileSize) -> bool
+  {
+    if (header.magic != Magic || header.count > MaxChunks)
+      return false;
+    for (auto i = 0U; i < header.count; ++i)
+    {
+      const auto &c = header.chunks[i];
+      if (c.offset % PageSize != 0 || c.offset < PageSize || c.offset + c.size > fileSize)
+        return false;
+    }
+    return true;
+  }
+} // namespace
+
+ProjectFile::ProjectFile(const std::string &path)
+{
+  const auto fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < PageSize)
+  {
+    close(fd);
+    return;
+  }
+  const auto size = static_cast<size_t>(st.st_size);
+  Header header;
+  if (pread(fd, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header)) || !isValid(header, size))
+  {
+    close(fd);
+    return;
+  }
+  // private and writable, the samples are handed out as float spans but nobody writes into them
+  const auto ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (ptr == MAP_FAILED)
+  {
+    LOG("failed to map project", path);
+    return;
+  }
+  map = ptr;
+  mapSize = size;
+  fileVersion = static_cast<int>(header.version);
+  for (auto i = 0U; i < header.count; ++i)
+  {
+    const auto &c = header.chunks[i];
+    chunks.push_back(std::make_pair(c.tag, std::span<char>{static_cast<char *>(map) + c.offset, c.size}));
+  }
+}
+
+ProjectFile::~ProjectFile()
+{
+  if (map)
+    munmap(map, mapSize);
+}
+
+auto ProjectFile::chunk(ChunkTag tag) const -> std::span<char>
+{
+  for (const auto &c : chunks)
+    if (c.first == tag)
+      return c.second;
+  return {};
+}
+
+auto ProjectFile::save(const std::string &path,
+                       int version,
+                       const std::vector<std::pair<ChunkTag, std::span<const char>>> &chunks) -> bool
+{
+  if (chunks.size() > MaxChunks)
+    return false;
+  const auto tmpPath = path + ".tmp";
+  {
+    auto file = std::ofstream{tmpPath, std::ios::binary};
+    if (!file.is_open())
+    {
+      LOG("failed to open file", tmpPath);
+      return false;
+    }
+    auto header = Header{};
+    header.magic = Magic;
+    header.version = static_cast<uint32_t>(version);
+    header.count = static_cast<uint32_t>(chunks.size());
+    auto offset = uint64_t{PageSize};
+    for (auto i = 0U; i < chunks.size(); ++i)
+    {
+      header.chunks[i] = Chunk{chunks[i].first, 0, offset, chunks[i].second.size()};
+      offset = alignUp(offset + chunks[i].second.size());
+    }
+    const auto padding = std::vector<char>(PageSize);
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(padding.data(), PageSize - sizeof(header));
+    for (auto i = 0U; i < chunks.size(); ++i)
+    {
+      file.write(chunks[i].second.data(), chunks[i].second.size());
+      // the padding after the last chunk is left out, replaceLast() truncates there anyway
+      if (i + 1 < chunks.size())
+        file.write(padding.data(), alignUp(chunks[i].second.size()) - chunks[i].second.size());
+    }
+    if (!file)
+    {
+      LOG("failed to write project", tmpPath);
+      return false;
+    }
+  }
+  std::error_code ec;
+  std::filesystem::rename(tmpPath, path, ec);
+  if (ec)
+  {
+    LOG("failed to rename", tmpPath, path, ec.message());
+    return false;
+  }
+  return true;
+}
+
+auto ProjectFile::replaceLast(const std::string &path, ChunkTag tag, std::span<const char> data) -> bool
+{
+  const auto fd = open(path.c_str(), O_RDWR);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  Header header;
+  const auto isOk = [&]() {
+    if (fstat(fd, &st) != 0 || pread(fd, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header)))
+      return false;
+    if (!isValid(header, static_cast<uint64_t>(st.st_size)) || header.count == 0)
+      return false;
+    auto &last = header.chunks[header.count - 1];
+    if (last.tag != tag)
+      return false;
+    // the old chunk is never overwritten: the new one goes right behind the previous chunk if the old one
+    // was moved away from there and it fits, otherwise behind the old one; the header points to it only
+    // once it is on the disk, so a crash at any point leaves either the old or the new chunk
+    const auto home = header.count > 1 ? alignUp(header.chunks[header.count - 2].offset +
+                                                 header.chunks[header.count - 2].size)
+                                       : uint64_t{PageSize};
+    const auto offset =
+      last.offset > home && home + data.size() <= last.offset ? home : alignUp(last.offset + last.size);
+    if (pwrite(fd, data.data(), data.size(), static_cast<off_t>(offset)) != static_cast<ssize_t>(data.size()))
+      return false;
+    if (fsync(fd) != 0)
+      return false;
+    last.offset = offset;
+    last.size = data.size();
+    // the header fits into the first page, which the disk writes as a whole
+    if (pwrite(fd, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header)) || fsync(fd) != 0)
+      return false;
+    // the old chunk is not referenced any more, whatever is behind the new one goes away
+    return ftruncate(fd, static_cast<off_t>(offset + data.size())) == 0;
+  }();
+  close(fd);
+  return isOk;
+}
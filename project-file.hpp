@@ -0,0 +1,43 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+using ChunkTag = std::array<char, 4>;
+
+// Chunked project container. The first page holds the header with the chunk directory, every chunk
+// starts at a page boundary so it can be used in place from the mapping. The chunk written last can be
+// replaced without touching the ones before it.
+class ProjectFile
+{
+public:
+  // maps the file, isOpen() is false if it does not exist or is not a chunked project
+  explicit ProjectFile(const std::string &path);
+  ~ProjectFile();
+  ProjectFile(const ProjectFile &) = delete;
+  ProjectFile &operator=(const ProjectFile &) = delete;
+
+  auto isOpen() const -> bool { return map != nullptr; }
+  auto version() const -> int { return fileVersion; }
+  // empty if there is no such chunk; the mapping is private and writable, writes never reach the file
+  auto chunk(ChunkTag) const -> std::span<char>;
+  // all chunks in the order they were saved
+  auto all() const -> const std::vector<std::pair<ChunkTag, std::span<char>>> & { return chunks; }
+
+  // writes a new file next to path and renames it over, a mapping of the old file stays valid
+  static auto save(const std::string &path,
+                   int version,
+                   const std::vector<std::pair<ChunkTag, std::span<const char>>> &chunks) -> bool;
+  // replaces the last chunk of an existing file without touching the ones before it, fails if the last
+  // chunk has a different tag; the new chunk is written next to the old one before the header is switched
+  static auto replaceLast(const std::string &path, ChunkTag, std::span<const char>) -> bool;
+
+private:
+  void *map = nullptr;
+  size_t mapSize = 0;
+  int fileVersion = 0;
+  std::vector<std::pair<ChunkTag, std::span<char>>> chunks;
+};
@@ -0,0 +1,95 @@
+#include "project-meta.hpp"
+#include <cstdint>
+#include <ser/istrm.hpp>
+#include <ser/ser.hpp>
+
+namespace
+{
+  // chunked projects of version 3 have no pitch track in the metadata, it is detected again
+  struct MetaV3
+  {
+    int &sampleRate;
+    float &brightness;
+    std::vector<Marker> &markers;
+    float &tempo;
+    GrainIndex &grains;
+
+#define SER_PROP_LIST   \
+  SER_PROP(sampleRate); \
+  SER_PROP(brightness); \
+  SER_PROP(markers);    \
+  SER_PROP(tempo);      \
+  SER_PROP(grains);
+
+    SER_DEF_PROPS()
+#undef SER_PROP_LIST
+  };
+
+  // version 4 had a single track
+  struct MetaV4
+  {
+    int &sampleRate;
+    float &brightness;
+    std::vector<Marker> &markers;
+    float &tempo;
+    GrainIndex &grains;
+    PitchTrack &pitchTrack;
+
+#define SER_PROP_LIST   \
+  SER_PROP(sampleRate); \
+  SER_PROP(brightness); \
+  SER_PROP(markers);    \
+  SER_PROP(tempo);      \
+  SER_PROP(grains);     \
+  SER_PROP(pitchTrack);
+
+    SER_DEF_PROPS()
+#undef SER_PROP_LIST
+  };
+} // namespace
+
+auto loadMeta(std::span<const char> meta,
+              int version,
+              MetaSettings settings,
+              const std::string &name,
+              std::vector<std::unique_ptr<Track>> &tracks) -> void
+{
+  IStrm st(meta.data(), meta.data() + meta.size());
+  if (version < 5)
+  {
+    tracks.push_back(std::make_unique<Track>());
+    auto &t = *tracks.back();
+    t.name = name;
+    if (version == 3)
+    {
+      auto v3 = MetaV3{settings.sampleRate, settings.brightness, t.markers, settings.tempo, t.grains};
+      ::deser(st, v3);
+    }
+    else
+    {
+      auto v4 =
+        MetaV4{settings.sampleRate, settings.brightness, t.markers, settings.tempo, t.grains, t.pitchTrack};
+      ::deser(st, v4);
+    }
+    return;
+  }
+  ::deser(st, settings);
+  auto n = uint32_t{};
+  ::deser(st, n);
+  for (auto i = 0U; i < n; ++i)
+  {
+    tracks.push_back(std::make_unique<Track>());
+    ::deser(st, *tracks.back());
+  }
+}
+
+auto saveMeta(MetaSettings settings, const std::vector<std::unique_ptr<Track>> &tracks) -> std::string
+{
+  OStrm st;
+  ::ser(st, settings);
+  const auto n = static_cast<uint32_t>(tracks.size());
+  ::ser(st, n);
+  for (const auto &t : tracks)
+    ::ser(st, *t);
+  return st.str();
+}
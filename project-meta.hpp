@@ -0,0 +1,36 @@
+#pragma once
+#include "track.hpp"
+#include <memory>
+#include <ser/macro.hpp>
+#include <span>
+#include <string>
+#include <vector>
+
+// The metadata chunk of a chunked project: the settings of the project, then every track without its
+// samples, which have chunks of their own. Versions 3 and 4 had a single track, version 3 without the
+// pitch track.
+struct MetaSettings
+{
+  int &sampleRate;
+  float &brightness;
+  float &tempo;
+
+#define SER_PROP_LIST   \
+  SER_PROP(sampleRate); \
+  SER_PROP(brightness); \
+  SER_PROP(tempo);
+
+  SER_DEF_PROPS()
+#undef SER_PROP_LIST
+};
+
+// reads the metadata of a project of the version into the settings and appends its tracks; the single
+// track of versions 3 and 4 gets the name, a track of version 3 is left without a pitch track so it is
+// detected again
+auto loadMeta(std::span<const char> meta,
+              int version,
+              MetaSettings,
+              const std::string &name,
+              std::vector<std::unique_ptr<Track>> &tracks) -> void;
+// the metadata in the current version
+auto saveMeta(MetaSettings, const std::vector<std::unique_ptr<Track>> &tracks) -> std::string;
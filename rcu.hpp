@@ -0,0 +1,46 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+// Publishes immutable versions of T from one writer thread to one reader thread without locks.
+// The reader announces the version it uses in a hazard pointer, the writer frees retired versions only
+// when the reader does not use them, so nothing is freed or allocated on the reader side.
+template <typename T>
+class Rcu
+{
+public:
+  // writer side
+  auto publish(std::unique_ptr<const T> value) -> void
+  {
+    if (owned)
+      retired.push_back(std::move(owned));
+    owned = std::move(value);
+    current.store(owned.get());
+    const auto hazard = inUse.load();
+    std::erase_if(retired, [hazard](const auto &v) { return v.get() != hazard; });
+  }
+
+  // writer side, the latest published version
+  auto get() const -> const T * { return owned.get(); }
+
+  // reader side, the returned version stays valid until the next acquire()
+  auto acquire() const -> const T *
+  {
+    for (;;)
+    {
+      const auto ret = current.load();
+      inUse.store(ret);
+      // if the writer published in between, it could have missed the hazard
+      if (current.load() == ret)
+        return ret;
+    }
+  }
+
+private:
+  std::unique_ptr<const T> owned;
+  std::vector<std::unique_ptr<const T>> retired;
+  std::atomic<const T *> current{nullptr};
+  mutable std::atomic<const T *> inUse{nullptr};
+};
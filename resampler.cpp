@@ -0,0 +1,199 @@
+#include "resampler.hpp"
+#include "cpu-features.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RESAMPLER_AVX2 1
+#endif
+
+namespace
+{
+  const auto FastTaps = 4;
+  const auto HighTaps = 32;
+  // the high quality cutoff steps down by a quarter octave per table, up to two octaves of pitch up
+  const auto CutoffSteps = 4;
+  const auto HighTables = 2 * CutoffSteps + 1;
+  // fraction of the Nyquist frequency passed at rates up to 1, leaves room for the transition band
+  const auto BaseCutoff = .9;
+
+  // row r holds the coefficients for the fraction r / Phases, tap k reads the sample at
+  // idx - taps / 2 + 1 + k
+  template <typename Kernel>
+  auto tabulate(int taps, Kernel &&kernel, float *dst) -> void
+  {
+    for (auto r = 0; r <= Resampler::Phases; ++r)
+    {
+      const auto f = 1. * r / Resampler::Phases;
+      auto row = dst + r * taps;
+      auto sum = 0.;
+      for (auto k = 0; k < taps; ++k)
+        sum += kernel(k - taps / 2 + 1 - f);
+      // unity gain at DC for every fraction, the truncated kernels are slightly off otherwise
+      for (auto k = 0; k < taps; ++k)
+        row[k] = static_cast<float>(kernel(k - taps / 2 + 1 - f) / sum);
+    }
+  }
+
+  // Catmull-Rom, goes through the samples like linear interpolation but with a continuous slope
+  auto cubic(double x) -> double
+  {
+    x = std::abs(x);
+    if (x < 1.)
+      return (1.5 * x - 2.5) * x * x + 1.;
+    if (x < 2.)
+      return ((-.5 * x + 2.5) * x - 4.) * x + 2.;
+    return 0.;
+  }
+
+  auto makeFastTable() -> std::array<float, (Resampler::Phases + 1) * FastTaps>
+  {
+    auto ret = std::array<float, (Resampler::Phases + 1) * FastTaps>{};
+    tabulate(FastTaps, cubic, ret.data());
+    return ret;
+  }
+
+  auto makeHighTables() -> std::vector<float>
+  {
+    const auto tableSize = static_cast<size_t>((Resampler::Phases + 1) * HighTaps);
+    auto ret = std::vector<float>(tableSize * HighTables);
+    for (auto i = 0; i < HighTables; ++i)
+    {
+      const auto cutoff = BaseCutoff * std::pow(2., -1. * i / CutoffSteps);
+      tabulate(
+        HighTaps,
+        [cutoff](double x) {
+          // sinc with the cutoff, Blackman window over the taps
+          const auto s = x == 0. ? 1. : std::sin(M_PI * cutoff * x) / (M_PI * cutoff * x);
+          const auto w = x / (HighTaps / 2);
+          if (std::abs(w) >= 1.)
+            return 0.;
+          return s * (.42 + .5 * std::cos(M_PI * w) + .08 * std::cos(2. * M_PI * w));
+        },
+        ret.data() + tableSize * i);
+    }
+    return ret;
+  }
+
+  // built when the program starts, a resampler created on the audio thread never waits for them
+  const auto FastTable = makeFastTable();
+  const auto HighTable = makeHighTables();
+
+  // the position is 32.32 fixed point, the top bits of the fraction pick the row and the rest is the weight
+  const auto FracBits = 32;
+  const auto RowBits = 8;
+  const auto WeightBits = FracBits - RowBits;
+  static_assert(Resampler::Phases == 1 << RowBits);
+
+  // the coefficients between row0 and row1 at w, applied to src[0, taps)
+  auto dotScalar(const float *row0, const float *row1, float w, const float *src, int taps) -> float
+  {
+    auto acc = 0.f;
+    for (auto k = 0; k < taps; ++k)
+      acc += (row0[k] + w * (row1[k] - row0[k])) * src[k];
+    return acc;
+  }
+
+#if defined(RESAMPLER_AVX2)
+  // AVX2 is not in the default flags, the kernel is compiled for it separately and picked at run time by
+  // cpuHasAvx2()
+  // taps is a multiple of 8
+  __attribute__((target("avx2"))) auto dotAvx2(const float *row0,
+                                               const float *row1,
+                                               float w,
+                                               const float *src,
+                                               int taps) -> float
+  {
+    const auto vw = _mm256_set1_ps(w);
+    auto acc = _mm256_setzero_ps();
+    for (auto k = 0; k < taps; k += 8)
+    {
+      const auto c0 = _mm256_loadu_ps(row0 + k);
+      const auto c = _mm256_add_ps(c0, _mm256_mul_ps(vw, _mm256_sub_ps(_mm256_loadu_ps(row1 + k), c0)));
+      acc = _mm256_add_ps(acc, _mm256_mul_ps(c, _mm256_loadu_ps(src + k)));
+    }
+    const auto half = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+    const auto quarter = _mm_add_ps(half, _mm_movehl_ps(half, half));
+    return _mm_cvtss_f32(_mm_add_ss(quarter, _mm_shuffle_ps(quarter, quarter, 1)));
+  }
+#endif
+
+  template <typename Dot>
+  auto run(const Resampler::Grain &g,
+           const float *table,
+           int taps,
+           float rate,
+           float bias,
+           size_t first,
+           std::span<float> out,
+           Dot &&dot) -> void
+  {
+    const auto before = static_cast<size_t>(taps / 2 - 1);
+    const auto after = static_cast<size_t>(taps / 2);
+    // the sample at offset k from the start of the grain, k can be outside of it
+    const auto at = [&g](ptrdiff_t k) -> float {
+      if (k < 0)
+        return -k <= static_cast<ptrdiff_t>(g.start) ? g.wav[g.start - static_cast<size_t>(-k)] : 0.f;
+      const auto i = static_cast<size_t>(k);
+      if (i < g.size)
+        return g.wav[g.start + i];
+      const auto n = g.next + (i - g.size);
+      return n < g.wav.size() ? g.wav[n] : 0.f;
+    };
+    auto window = std::array<float, HighTaps>{};
+    // one add per sample instead of a multiply and a modf, the error of the rounded step stays far below a
+    // row over a grain
+    auto pos = std::llround((static_cast<double>(first) * rate + bias) * 0x1p32);
+    const auto step = std::llround(static_cast<double>(rate) * 0x1p32);
+    for (auto j = 0U; j < out.size(); ++j, pos += step)
+    {
+      const auto idx = static_cast<size_t>(pos >> FracBits);
+      const auto frac = static_cast<uint32_t>(pos);
+      const auto row = static_cast<int>(frac >> WeightBits);
+      const auto w = static_cast<float>(frac & ((1U << WeightBits) - 1)) / (1U << WeightBits);
+      const auto row0 = table + row * taps;
+      // all taps inside the file before the end of the grain read the samples in place
+      const auto src = g.start + idx >= before && idx + after < g.size ? g.wav.data() + g.start + idx - before
+                                                                       : nullptr;
+      if (!src)
+      {
+        const auto firstTap = static_cast<ptrdiff_t>(idx) - static_cast<ptrdiff_t>(before);
+        for (auto k = 0; k < taps; ++k)
+          window[static_cast<size_t>(k)] = at(firstTap + k);
+      }
+      out[j] = dot(row0, row0 + taps, w, src ? src : window.data(), taps);
+    }
+  }
+} // namespace
+
+Resampler::Resampler(Quality quality)
+  : taps(quality == Quality::Fast ? FastTaps : HighTaps),
+    tables(quality == Quality::Fast ? FastTable.data() : HighTable.data()),
+    tableCount(quality == Quality::Fast ? 1 : HighTables)
+{
+}
+
+auto Resampler::table(float rate) const -> const float *
+{
+  // the first table whose cutoff is below the Nyquist frequency of the output
+  const auto steps = rate <= 1.f ? 0 : static_cast<int>(std::ceil(std::log2(rate) * CutoffSteps));
+  return tables + std::min(steps, tableCount - 1) * (Phases + 1) * taps;
+}
+
+auto Resampler::resample(const Grain &g, float rate, float bias, size_t first, std::span<float> out) const
+  -> void
+{
+  const auto t = table(rate);
+#if defined(RESAMPLER_AVX2)
+  if (cpuHasAvx2() && taps % 8 == 0)
+  {
+    run(g, t, taps, rate, bias, first, out, dotAvx2);
+    return;
+  }
+#endif
+  run(g, t, taps, rate, bias, first, out, dotScalar);
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <cstddef>
+#include <span>
+
+// Reads a grain at fractional positions with a polyphase FIR: the kernel is tabulated for Phases
+// fractions once, a sample interpolates between the two nearest rows.
+class Resampler
+{
+public:
+  enum class Quality
+  {
+    // 4 tap cubic, cheap enough for the audio callback
+    Fast,
+    // 32 tap windowed sinc whose cutoff follows the rate, so a pitch up does not alias
+    High
+  };
+
+  // a grain and its surroundings: before it the samples are the ones before it in the file, after it the
+  // ones of the grain which plays next; next is wav.size() if there is none
+  struct Grain
+  {
+    std::span<const float> wav;
+    size_t start;
+    size_t size;
+    size_t next;
+  };
+
+  explicit Resampler(Quality);
+  // out[j] is the grain at the position (first + j) * rate + bias
+  auto resample(const Grain &, float rate, float bias, size_t first, std::span<float> out) const -> void;
+
+  static const auto Phases = 256;
+
+private:
+  int taps;
+  // rows of taps coefficients, Phases + 1 of them per table; a table per cutoff for the high quality
+  const float *tables;
+  int tableCount;
+
+  auto table(float rate) const -> const float *;
+};
@@ -0,0 +1,58 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <memory>
+#include <span>
+
+// Single producer, single consumer ring buffer. The storage is allocated once in the constructor,
+// neither side allocates, locks or moves elements afterwards.
+template <typename T>
+class RingBuffer
+{
+public:
+  explicit RingBuffer(size_t minCapacity)
+    : capacity(std::bit_ceil(minCapacity)), mask(capacity - 1), buf(std::make_unique<T[]>(capacity))
+  {
+  }
+
+  // number of elements available to the consumer
+  auto size() const -> size_t { return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire); }
+
+  // producer side: up to two contiguous free regions, publish what was written with commit()
+  auto writable() -> std::array<std::span<T>, 2>
+  {
+    const auto h = head.load(std::memory_order_relaxed);
+    const auto free = capacity - (h - tail.load(std::memory_order_acquire));
+    const auto start = h & mask;
+    const auto first = std::min(free, capacity - start);
+    return {std::span<T>{buf.get() + start, first}, std::span<T>{buf.get(), free - first}};
+  }
+
+  auto commit(size_t n) -> void { head.store(head.load(std::memory_order_relaxed) + n, std::memory_order_release); }
+
+  // consumer side
+  auto read(T *dst, size_t n) -> size_t
+  {
+    const auto t = tail.load(std::memory_order_relaxed);
+    n = std::min(n, head.load(std::memory_order_acquire) - t);
+    const auto start = t & mask;
+    const auto first = std::min(n, capacity - start);
+    std::copy(buf.get() + start, buf.get() + start + first, dst);
+    std::copy(buf.get(), buf.get() + (n - first), dst + first);
+    tail.store(t + n, std::memory_order_release);
+    return n;
+  }
+
+  // consumer side, drops everything which was produced so far
+  auto clear() -> void { tail.store(head.load(std::memory_order_acquire), std::memory_order_release); }
+
+private:
+  size_t capacity;
+  size_t mask;
+  std::unique_ptr<T[]> buf;
+  // both indices only grow, the difference is the number of stored elements
+  std::atomic<size_t> head = 0;
+  std::atomic<size_t> tail = 0;
+};
@@ -0,0 +1,600 @@
+#include "sample-codec.hpp"
+#include "parallel-for.hpp"
+#include "profiler.hpp"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <log/log.hpp>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace
+{
+  const auto BlockSize = static_cast<uint32_t>(BlockCache::BlockSize);
+  // blocks the first pass decompresses ahead of what its reader released
+  const auto LookAhead = size_t{64};
+  const auto PartitionSize = 4096;
+  // unary quotients from this length on are followed by the value itself
+  const auto Escape = 24U;
+  const auto EscapeBits = 20;
+  const auto WarmUpBits = 16;
+  const auto RiceParamBits = 5;
+
+  enum class Mode : uint8_t
+  {
+    Raw = 0,
+    Pcm16 = 1
+  };
+
+  struct ChunkHeader
+  {
+    uint64_t sampleCount;
+    uint32_t blockSize;
+    uint32_t blockCount;
+  };
+
+  struct BlockHeader
+  {
+    Mode mode;
+    uint8_t order;
+    uint16_t reserved;
+  };
+
+  class BitWriter
+  {
+  public:
+    explicit BitWriter(std::vector<char> &out) : out(out) {}
+    // bits <= 32
+    auto put(uint32_t v, int bits) -> void
+    {
+      acc = (acc << bits) | v;
+      n += bits;
+      while (n >= 8)
+      {
+        n -= 8;
+        out.push_back(static_cast<char>(acc >> n));
+      }
+    }
+    auto flush() -> void
+    {
+      if (n > 0)
+        put(0, 8 - n);
+    }
+
+  private:
+    std::vector<char> &out;
+    uint64_t acc = 0;
+    int n = 0;
+  };
+
+  class BitReader
+  {
+  public:
+    BitReader(const char *data, size_t size) : ptr(data), end(data + size) {}
+    // bits <= 32
+    auto get(int bits) -> uint32_t
+    {
+      if (bits == 0)
+        return 0;
+      refill();
+      const auto ret = static_cast<uint32_t>(cache >> (64 - bits));
+      consume(bits);
+      return ret;
+    }
+    // a run of ones terminated by a zero, at most Escape ones without the terminator
+    auto unary() -> uint32_t
+    {
+      auto ret = 0U;
+      for (;;)
+      {
+        refill();
+        if (count == 0)
+          return ret;
+        const auto ones = std::min({static_cast<uint32_t>(std::countl_one(cache)),
+                                    static_cast<uint32_t>(count),
+                                    Escape - ret});
+        ret += ones;
+        consume(static_cast<int>(ones));
+        if (ret == Escape)
+          return ret;
+        if (ones < static_cast<uint32_t>(count))
+        {
+          consume(1);
+          return ret;
+        }
+      }
+    }
+    auto isOk() const -> bool { return count >= 0; }
+
+  private:
+    const char *ptr;
+    const char *end;
+    uint64_t cache = 0;
+    int count = 0;
+
+    auto refill() -> void
+    {
+      while (count <= 56 && ptr < end)
+      {
+        cache |= static_cast<uint64_t>(static_cast<uint8_t>(*ptr++)) << (56 - count);
+        count += 8;
+      }
+    }
+    auto consume(int bits) -> void
+    {
+      cache = bits < 64 ? cache << bits : 0;
+      count -= bits;
+    }
+  };
+
+  auto zigzag(int32_t v) -> uint32_t
+  {
+    return (static_cast<uint32_t>(v) << 1) ^ static_cast<uint32_t>(v >> 31);
+  }
+
+  auto unzigzag(uint32_t v) -> int32_t
+  {
+    return static_cast<int32_t>(v >> 1) ^ -static_cast<int32_t>(v & 1);
+  }
+
+  auto toFloat(int32_t q) -> float
+  {
+    return static_cast<float>(q) * (1.f / 32768.f);
+  }
+
+  // prediction residual of the fixed polynomial predictor of the order
+  auto residual(const int32_t *q, size_t i, int order) -> int32_t
+  {
+    switch (order)
+    {
+    case 0: return q[i];
+    case 1: return q[i] - q[i - 1];
+    default: return q[i] - 2 * q[i - 1] + q[i - 2];
+    }
+  }
+
+  auto riceParam(const uint32_t *u, size_t n) -> int
+  {
+    auto sum = uint64_t{0};
+    for (auto i = 0U; i < n; ++i)
+      sum += u[i];
+    auto k = 0;
+    while (k < 30 && (uint64_t{n} << (k + 1)) <= sum)
+      ++k;
+    return k;
+  }
+
+  auto encodeBlock(const float *x, size_t n, std::vector<char> &out) -> void
+  {
+    const auto rawBlock = [&]() {
+      const auto header = BlockHeader{Mode::Raw, 0, 0};
+      out.insert(std::end(out),
+                 reinterpret_cast<const char *>(&header),
+                 reinterpret_cast<const char *>(&header) + sizeof(header));
+      out.insert(std::end(out), reinterpret_cast<const char *>(x), reinterpret_cast<const char *>(x + n));
+    };
+
+    // only bit exact 16-bit PCM goes through the predictor
+    auto q = std::vector<int32_t>(n);
+    for (auto i = 0U; i < n; ++i)
+    {
+      const auto v = std::lrint(x[i] * 32768.f);
+      const auto back = toFloat(static_cast<int32_t>(v));
+      if (v < -32768 || v > 32767 || memcmp(&back, x + i, sizeof(float)) != 0)
+        return rawBlock();
+      q[i] = static_cast<int32_t>(v);
+    }
+
+    auto order = 0;
+    {
+      auto best = std::numeric_limits<int64_t>::max();
+      for (auto o = 0; o <= 2; ++o)
+      {
+        auto sum = int64_t{0};
+        for (auto i = static_cast<size_t>(o); i < n; ++i)
+          sum += std::abs(residual(q.data(), i, o));
+        if (sum < best)
+        {
+          best = sum;
+          order = o;
+        }
+      }
+    }
+    order = std::min(order, static_cast<int>(n));
+
+    const auto start = out.size();
+    const auto header = BlockHeader{Mode::Pcm16, static_cast<uint8_t>(order), 0};
+    out.insert(std::end(out),
+               reinterpret_cast<const char *>(&header),
+               reinterpret_cast<const char *>(&header) + sizeof(header));
+    auto u = std::vector<uint32_t>(n);
+    for (auto i = static_cast<size_t>(order); i < n; ++i)
+      u[i] = zigzag(residual(q.data(), i, order));
+    {
+      auto writer = BitWriter{out};
+      for (auto i = 0; i < order; ++i)
+        writer.put(static_cast<uint16_t>(q[i]), WarmUpBits);
+      for (auto p = static_cast<size_t>(order); p < n; p += PartitionSize)
+      {
+        const auto cnt = std::min<size_t>(PartitionSize, n - p);
+        const auto k = riceParam(u.data() + p, cnt);
+        writer.put(static_cast<uint32_t>(k), RiceParamBits);
+        for (auto i = p; i < p + cnt; ++i)
+        {
+          const auto quotient = u[i] >> k;
+          if (quotient >= Escape)
+          {
+            writer.put((1U << Escape) - 1, Escape);
+            writer.put(u[i], EscapeBits);
+            continue;
+          }
+          // quotient ones and a zero
+          writer.put(((1U << quotient) - 1) << 1, static_cast<int>(quotient) + 1);
+          if (k > 0)
+            writer.put(u[i] & ((1U << k) - 1), k);
+        }
+      }
+      writer.flush();
+    }
+    if (out.size() - start >= sizeof(BlockHeader) + n * sizeof(float))
+    {
+      out.resize(start);
+      rawBlock();
+    }
+  }
+
+  auto decodeBlock(const char *data, size_t size, float *dst, size_t n) -> bool
+  {
+    if (size < sizeof(BlockHeader))
+      return false;
+    BlockHeader header;
+    memcpy(&header, data, sizeof(header));
+    data += sizeof(header);
+    size -= sizeof(header);
+    if (header.mode == Mode::Raw)
+    {
+      if (size != n * sizeof(float))
+        return false;
+      memcpy(dst, data, size);
+      return true;
+    }
+    if (header.mode != Mode::Pcm16 || header.order > 2)
+      return false;
+
+    const auto order = static_cast<size_t>(std::min<size_t>(header.order, n));
+    auto reader = BitReader{data, size};
+    auto q = std::array<int32_t, 2>{};
+    for (auto i = 0U; i < order; ++i)
+    {
+      q[i] = static_cast<int16_t>(reader.get(WarmUpBits));
+      dst[i] = toFloat(q[i]);
+    }
+    // q holds the previous two samples, q[1] the last one
+    if (order == 1)
+      q = {0, q[0]};
+    for (auto p = order; p < n; p += PartitionSize)
+    {
+      const auto cnt = std::min<size_t>(PartitionSize, n - p);
+      const auto k = static_cast<int>(reader.get(RiceParamBits));
+      for (auto i = p; i < p + cnt; ++i)
+      {
+        const auto quotient = reader.unary();
+        const auto u = quotient == Escape ? reader.get(EscapeBits) : (quotient << k) | reader.get(k);
+        const auto e = unzigzag(u);
+        const auto v = header.order == 0 ? e : header.order == 1 ? q[1] + e : 2 * q[1] - q[0] + e;
+        q = {q[1], v};
+        dst[i] = toFloat(v);
+      }
+    }
+    return reader.isOk();
+  }
+
+  auto workerCount() -> int
+  {
+    return std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+  }
+} // namespace
+
+auto compressSamples(std::span<const float> samples) -> std::vector<char>
+{
+  const auto blockCount = static_cast<uint32_t>((samples.size() + BlockSize - 1) / BlockSize);
+  auto blocks = std::vector<std::vector<char>>(blockCount);
+  {
+    auto next = std::atomic<uint32_t>{0};
+    auto threads = std::vector<std::thread>{};
+    for (auto i = 0; i < workerCount(); ++i)
+      threads.emplace_back([&]() {
+        for (auto b = next++; b < blockCount; b = next++)
+        {
+          const auto first = size_t{b} * BlockSize;
+          encodeBlock(samples.data() + first, std::min<size_t>(BlockSize, samples.size() - first), blocks[b]);
+        }
+      });
+    for (auto &thread : threads)
+      thread.join();
+  }
+
+  auto ret = std::vector<char>(sizeof(ChunkHeader) + (blockCount + 1) * sizeof(uint64_t));
+  const auto header = ChunkHeader{samples.size(), BlockSize, blockCount};
+  memcpy(ret.data(), &header, sizeof(header));
+  auto offset = static_cast<uint64_t>(ret.size());
+  for (auto b = 0U; b <= blockCount; ++b)
+  {
+    memcpy(ret.data() + sizeof(ChunkHeader) + b * sizeof(uint64_t), &offset, sizeof(offset));
+    if (b < blockCount)
+      offset += blocks[b].size();
+  }
+  ret.reserve(offset);
+  for (const auto &block : blocks)
+    ret.insert(std::end(ret), std::begin(block), std::end(block));
+  LOG("compressed samples", samples.size() * sizeof(float), "->", ret.size());
+  return ret;
+}
+
+auto compressedSampleCount(std::span<const char> chunk) -> size_t
+{
+  if (chunk.size() < sizeof(ChunkHeader))
+    return 0;
+  ChunkHeader header;
+  memcpy(&header, chunk.data(), sizeof(header));
+  if (header.blockSize != BlockSize ||
+      header.blockCount != (header.sampleCount + BlockSize - 1) / BlockSize ||
+      sizeof(ChunkHeader) + (header.blockCount + uint64_t{1}) * sizeof(uint64_t) > chunk.size())
+    return 0;
+  return header.sampleCount;
+}
+
+BlockCache::Pin::~Pin()
+{
+  release();
+}
+
+BlockCache::Pin::Pin(Pin &&other) noexcept : cache(other.cache), first(other.first), last(other.last)
+{
+  other.cache = nullptr;
+}
+
+auto BlockCache::Pin::operator=(Pin &&other) noexcept -> Pin &
+{
+  if (this == &other)
+    return *this;
+  release();
+  cache = other.cache;
+  first = other.first;
+  last = other.last;
+  other.cache = nullptr;
+  return *this;
+}
+
+auto BlockCache::Pin::release() -> void
+{
+  if (cache)
+    cache->unpin(first, last);
+  cache = nullptr;
+}
+
+BlockCache::BlockCache(std::shared_ptr<const void> aOwner, std::span<const char> chunk, size_t aBudget)
+  : owner(std::move(aOwner)),
+    compressed(chunk),
+    sampleCount(compressedSampleCount(chunk)),
+    blockCount((sampleCount + BlockSize - 1) / BlockSize),
+    budget(aBudget),
+    blocks(std::make_unique<Block[]>(blockCount))
+{
+  if (sampleCount == 0)
+    return;
+  // the pages are committed only when a block is written into them
+  mapSize = sampleCount * sizeof(float);
+  const auto map =
+    mmap(nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (map == MAP_FAILED)
+  {
+    LOG("cannot map", mapSize, "bytes for the samples");
+    sampleCount = 0;
+    blockCount = 0;
+    mapSize = 0;
+    return;
+  }
+  buffer = static_cast<float *>(map);
+}
+
+BlockCache::~BlockCache()
+{
+  if (buffer)
+    munmap(buffer, mapSize);
+}
+
+auto BlockCache::pin(size_t first, size_t last) -> Pin
+{
+  const auto firstBlock = std::min(first / BlockSize, blockCount);
+  const auto lastBlock = std::min((last + BlockSize - 1) / BlockSize, blockCount);
+  if (firstBlock >= lastBlock)
+    return {};
+  auto claimed = std::vector<size_t>{};
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto b = firstBlock; b < lastBlock; ++b)
+    {
+      auto &block = blocks[b];
+      if (block.pins++ == 0 && block.isAged)
+      {
+        age.erase(block.age);
+        block.isAged = false;
+      }
+      if (block.state.load(std::memory_order_relaxed) != Empty)
+        continue;
+      block.state.store(Decoding, std::memory_order_relaxed);
+      ++resident;
+      claimed.push_back(b);
+    }
+  }
+  parallelFor(claimed.size(), 1, [&](size_t begin, size_t end) {
+    for (auto i = begin; i < end; ++i)
+      decode(claimed[i]);
+  });
+
+  std::unique_lock<std::mutex> lock(mutex);
+  for (const auto b : claimed)
+    blocks[b].state.store(Ready, std::memory_order_release);
+  if (!claimed.empty())
+    decodedCv.notify_all();
+  decodedCv.wait(lock, [&]() {
+    for (auto b = firstBlock; b < lastBlock; ++b)
+      if ((blocks[b].state.load(std::memory_order_relaxed) & StateMask) != Ready)
+        return false;
+    return true;
+  });
+  evict();
+  return Pin{this, firstBlock, lastBlock};
+}
+
+auto BlockCache::tryRead(size_t first, size_t last) -> bool
+{
+  const auto firstBlock = std::min(first / BlockSize, blockCount);
+  const auto lastBlock = std::min((last + BlockSize - 1) / BlockSize, blockCount);
+  for (auto b = firstBlock; b < lastBlock; ++b)
+  {
+    auto &state = blocks[b].state;
+    auto old = state.load(std::memory_order_relaxed);
+    do
+    {
+      if ((old & StateMask) != Ready)
+      {
+        endRead(first, b * BlockSize);
+        return false;
+      }
+    } while (!state.compare_exchange_weak(old, old + Reader, std::memory_order_acquire));
+  }
+  return true;
+}
+
+auto BlockCache::endRead(size_t first, size_t last) -> void
+{
+  const auto firstBlock = std::min(first / BlockSize, blockCount);
+  const auto lastBlock = std::min((last + BlockSize - 1) / BlockSize, blockCount);
+  for (auto b = firstBlock; b < lastBlock; ++b)
+    blocks[b].state.fetch_sub(Reader, std::memory_order_release);
+}
+
+auto BlockCache::decode(size_t b) -> void
+{
+  const auto offsets = compressed.data() + sizeof(ChunkHeader);
+  auto range = std::array<uint64_t, 2>{};
+  memcpy(range.data(), offsets + b * sizeof(uint64_t), sizeof(range));
+  const auto first = b * BlockSize;
+  const auto n = std::min<size_t>(BlockSize, sampleCount - first);
+  if (range[0] > range[1] || range[1] > compressed.size() ||
+      !decodeBlock(compressed.data() + range[0], range[1] - range[0], buffer + first, n))
+  {
+    // a broken block stays silent
+    LOG("corrupted sample block", b);
+    std::fill_n(buffer + first, n, 0.f);
+  }
+}
+
+auto BlockCache::unpin(size_t first, size_t last) -> void
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  for (auto b = first; b < last; ++b)
+  {
+    auto &block = blocks[b];
+    if (--block.pins > 0)
+      continue;
+    // pins wait for their blocks, an unpinned block is Ready
+    block.age = age.insert(std::begin(age), b);
+    block.isAged = true;
+  }
+  evict();
+}
+
+auto BlockCache::evict() -> void
+{
+  static auto &residentGauge = profiler().gauge("samples/resident blocks");
+  static const auto pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  // everything not in the age list is pinned, the budget is exceeded until the pins go away
+  for (auto it = std::end(age); resident > budget && it != std::begin(age);)
+  {
+    const auto oldest = *--it;
+    auto &block = blocks[oldest];
+    auto expected = Ready;
+    // a block the audio callback reads stays, a later call evicts it
+    if (!block.state.compare_exchange_strong(expected, Empty, std::memory_order_acquire))
+      continue;
+    it = age.erase(it);
+    block.isAged = false;
+    --resident;
+    // blocks start at page boundaries, the last one ends in the last page of the mapping
+    const auto offset = oldest * BlockSize * sizeof(float);
+    const auto bytes = std::min(BlockSize * sizeof(float), mapSize - offset);
+    const auto pages = (bytes + pageSize - 1) / pageSize;
+    madvise(reinterpret_cast<char *>(buffer) + offset, pages * pageSize, MADV_DONTNEED);
+  }
+  residentGauge.set(static_cast<int64_t>(resident));
+}
+
+Decompressor::Decompressor(BlockCache &aCache)
+  : cache(aCache),
+    sampleCount(aCache.size()),
+    blockCount((sampleCount + BlockSize - 1) / BlockSize),
+    isBlockDone(std::make_unique<std::atomic<bool>[]>(blockCount)),
+    pins(blockCount)
+{
+  for (auto i = 0; i < workerCount(); ++i)
+    threads.emplace_back(&Decompressor::run, this);
+}
+
+Decompressor::~Decompressor()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    isStopping = true;
+  }
+  releasedCv.notify_all();
+  for (auto &thread : threads)
+    thread.join();
+}
+
+auto Decompressor::run() -> void
+{
+  for (auto b = nextBlock++; b < blockCount; b = nextBlock++)
+  {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      releasedCv.wait(lock, [&]() { return isStopping || b < released + LookAhead; });
+      if (isStopping)
+        return;
+    }
+    pins[b] = cache.pin(b * BlockSize, (b + 1) * BlockSize);
+    isBlockDone[b].store(true, std::memory_order_release);
+  }
+}
+
+auto Decompressor::available() const -> size_t
+{
+  auto p = prefix.load();
+  while (p < blockCount && isBlockDone[p].load(std::memory_order_acquire))
+    ++p;
+  prefix = p;
+  return std::min(sampleCount, p * BlockSize);
+}
+
+auto Decompressor::isDone() const -> bool
+{
+  return available() == sampleCount;
+}
+
+auto Decompressor::release(size_t samples) -> void
+{
+  // only done blocks, their pins are written
+  const auto last = std::min(samples, available()) / BlockSize;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (; released < last; ++released)
+      pins[released] = {};
+  }
+  releasedCv.notify_all();
+}
@@ -0,0 +1,143 @@
+#pragma once
+#include "sample-loader.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+
+// Lossless block compression of the project samples. Blocks which are exactly 16-bit PCM are stored as
+// fixed linear prediction residuals in Rice codes, anything else as raw floats. Every block is
+// independent and the chunk starts with an index of the block offsets.
+auto compressSamples(std::span<const float>) -> std::vector<char>;
+// number of samples in a compressed chunk, 0 if the chunk is malformed
+auto compressedSampleCount(std::span<const char>) -> size_t;
+
+// Random access to a compressed chunk. The samples have their place in one buffer of the full length, but
+// only the pinned blocks and the budget of most recently used ones are decompressed; the pages of the
+// others go back to the system and read as zeros.
+class BlockCache
+{
+public:
+  // keeps the blocks of a sample range decompressed while it is alive
+  class Pin
+  {
+  public:
+    Pin() = default;
+    ~Pin();
+    // disable copy
+    Pin(const Pin &) = delete;
+    Pin &operator=(const Pin &) = delete;
+    // moving
+    Pin(Pin &&other) noexcept;
+    Pin &operator=(Pin &&other) noexcept;
+
+  private:
+    friend class BlockCache;
+    Pin(BlockCache *cache, size_t first, size_t last) : cache(cache), first(first), last(last) {}
+    auto release() -> void;
+
+    BlockCache *cache = nullptr;
+    // blocks [first, last)
+    size_t first = 0;
+    size_t last = 0;
+  };
+
+  // the chunk has to stay valid until the cache is destroyed, owner keeps it alive; size() is 0 if the
+  // chunk is malformed
+  BlockCache(std::shared_ptr<const void> owner, std::span<const char> chunk, size_t budget);
+  ~BlockCache();
+  // disable copy
+  BlockCache(const BlockCache &) = delete;
+  BlockCache &operator=(const BlockCache &) = delete;
+
+  auto data() const -> float * { return buffer; }
+  auto size() const -> size_t { return sampleCount; }
+  auto chunk() const -> std::span<const char> { return compressed; }
+  // decompresses the blocks of the samples [first, last) which are not, on the calling thread and the
+  // thread pool; blocks another thread is decompressing are waited for
+  auto pin(size_t first, size_t last) -> Pin;
+  // checks that all samples of [first, last) are decompressed and keeps them from being evicted until
+  // endRead(), in one step; lock free for the audio callback, false if a block is not decompressed
+  auto tryRead(size_t first, size_t last) -> bool;
+  auto endRead(size_t first, size_t last) -> void;
+
+  // samples per block, every block is compressed on its own
+  static constexpr auto BlockSize = size_t{1} << 16;
+
+private:
+  // the state of a block in the low bits, plus one Reader for every tryRead() of a Ready block; a block
+  // is evicted only by exchanging a plain Ready for Empty, so never while it is read
+  static constexpr auto Empty = uint32_t{0};
+  static constexpr auto Decoding = uint32_t{1};
+  static constexpr auto Ready = uint32_t{2};
+  static constexpr auto StateMask = uint32_t{3};
+  static constexpr auto Reader = uint32_t{4};
+  // the unpinned Ready blocks, the least recently used at the back
+  using Age = std::list<size_t>;
+  struct Block
+  {
+    std::atomic<uint32_t> state = Empty;
+    int pins = 0;
+    // valid while the block is in the age list
+    Age::iterator age;
+    bool isAged = false;
+  };
+
+  std::shared_ptr<const void> owner;
+  std::span<const char> compressed;
+  size_t sampleCount;
+  size_t blockCount;
+  size_t budget;
+  size_t mapSize = 0;
+  float *buffer = nullptr;
+  std::unique_ptr<Block[]> blocks;
+  std::mutex mutex;
+  std::condition_variable decodedCv;
+  Age age;
+  // blocks which are not Empty
+  size_t resident = 0;
+
+  auto decode(size_t block) -> void;
+  auto unpin(size_t first, size_t last) -> void;
+  // drops the least recently used unpinned blocks over the budget, under the lock
+  auto evict() -> void;
+};
+
+// the first pass over a compressed chunk, on all cores in file order for the waveform levels and the
+// grains which need every sample; it runs at most a limited number of blocks ahead of release()
+class Decompressor final : public SampleLoader
+{
+public:
+  explicit Decompressor(BlockCache &);
+  ~Decompressor() override;
+  Decompressor(const Decompressor &) = delete;
+  Decompressor &operator=(const Decompressor &) = delete;
+
+  auto available() const -> size_t override;
+  auto isDone() const -> bool override;
+  auto release(size_t samples) -> void override;
+
+private:
+  BlockCache &cache;
+  size_t sampleCount;
+  size_t blockCount;
+  std::atomic<size_t> nextBlock = 0;
+  std::atomic<bool> isStopping = false;
+  std::unique_ptr<std::atomic<bool>[]> isBlockDone;
+  // written by the worker of the block before its isBlockDone, released by release()
+  std::vector<BlockCache::Pin> pins;
+  // blocks before it are done, only advanced by available()
+  mutable std::atomic<size_t> prefix = 0;
+  std::mutex mutex;
+  std::condition_variable releasedCv;
+  // blocks before it are released, under the mutex
+  size_t released = 0;
+  std::vector<std::thread> threads;
+
+  auto run() -> void;
+};
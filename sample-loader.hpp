@@ -0,0 +1,27 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+// Fills the samples of one or more tracks on background threads, a track per channel. The UI polls
+// available() and can use the samples before it while the rest is still loading.
+class SampleLoader
+{
+public:
+  virtual ~SampleLoader() = default;
+  // number of samples from the start of every buffer which are final
+  virtual auto available() const -> size_t = 0;
+  virtual auto isDone() const -> bool = 0;
+  // the samples before it are not read anymore, a loader which keeps only a part of the samples in memory
+  // can drop them
+  virtual auto release(size_t) -> void {}
+  // samples of the channel which did not fit into its buffer, only valid once isDone()
+  auto overflow(size_t channel = 0) -> std::vector<float> &
+  {
+    if (rest.size() <= channel)
+      rest.resize(channel + 1);
+    return rest[channel];
+  }
+
+protected:
+  std::vector<std::vector<float>> rest;
+};
@@ -0,0 +1,62 @@
+#include "samples.hpp"
+#include <algorithm>
+
+auto Samples::allocate(size_t n) -> void
+{
+  assign(std::vector<float>(n));
+}
+
+auto Samples::assign(std::vector<float> &&v) -> void
+{
+  owned = std::move(v);
+  mapped = nullptr;
+  blockCache = nullptr;
+  ptr = owned.data();
+  count = owned.size();
+}
+
+auto Samples::map(std::shared_ptr<const ProjectFile> file, std::span<float> chunk) -> void
+{
+  owned = {};
+  mapped = std::move(file);
+  blockCache = nullptr;
+  ptr = chunk.data();
+  count = chunk.size();
+}
+
+auto Samples::attach(std::unique_ptr<BlockCache> cache) -> void
+{
+  owned = {};
+  mapped = nullptr;
+  blockCache = std::move(cache);
+  ptr = blockCache->data();
+  count = blockCache->size();
+}
+
+auto Samples::pin(size_t first, size_t last) const -> BlockCache::Pin
+{
+  if (!blockCache)
+    return {};
+  return blockCache->pin(first, last);
+}
+
+auto Samples::truncate(size_t n) -> void
+{
+  count = std::min(count, n);
+  if (!mapped && !blockCache)
+    owned.resize(count);
+}
+
+auto Samples::append(const std::vector<float> &v) -> void
+{
+  if (mapped || blockCache)
+  {
+    const auto all = pin(0, count);
+    owned.assign(ptr, ptr + count);
+  }
+  mapped = nullptr;
+  blockCache = nullptr;
+  owned.insert(std::end(owned), std::begin(v), std::end(v));
+  ptr = owned.data();
+  count = owned.size();
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include "project-file.hpp"
+#include "sample-codec.hpp"
+#include <memory>
+#include <span>
+#include <vector>
+
+// The project samples, owned after an import, used in place from the mapped project file or decompressed
+// in blocks on demand from a compressed one. The data never moves except in append(), everything else
+// keeps views into it.
+class Samples
+{
+public:
+  auto data() const -> float * { return ptr; }
+  auto size() const -> size_t { return count; }
+  auto empty() const -> bool { return count == 0; }
+  auto operator[](size_t i) const -> float { return ptr[i]; }
+  auto span() const -> std::span<float> { return {ptr, count}; }
+
+  // n zero samples in an owned buffer
+  auto allocate(size_t n) -> void;
+  auto assign(std::vector<float> &&) -> void;
+  // the chunk has to point into the file, the tracks of a project share it
+  auto map(std::shared_ptr<const ProjectFile>, std::span<float> chunk) -> void;
+  // only the pinned and the recently used blocks of the samples hold data, the others read as zeros
+  auto attach(std::unique_ptr<BlockCache>) -> void;
+  // drops the samples after n without moving the rest
+  auto truncate(size_t n) -> void;
+  // moves the data, only for owned samples
+  auto append(const std::vector<float> &) -> void;
+  // the file the samples are mapped from, nullptr if they are owned
+  auto file() const -> const ProjectFile * { return mapped.get(); }
+  // nullptr unless the samples are decompressed on demand
+  auto blocks() const -> BlockCache * { return blockCache.get(); }
+  // keeps the samples [first, last) readable, an empty pin unless they are decompressed on demand
+  auto pin(size_t first, size_t last) const -> BlockCache::Pin;
+
+private:
+  std::vector<float> owned;
+  std::shared_ptr<const ProjectFile> mapped;
+  std::unique_ptr<BlockCache> blockCache;
+  float *ptr = nullptr;
+  size_t count = 0;
+};
@@ -1,6 +1,10 @@
 #include "save-wav.hpp"
-#include <fstream>
-#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <log/log.hpp>
 
 namespace little_endian_io
 {
@@ -11,38 +15,146 @@ namespace little_endian_io
       outs.put(static_cast<char>(value & 0xFF));
     return outs;
   }
+
+  template <typename Word>
+  auto storeWord(char *dst, Word value, unsigned size) -> void
+  {
+    for (; size; --size, value >>= 8)
+      *dst++ = static_cast<char>(value & 0xFF);
+  }
 } // namespace little_endian_io
 using namespace little_endian_io;
 
-auto saveWav(const std::string &fileName, const std::vector<int16_t> &pcm, int sampleRate) -> void
+// a multiple of the page size and of every sample size, each write() to the stream is one large block
+static const auto BufferSize = size_t{3} << 18;
+// the JUNK chunk reserves room for the ds64 chunk which replaces it if the file becomes RF64
+static const auto Ds64Size = 28U;
+
+WavWriter::WavWriter(const std::string &fileName, int sampleRate, Format aFormat, uint64_t aMaxRiffSize)
+  : f(fileName, std::ios::binary), format(aFormat), maxRiffSize(aMaxRiffSize), buf(BufferSize)
 {
-  std::ofstream f(fileName, std::ios::binary);
+  if (!f)
+  {
+    LOG("cannot open", fileName);
+    return;
+  }
 
+  const auto bits = bytesPerSample() * 8;
   // Write the file headers
-  f << "RIFF----WAVEfmt ";                    // (chunk size to be filled in later)
-  writeWord(f, 16, 4);                        // no extension data
-  writeWord(f, 1, 2);                         // PCM - integer samples
-  writeWord(f, 1, 2);                         // one channel (mono file)
-  writeWord(f, sampleRate, 4);                // samples per second (Hz)
-  writeWord(f, (sampleRate * 16 * 1) / 8, 4); // (Sample Rate * BitsPerSample * Channels) / 8
-  writeWord(f, 2, 2);                         // data block size (size of two integer samples, one for each channel, in bytes)
-  writeWord(f, 16, 2);                        // number of bits per sample (use a multiple of 8)
+  f << "RIFF----WAVE"; // (chunk size to be filled in later)
+  f << "JUNK";
+  writeWord(f, Ds64Size, 4);
+  for (auto i = 0U; i < Ds64Size; ++i)
+    f.put(0);
+  f << "fmt ";
+  writeWord(f, 16, 4);                                // no extension data
+  writeWord(f, format == Format::Float32 ? 3 : 1, 2); // PCM - integer samples or IEEE float
+  writeWord(f, 1, 2);                                 // one channel (mono file)
+  writeWord(f, sampleRate, 4);                        // samples per second (Hz)
+  writeWord(f, sampleRate * bytesPerSample(), 4);     // (Sample Rate * BitsPerSample * Channels) / 8
+  writeWord(f, bytesPerSample(), 2);                  // data block size (one sample, in bytes)
+  writeWord(f, bits, 2);                              // number of bits per sample (use a multiple of 8)
 
   // Write the data chunk header
-  size_t dataChunkPos = f.tellp();
+  dataChunkPos = static_cast<std::streamoff>(f.tellp());
   f << "data----"; // (chunk size to be filled in later)
+}
+
+WavWriter::~WavWriter()
+{
+  if (f.is_open())
+    close();
+}
 
-  for (auto a : pcm)
-    writeWord(f, a, 2);
+auto WavWriter::bytesPerSample() const -> int
+{
+  switch (format)
+  {
+  case Format::Pcm16: return 2;
+  case Format::Pcm24: return 3;
+  case Format::Float32: return 4;
+  }
+  return 2;
+}
 
+auto WavWriter::write(std::span<const float> pcm) -> void
+{
+  const auto bytes = static_cast<size_t>(bytesPerSample());
+  while (!pcm.empty())
+  {
+    const auto n = std::min(pcm.size(), (buf.size() - used) / bytes);
+    auto dst = buf.data() + used;
+    switch (format)
+    {
+    case Format::Pcm16:
+      for (auto i = 0U; i < n; ++i, dst += 2)
+        storeWord(dst, static_cast<int16_t>(std::clamp(pcm[i], -1.f, 1.f) * 32767.), 2);
+      break;
+    case Format::Pcm24:
+      for (auto i = 0U; i < n; ++i, dst += 3)
+        storeWord(dst, static_cast<int32_t>(std::lrint(std::clamp(pcm[i], -1.f, 1.f) * 8388607.)), 3);
+      break;
+    case Format::Float32:
+      static_assert(std::numeric_limits<float>::is_iec559);
+      memcpy(dst, pcm.data(), n * sizeof(float));
+      break;
+    }
+    used += n * bytes;
+    pcm = pcm.subspan(n);
+    if (buf.size() - used < bytes)
+      flush();
+  }
+}
+
+auto WavWriter::flush() -> void
+{
+  f.write(buf.data(), static_cast<std::streamsize>(used));
+  used = 0;
+}
+
+auto WavWriter::close() -> bool
+{
+  flush();
   // (We'll need the final file size to fix the chunk sizes above)
-  size_t fileLength = f.tellp();
+  const auto dataSize = static_cast<std::streamoff>(f.tellp()) - dataChunkPos - 8;
+  // chunks have an even size
+  if (dataSize % 2 != 0)
+    f.put(0);
+  const auto fileLength = static_cast<std::streamoff>(f.tellp());
+  const auto riffSize = static_cast<uint64_t>(fileLength - 8);
+  const auto isRf64 = riffSize > maxRiffSize;
 
-  // Fix the data chunk header to contain the data size
-  f.seekp(dataChunkPos + 4);
-  writeWord(f, fileLength - dataChunkPos + 8);
+  if (isRf64)
+  {
+    // the 32 bit sizes are all ones, the real ones are in the ds64 chunk
+    f.seekp(0);
+    f << "RF64";
+    writeWord(f, 0xFFFFFFFFU, 4);
+    f.seekp(12);
+    f << "ds64";
+    writeWord(f, Ds64Size, 4);
+    writeWord(f, riffSize, 8);
+    writeWord(f, static_cast<uint64_t>(dataSize), 8);
+    writeWord(f, static_cast<uint64_t>(dataSize / bytesPerSample()), 8); // sample count
+    writeWord(f, 0, 4);                                                   // no table entries
+    f.seekp(dataChunkPos + 4);
+    writeWord(f, 0xFFFFFFFFU, 4);
+  }
+  else
+  {
+    // Fix the data chunk header to contain the data size
+    f.seekp(dataChunkPos + 4);
+    writeWord(f, dataSize, 4);
 
-  // Fix the file header to contain the proper RIFF chunk size, which is (file size - 8) bytes
-  f.seekp(0 + 4);
-  writeWord(f, fileLength - 8, 4);
+    // Fix the file header to contain the proper RIFF chunk size, which is (file size - 8) bytes
+    f.seekp(0 + 4);
+    writeWord(f, riffSize, 4);
+  }
+  f.close();
+  if (!f)
+  {
+    LOG("error writing the wav file");
+    return false;
+  }
+  return true;
 }
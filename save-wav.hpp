@@ -1,5 +1,41 @@
 #pragma once
-#include <vector>
+#include <cstdint>
+#include <fstream>
+#include <limits>
+#include <span>
 #include <string>
+#include <vector>
+
+// Streams mono samples to a wav file block by block. The samples are converted into a large buffer which
+// is written at once, the sizes in the header are filled in by close(). Files over 4 GB become RF64.
+class WavWriter
+{
+public:
+  enum class Format { Pcm16, Pcm24, Float32 };
+
+  // a file whose RIFF size is over maxRiffSize becomes RF64, the tests lower it
+  WavWriter(const std::string &fileName,
+            int sampleRate,
+            Format = Format::Pcm16,
+            uint64_t maxRiffSize = std::numeric_limits<uint32_t>::max());
+  ~WavWriter();
+  // disable copy
+  WavWriter(const WavWriter &) = delete;
+  WavWriter &operator=(const WavWriter &) = delete;
+
+  auto isOk() const -> bool { return f.good(); }
+  auto write(std::span<const float>) -> void;
+  auto close() -> bool;
+
+private:
+  std::ofstream f;
+  Format format;
+  uint64_t maxRiffSize;
+  std::streamoff dataChunkPos = 0;
+  // bytes of converted samples in buf
+  size_t used = 0;
+  std::vector<char> buf;
 
-auto saveWav(const std::string &fileName, const std::vector<int16_t> &wav, int sampleRate) -> void;
+  auto bytesPerSample() const -> int;
+  auto flush() -> void;
+};
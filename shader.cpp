@@ -0,0 +1,64 @@
+#include "shader.hpp"
+#include <algorithm>
+#include <log/log.hpp>
+#include <string>
+#include <vector>
+
+#if defined(__APPLE__)
+static const auto glslVersion = "#version 150\n";
+#else
+static const auto glslVersion = "#version 130\n";
+#endif
+
+static auto compile(GLenum type, const char *source) -> GLuint
+{
+  const auto ret = glCreateShader(type);
+  const char *sources[] = {glslVersion, source};
+  glShaderSource(ret, 2, sources, nullptr);
+  glCompileShader(ret);
+  auto status = GLint{};
+  glGetShaderiv(ret, GL_COMPILE_STATUS, &status);
+  if (status != GL_TRUE)
+  {
+    auto len = GLint{};
+    glGetShaderiv(ret, GL_INFO_LOG_LENGTH, &len);
+    auto log = std::vector<char>(static_cast<size_t>(std::max(len, 1)));
+    glGetShaderInfoLog(ret, static_cast<GLsizei>(log.size()), nullptr, log.data());
+    LOG("shader compilation failed", log.data());
+  }
+  return ret;
+}
+
+Shader::Shader(const char *vertex, const char *fragment) : program(glCreateProgram())
+{
+  const auto vs = compile(GL_VERTEX_SHADER, vertex);
+  const auto fs = compile(GL_FRAGMENT_SHADER, fragment);
+  glAttachShader(program, vs);
+  glAttachShader(program, fs);
+  glBindFragDataLocation(program, 0, "fragColor");
+  glLinkProgram(program);
+  glDetachShader(program, vs);
+  glDetachShader(program, fs);
+  glDeleteShader(vs);
+  glDeleteShader(fs);
+  auto status = GLint{};
+  glGetProgramiv(program, GL_LINK_STATUS, &status);
+  if (status != GL_TRUE)
+  {
+    auto len = GLint{};
+    glGetProgramiv(program, GL_INFO_LOG_LENGTH, &len);
+    auto log = std::vector<char>(static_cast<size_t>(std::max(len, 1)));
+    glGetProgramInfoLog(program, static_cast<GLsizei>(log.size()), nullptr, log.data());
+    LOG("shader link failed", log.data());
+  }
+}
+
+Shader::~Shader()
+{
+  glDeleteProgram(program);
+}
+
+auto Shader::uniform(const char *name) const -> GLint
+{
+  return glGetUniformLocation(program, name);
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include "gl.hpp"
+
+class Shader
+{
+public:
+  // the sources go without the #version line, it is picked for the GL context main() requests
+  Shader(const char *vertex, const char *fragment);
+  ~Shader();
+  // disable copy
+  Shader(const Shader &) = delete;
+  Shader &operator=(const Shader &) = delete;
+
+  auto get() const -> GLuint { return program; }
+  operator GLuint() const { return program; }
+  auto uniform(const char *name) const -> GLint;
+
+private:
+  GLuint program;
+};
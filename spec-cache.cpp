@@ -1,116 +1,268 @@
 #include "spec-cache.hpp"
+#include "profiler.hpp"
 #include <algorithm>
 #include <cmath>
 
-SpecCache::SpecCache(Spec &spec, float k, int screenWidth, double rangeTime, std::function<int(double)> time2Sample)
-  : spec(spec), k(k), width(screenWidth), rangeTime(rangeTime), time2Sample(std::move(time2Sample))
+static const auto vertexSource = R"(
+out vec2 uv;
+void main()
 {
+  // full viewport quad as a triangle strip, no vertex buffer needed
+  uv = vec2(float(gl_VertexID & 1), float((gl_VertexID >> 1) & 1));
+  gl_Position = vec4(uv * 2.0 - 1.0, 0.0, 1.0);
 }
+)";
 
-auto SpecCache::getTex(double start) -> GLuint
+static const auto fragmentSource = R"(
+uniform sampler2D atlas;
+uniform sampler1D columns;
+uniform float k;
+uniform float startFreq; // relative to the Nyquist frequency
+uniform float rangeNote;
+uniform int binCount;
+uniform int spectrBins;
+in vec2 uv;
+out vec4 fragColor;
+vec3 colormap(float magnitude)
 {
-  const auto key = static_cast<int>(start * width / rangeTime);
+  float tmp = clamp(magnitude * k, 0.0, 255.0);
+  if (tmp < 85.0)
+    return vec3(tmp, 0.0, 0.0) / 255.0;
+  if (tmp < 170.0)
   {
-    const auto it = range2Tex.find(key);
-    if (it != std::end(range2Tex))
-    {
-      age.erase(it->second.age);
-      age.push_front(key);
-      it->second.age = std::begin(age);
-
-      return populateTex(it->second.texture, it->second.isDirty, key);
-    }
+    float a = (tmp - 85.0) / 85.0 * 3.141592 / 2.0;
+    return vec3(tmp * cos(a), tmp * sin(a), 0.0) / 255.0;
   }
-
+  float l = (tmp - 170.0) * 3.0;
+  return vec3(l, tmp, l) / 255.0;
+}
+void main()
+{
+  vec2 column = texelFetch(columns, int(uv.x * float(textureSize(columns, 0))), 0).rg;
+  float note = uv.y * rangeNote - column.g;
+  int bin = int(startFreq * exp2(note / 12.0) * float(spectrBins));
+  if (column.r < 0.0 || note < 0.0 || bin >= binCount)
   {
-    if (range2Tex.size() < MaxRanges)
-    {
-      age.push_front(key);
-      auto tmp = range2Tex.insert(std::make_pair(key, Tex{std::begin(age)}));
-      auto retIt = tmp.first;
-      return populateTex(retIt->second.texture.get(), retIt->second.isDirty, key);
-    }
-    // recycle textures
-    // get the oldest texture
-    auto oldest = std::end(age);
-    --oldest;
+    fragColor = vec4(0.0, 0.0, 0.0, 1.0);
+    return;
+  }
+  fragColor = vec4(colormap(texelFetch(atlas, ivec2(bin, int(column.r)), 0).r), 1.0);
+}
+)";
 
-    age.erase(oldest);
+// the atlas is half float: the raw magnitudes of quiet bins fall below its normal range, where its steps
+// show up as banding at high brightness. Scaled by this they stay normal, the loud ones saturate the
+// colormap long before the half float maximum
+static const auto MagnitudeScale = 65536.f;
+static const auto MaxHalf = 65504.f;
 
-    const auto oldestKey = *oldest;
-    const auto retIt = range2Tex.find(oldestKey);
-    auto ret = std::move(retIt->second.texture);
-    range2Tex.erase(retIt);
+SpecCache::SpecCache() : shader(vertexSource, fragmentSource)
+{
+  auto maxSize = GLint{};
+  glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+  // the bins past the maximum texture width are high above the piano range, they are drawn black
+  binCount = std::min(Spec::binCount(), static_cast<int>(maxSize));
+  rowCount = std::min(MaxRanges, static_cast<int>(maxSize));
 
-    age.push_front(key);
-    auto tmp = range2Tex.insert(std::make_pair(key, Tex{std::move(ret), std::begin(age)}));
+  glBindTexture(GL_TEXTURE_2D, atlas);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  // scaled magnitudes, the brightness and the colormap are applied in the shader
+  glTexImage2D(GL_TEXTURE_2D, // target
+               0,             // level
+               GL_R16F,       // internalFormat
+               binCount,      // width
+               rowCount,      // height
+               0,             // border
+               GL_RED,        // format
+               GL_FLOAT,      // type
+               nullptr        // data
+  );
 
-    return populateTex(tmp.first->second.texture.get(), tmp.first->second.isDirty, key);
+  glBindTexture(GL_TEXTURE_1D, columnsTexture);
+  glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+
+  // the core profile does not draw without a vertex array object
+  glGenVertexArrays(1, &vao);
+  glGenBuffers(1, &pbo);
+  stagedRows.reserve(static_cast<size_t>(uploadBudget));
+}
+
+SpecCache::~SpecCache()
+{
+  if (staging)
+  {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
   }
+  glDeleteBuffers(1, &pbo);
+  glDeleteVertexArrays(1, &vao);
 }
 
-auto SpecCache::populateTex(GLuint texture, bool &isDirty, int key) -> GLuint
+auto SpecCache::setUploadBudget(int value) -> void
 {
-  glBindTexture(GL_TEXTURE_1D, texture);
-  glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-  glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  // the pixel buffer is sized for the budget, a new size takes effect with the next mapping
+  flushUploads();
+  uploadBudget = std::max(1, value);
+}
 
-  if (!isDirty)
+auto SpecCache::getRow(const Spec &spec, int start, int end) -> float
+{
+  static auto &hits = profiler().counter("specCache/hit");
+  static auto &misses = profiler().counter("specCache/miss");
+  static auto &evictions = profiler().counter("specCache/eviction");
+  if (isNewFrame)
+  {
+    // the rows which did not fit into the last budget are found dirty again
+    isNewFrame = false;
+    isUploadPending = false;
+  }
+  // the key is in the sample domain, so rows survive zooming and panning
+  const auto column = Spec::key(start, end);
+  const auto key = std::make_pair(spec.id(), column);
+  {
+    const auto it = range2Row.find(key);
+    if (it != std::end(range2Row))
+    {
+      age.erase(it->second.age);
+      age.push_front(key);
+      it->second.age = std::begin(age);
+      hits.add();
+
+      return populateRow(it->second, spec, column);
+    }
+  }
+
+  misses.add();
+  if (range2Row.size() < static_cast<size_t>(rowCount))
   {
-    return texture;
+    age.push_front(key);
+    const auto row = static_cast<int>(range2Row.size());
+    auto tmp = range2Row.insert(std::make_pair(key, Row{row, std::begin(age)}));
+    return populateRow(tmp.first->second, spec, column);
   }
+  // recycle rows
+  // get the oldest row
+  auto oldest = std::end(age);
+  --oldest;
+  const auto oldestKey = *oldest;
+  age.erase(oldest);
 
-  const auto start = key * rangeTime / width;
-  const auto pixelSize = rangeTime / width;
-  const auto s = spec.get().getSpec(time2Sample(start), time2Sample(start + pixelSize));
+  const auto retIt = range2Row.find(oldestKey);
+  const auto row = retIt->second.row;
+  range2Row.erase(retIt);
+  evictions.add();
 
+  age.push_front(key);
+  auto tmp = range2Row.insert(std::make_pair(key, Row{row, std::begin(age)}));
+  return populateRow(tmp.first->second, spec, column);
+}
+
+auto SpecCache::populateRow(Row &row, const Spec &spec, Range key) -> float
+{
+  if (!row.isDirty)
+    return static_cast<float>(row.row);
+
+  const auto s = spec.getSpec(key);
+  // nothing is uploaded until the column is computed, the shader draws -1 rows black
   if (s.empty())
+    return -1.f;
+
+  if (stagedRows.size() >= static_cast<size_t>(uploadBudget))
   {
-    data.clear();
-    for (auto i = 0; i < 16; ++i)
-      data.push_back({static_cast<unsigned char>(0), static_cast<unsigned char>(0), static_cast<unsigned char>(0)});
+    isUploadPending = true;
+    return -1.f;
   }
-  else
+
+  const auto rowSize = static_cast<size_t>(binCount) * sizeof(float);
+  if (!staging)
   {
-    isDirty = false;
-    data.resize(s.size());
-    for (auto i = 0U; i < s.size(); ++i)
-    {
-      const auto tmp = std::clamp(s[i] * k, 0.f, 255.f);
-      if (tmp < 255 / 3)
-      {
-        data[i] = {static_cast<unsigned char>(tmp), 0, 0};
-      }
-      else if (tmp < 2 * 255 / 3)
-      {
-        const auto a = (tmp - 255 / 3) / (255 / 3) * 3.141592 / 2;
-        const auto r = static_cast<unsigned char>(tmp * std::cos(a));
-        const auto g = static_cast<unsigned char>(tmp * std::sin(a));
-        data[i] = std::array<unsigned char, 3>{r, g, 0};
-      }
-      else
-      {
-        const auto l_k = static_cast<unsigned char>((tmp - 2 * 255 / 3) * 3);
-        data[i] = std::array<unsigned char, 3>{l_k, static_cast<unsigned char>(tmp), l_k};
-      }
-    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+    // a new store every frame, the driver does not wait for the uploads of the previous one
+    glBufferData(GL_PIXEL_UNPACK_BUFFER,
+                 static_cast<GLsizeiptr>(rowSize * static_cast<size_t>(uploadBudget)),
+                 nullptr,
+                 GL_STREAM_DRAW);
+    staging = static_cast<float *>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER,
+                                                    0,
+                                                    static_cast<GLsizeiptr>(rowSize * uploadBudget),
+                                                    GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+    // other texture uploads must not read from the pixel buffer
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    if (!staging)
+      return -1.f;
   }
 
-  glTexImage1D(GL_TEXTURE_1D,                     // target
-               0,                                 // level
-               3,                                 // internalFormat
-               static_cast<GLsizei>(data.size()), // width
-               0,                                 // border
-               GL_RGB,                            // format
-               GL_UNSIGNED_BYTE,                  // type
-               data.data()                        // data
-  );
+  const auto dst = staging + stagedRows.size() * static_cast<size_t>(binCount);
+  for (auto i = size_t{0}; i < static_cast<size_t>(binCount); ++i)
+    dst[i] = std::min(s[i] * MagnitudeScale, MaxHalf);
+  stagedRows.push_back(row.row);
+  row.isDirty = false;
+  return static_cast<float>(row.row);
+}
 
-  return texture;
+auto SpecCache::flushUploads() -> void
+{
+  isNewFrame = true;
+  if (!staging)
+    return;
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+  glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+  staging = nullptr;
+  glBindTexture(GL_TEXTURE_2D, atlas);
+  for (auto i = 0U; i < stagedRows.size(); ++i)
+    glTexSubImage2D(GL_TEXTURE_2D,  // target
+                    0,              // level
+                    0,              // xoffset
+                    stagedRows[i],  // yoffset
+                    binCount,       // width
+                    1,              // height
+                    GL_RED,         // format
+                    GL_FLOAT,       // type
+                    reinterpret_cast<const void *>(i * static_cast<size_t>(binCount) * sizeof(float)));
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  static auto &uploads = profiler().counter("specCache/uploads");
+  uploads.add(static_cast<int64_t>(stagedRows.size()));
+  stagedRows.clear();
 }
 
-auto SpecCache::clear() -> void
+auto SpecCache::draw(const std::vector<std::array<float, 2>> &columns,
+                     double startNote,
+                     float rangeNote,
+                     int sampleRate,
+                     float k) -> void
 {
-  range2Tex.clear();
-  age.clear();
+  flushUploads();
+  if (columns.empty())
+    return;
+
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_1D, columnsTexture);
+  glTexImage1D(GL_TEXTURE_1D,                        // target
+               0,                                    // level
+               GL_RG32F,                             // internalFormat
+               static_cast<GLsizei>(columns.size()), // width
+               0,                                    // border
+               GL_RG,                                // format
+               GL_FLOAT,                             // type
+               columns.data()                        // data
+  );
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, atlas);
+
+  const auto startFreq = 55. * pow(2., (startNote - 24) / 12.);
+  glUseProgram(shader);
+  glUniform1i(shader.uniform("atlas"), 0);
+  glUniform1i(shader.uniform("columns"), 1);
+  glUniform1f(shader.uniform("k"), k / MagnitudeScale);
+  glUniform1f(shader.uniform("startFreq"), static_cast<float>(startFreq / sampleRate * 2.));
+  glUniform1f(shader.uniform("rangeNote"), rangeNote);
+  glUniform1i(shader.uniform("binCount"), binCount);
+  glUniform1i(shader.uniform("spectrBins"), Spec::binCount());
+  glBindVertexArray(vao);
+  glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+  glBindVertexArray(0);
+  glUseProgram(0);
 }
@@ -1,39 +1,70 @@
 #pragma once
+#include "gl.hpp"
+#include "shader.hpp"
 #include "spec.hpp"
 #include "texture.hpp"
-#include <functional>
+#include <array>
+#include <vector>
 #include <imgui/imgui.h>
 
-#if defined(IMGUI_IMPL_OPENGL_ES2)
-#include <SDL_opengles2.h>
-#else
-#include <SDL_opengl.h>
-#endif
-
+// keeps spectrum columns in rows of one 2D texture atlas and draws the spectrogram with a single shader
+// pass; the rows of all tracks share the atlas and its LRU
 class SpecCache
 {
 public:
-  SpecCache(Spec &, float k, int screenWidth, double rangeTime, std::function<int(double)> time2Sample);
-  auto getTex(double time) -> GLuint;
-  auto clear() -> void;
+  SpecCache();
+  ~SpecCache();
+  // atlas row of the spectrum column covering the samples [start, end), -1 while the column is not
+  // computed yet or its upload did not fit into this frame's budget
+  auto getRow(const Spec &, int start, int end) -> float;
+  // rows uploaded per draw(), a pan over computed columns is spread over several frames
+  auto setUploadBudget(int) -> void;
+  // copies the rows looked up since the last call into the atlas, draw() does it as well
+  auto flushUploads() -> void;
+  // computed columns are waiting for the upload budget of the next frames
+  auto hasPendingUploads() const -> bool { return isUploadPending; }
+  // draws into the current viewport, one (atlas row, pitch bend) pair per screen column, k is the
+  // brightness applied by the colormap
+  auto draw(const std::vector<std::array<float, 2>> &columns,
+            double startNote,
+            float rangeNote,
+            int sampleRate,
+            float k) -> void;
 
 private:
-  std::reference_wrapper<Spec> spec;
-  float k;
-  int width;
-  double rangeTime;
-  std::function<int(double)> time2Sample;
-  struct Tex
+  // the id of the Spec and the column
+  using Key = std::pair<uint64_t, Range>;
+  struct KeyHash
+  {
+    auto operator()(const Key &key) const -> size_t
+    {
+      return pair_hash{}(std::make_pair(key.first, pair_hash{}(key.second)));
+    }
+  };
+
+  int binCount;
+  int rowCount;
+  Texture atlas;
+  Texture columnsTexture;
+  GLuint vao = 0;
+  Shader shader;
+  // the rows of a frame are copied into the pixel buffer while the columns are looked up, draw() uploads
+  // them from it to the atlas
+  GLuint pbo = 0;
+  float *staging = nullptr;
+  std::vector<int> stagedRows;
+  int uploadBudget = 32;
+  bool isUploadPending = false;
+  bool isNewFrame = true;
+  struct Row
   {
-    explicit Tex(std::list<int>::iterator age) : age(std::move(age)) {}
-    explicit Tex(Texture &&texture, std::list<int>::iterator age) : texture(std::move(texture)), age(std::move(age)) {}
-    Texture texture;
-    std::list<int>::iterator age;
+    Row(int row, std::list<Key>::iterator age) : row(row), age(std::move(age)) {}
+    int row;
+    std::list<Key>::iterator age;
     bool isDirty = true;
   };
-  std::unordered_map<int, Tex> range2Tex;
-  std::list<int> age;
-  std::vector<std::array<unsigned char, 3>> data;
+  std::unordered_map<Key, Row, KeyHash> range2Row;
+  std::list<Key> age;
 
-  auto populateTex(GLuint texture, bool &isDirty, int key) -> GLuint;
+  auto populateRow(Row &, const Spec &, Range key) -> float;
 };
@@ -0,0 +1,139 @@
+#include "spec-file.hpp"
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <log/log.hpp>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+  const auto Magic = std::array<char, 8>{'M', 'L', 'X', 'S', 'P', 'E', 'C', '\0'};
+  const auto Version = uint32_t{2};
+  const auto PageSize = size_t{4096};
+
+  struct Header
+  {
+    std::array<char, 8> magic;
+    uint32_t version;
+    uint32_t binCount;
+    uint64_t key;
+    uint64_t count;
+  };
+
+  // the column data starts at the first page boundary after the header and the index
+  auto dataOffset(uint64_t count) -> size_t
+  {
+    const auto sz = sizeof(Header) + count * 2 * sizeof(int32_t);
+    return (sz + PageSize - 1) / PageSize * PageSize;
+  }
+} // namespace
+
+SpecFile::SpecFile(const std::string &path, uint64_t key, int binCount) : binCount(binCount)
+{
+  const auto fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(Header))
+  {
+    close(fd);
+    return;
+  }
+  mapSize = static_cast<size_t>(st.st_size);
+  map = mmap(nullptr, mapSize, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+  {
+    LOG("failed to map spectrum cache", path);
+    map = nullptr;
+    return;
+  }
+
+  const auto base = static_cast<const char *>(map);
+  Header header;
+  memcpy(&header, base, sizeof(header));
+  if (header.magic != Magic || header.version != Version || header.key != key ||
+      header.binCount != static_cast<uint32_t>(binCount) ||
+      dataOffset(header.count) + header.count * binCount * sizeof(float) > mapSize)
+  {
+    LOG("spectrum cache is stale", path);
+    return;
+  }
+
+  for (auto i = 0U; i < header.count; ++i)
+  {
+    auto range = std::array<int32_t, 2>{};
+    memcpy(range.data(), base + sizeof(Header) + i * sizeof(range), sizeof(range));
+    range2Idx[std::make_pair(range[0], range[1])] = i;
+  }
+  data = reinterpret_cast<const float *>(base + dataOffset(header.count));
+  LOG("spectrum cache loaded", path, "columns", header.count);
+}
+
+SpecFile::~SpecFile()
+{
+  if (map)
+    munmap(map, mapSize);
+}
+
+auto SpecFile::find(Range range) const -> std::span<const float>
+{
+  const auto it = range2Idx.find(range);
+  if (it == std::end(range2Idx))
+    return {};
+  return {data + it->second * binCount, static_cast<size_t>(binCount)};
+}
+
+auto SpecFile::ranges() const -> std::vector<Range>
+{
+  auto ret = std::vector<Range>{};
+  ret.reserve(range2Idx.size());
+  for (const auto &r : range2Idx)
+    ret.push_back(r.first);
+  return ret;
+}
+
+auto SpecFile::save(const std::string &path,
+                    uint64_t key,
+                    int binCount,
+                    const std::vector<std::pair<Range, std::span<const float>>> &columns) -> bool
+{
+  // write to a temporary file and rename it over the old one, the old file can still be mapped
+  const auto tmpPath = path + ".tmp";
+  {
+    auto file = std::ofstream{tmpPath, std::ios::binary};
+    if (!file.is_open())
+    {
+      LOG("failed to open file", tmpPath);
+      return false;
+    }
+    const auto header = Header{Magic, Version, static_cast<uint32_t>(binCount), key, columns.size()};
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    for (const auto &column : columns)
+    {
+      const auto range = std::array<int32_t, 2>{column.first.first, column.first.second};
+      file.write(reinterpret_cast<const char *>(range.data()), sizeof(range));
+    }
+    const auto padding =
+      std::vector<char>(dataOffset(columns.size()) - sizeof(Header) - columns.size() * 2 * sizeof(int32_t));
+    file.write(padding.data(), padding.size());
+    for (const auto &column : columns)
+      file.write(reinterpret_cast<const char *>(column.second.data()), binCount * sizeof(float));
+    if (!file)
+    {
+      LOG("failed to write spectrum cache", tmpPath);
+      return false;
+    }
+  }
+  std::error_code ec;
+  std::filesystem::rename(tmpPath, path, ec);
+  if (ec)
+  {
+    LOG("failed to rename", tmpPath, path, ec.message());
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include "range.hpp"
+#include <array>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// sidecar file with precomputed spectrum columns, the file is memory-mapped and the columns are used in
+// place
+class SpecFile
+{
+public:
+  // maps the file if it exists and was computed for the same key, otherwise the cache stays empty
+  SpecFile(const std::string &path, uint64_t key, int binCount);
+  ~SpecFile();
+  SpecFile(const SpecFile &) = delete;
+  SpecFile &operator=(const SpecFile &) = delete;
+
+  auto find(Range) const -> std::span<const float>;
+  auto ranges() const -> std::vector<Range>;
+
+  static auto save(const std::string &path,
+                   uint64_t key,
+                   int binCount,
+                   const std::vector<std::pair<Range, std::span<const float>>> &columns) -> bool;
+
+private:
+  void *map = nullptr;
+  size_t mapSize = 0;
+  int binCount;
+  const float *data = nullptr;
+  std::unordered_map<Range, size_t, pair_hash> range2Idx;
+};
@@ -0,0 +1,142 @@
+#include "spec-kernels.hpp"
+#include "cpu-features.hpp"
+#include <cmath>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SPEC_KERNELS_AVX2 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define SPEC_KERNELS_NEON 1
+#endif
+
+namespace
+{
+  auto applyWindowScalar(const float *src, const float *window, FftReal *dst, int n) -> void
+  {
+    for (auto i = 0; i < n; ++i)
+      dst[i] = src[i] * window[i];
+  }
+
+  auto magnitudesScalar(const FftComplex *src, float *dst, int n, float scale) -> void
+  {
+    for (auto i = 0; i < n; ++i)
+      dst[i] = static_cast<float>(std::sqrt(src[i][0] * src[i][0] + src[i][1] * src[i][1]) * scale);
+  }
+
+#if defined(SPEC_KERNELS_AVX2)
+  // AVX2 is not in the default flags, so the kernels are compiled for it separately and picked at run
+  // time by cpuHasAvx2()
+  __attribute__((target("avx2"))) auto applyWindowAvx2(const float *src,
+                                                       const float *window,
+                                                       FftReal *dst,
+                                                       int n) -> void
+  {
+    auto i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+      const auto v = _mm256_mul_ps(_mm256_loadu_ps(src + i), _mm256_loadu_ps(window + i));
+#if defined(MELONIX_FFTWF)
+      _mm256_storeu_ps(dst + i, v);
+#else
+      _mm256_storeu_pd(dst + i, _mm256_cvtps_pd(_mm256_castps256_ps128(v)));
+      _mm256_storeu_pd(dst + i + 4, _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1)));
+#endif
+    }
+    applyWindowScalar(src + i, window + i, dst + i, n - i);
+  }
+
+  __attribute__((target("avx2"))) auto magnitudesAvx2(const FftComplex *src, float *dst, int n, float scale)
+    -> void
+  {
+    auto i = 0;
+#if defined(MELONIX_FFTWF)
+    const auto s = _mm256_set1_ps(scale);
+    for (; i + 8 <= n; i += 8)
+    {
+      const auto a = _mm256_loadu_ps(&src[i][0]);
+      const auto b = _mm256_loadu_ps(&src[i + 4][0]);
+      // hadd works within 128-bit lanes: a01 a23 b01 b23 | a45 a67 b45 b67, put the lanes back in order
+      const auto sum = _mm256_hadd_ps(_mm256_mul_ps(a, a), _mm256_mul_ps(b, b));
+      const auto ordered =
+        _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(sum), _MM_SHUFFLE(3, 1, 2, 0)));
+      _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_sqrt_ps(ordered), s));
+    }
+#else
+    const auto s = _mm256_set1_pd(scale);
+    for (; i + 4 <= n; i += 4)
+    {
+      const auto a = _mm256_loadu_pd(&src[i][0]);
+      const auto b = _mm256_loadu_pd(&src[i + 2][0]);
+      // a01 b01 a23 b23 -> a01 a23 b01 b23
+      const auto sum = _mm256_hadd_pd(_mm256_mul_pd(a, a), _mm256_mul_pd(b, b));
+      const auto ordered = _mm256_permute4x64_pd(sum, _MM_SHUFFLE(3, 1, 2, 0));
+      _mm_storeu_ps(dst + i, _mm256_cvtpd_ps(_mm256_mul_pd(_mm256_sqrt_pd(ordered), s)));
+    }
+#endif
+    magnitudesScalar(src + i, dst + i, n - i, scale);
+  }
+#endif
+
+#if defined(SPEC_KERNELS_NEON)
+  auto applyWindowNeon(const float *src, const float *window, FftReal *dst, int n) -> void
+  {
+    auto i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+      const auto v = vmulq_f32(vld1q_f32(src + i), vld1q_f32(window + i));
+#if defined(MELONIX_FFTWF)
+      vst1q_f32(dst + i, v);
+#else
+      vst1q_f64(dst + i, vcvt_f64_f32(vget_low_f32(v)));
+      vst1q_f64(dst + i + 2, vcvt_high_f64_f32(v));
+#endif
+    }
+    applyWindowScalar(src + i, window + i, dst + i, n - i);
+  }
+
+  auto magnitudesNeon(const FftComplex *src, float *dst, int n, float scale) -> void
+  {
+    auto i = 0;
+#if defined(MELONIX_FFTWF)
+    for (; i + 4 <= n; i += 4)
+    {
+      // vld2 deinterleaves the real and the imaginary parts
+      const auto v = vld2q_f32(&src[i][0]);
+      const auto sum = vmlaq_f32(vmulq_f32(v.val[0], v.val[0]), v.val[1], v.val[1]);
+      vst1q_f32(dst + i, vmulq_n_f32(vsqrtq_f32(sum), scale));
+    }
+#else
+    for (; i + 2 <= n; i += 2)
+    {
+      const auto v = vld2q_f64(&src[i][0]);
+      const auto sum = vmlaq_f64(vmulq_f64(v.val[0], v.val[0]), v.val[1], v.val[1]);
+      vst1_f32(dst + i, vcvt_f32_f64(vmulq_n_f64(vsqrtq_f64(sum), scale)));
+    }
+#endif
+    magnitudesScalar(src + i, dst + i, n - i, scale);
+  }
+#endif
+} // namespace
+
+auto applyWindow(const float *src, const float *window, FftReal *dst, int n) -> void
+{
+#if defined(SPEC_KERNELS_AVX2)
+  if (cpuHasAvx2())
+    return applyWindowAvx2(src, window, dst, n);
+#elif defined(SPEC_KERNELS_NEON)
+  return applyWindowNeon(src, window, dst, n);
+#endif
+  applyWindowScalar(src, window, dst, n);
+}
+
+auto magnitudes(const FftComplex *src, float *dst, int n, float scale) -> void
+{
+#if defined(SPEC_KERNELS_AVX2)
+  if (cpuHasAvx2())
+    return magnitudesAvx2(src, dst, n, scale);
+#elif defined(SPEC_KERNELS_NEON)
+  return magnitudesNeon(src, dst, n, scale);
+#endif
+  magnitudesScalar(src, dst, n, scale);
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include <fftw3.h>
+
+// single precision FFT is opt-in, it halves the FFT cost and memory but needs libfftw3f
+#if defined(MELONIX_FFTWF)
+using FftReal = float;
+using FftComplex = fftwf_complex;
+using FftPlan = fftwf_plan;
+#else
+using FftReal = double;
+using FftComplex = fftw_complex;
+using FftPlan = fftw_plan;
+#endif
+
+// dst[i] = src[i] * window[i]
+auto applyWindow(const float *src, const float *window, FftReal *dst, int n) -> void;
+// dst[i] = |src[i]| * scale
+auto magnitudes(const FftComplex *src, float *dst, int n, float scale) -> void;
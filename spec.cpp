@@ -1,106 +1,667 @@
 #include "spec.hpp"
+#include "profiler.hpp"
+#include "thread-pool.hpp"
+#include <algorithm>
+#include <array>
+#include <bit>
 #include <cassert>
 #include <cmath>
+#include <cstdlib>
 #include <cstring>
 #include <log/log.hpp>
+#include <memory>
 #include <optional>
 
 const auto SpectrSize = 8 * 4096;
+const auto DecayRate = 2.5e-4f;
+// level 0 columns are one hop wide, every next level pools two columns of the previous level
+const auto Hop = 1024;
+const auto MaxLevel = 16;
+// the levels right below a job which are stored like requested columns, the deeper ones are stored only
+// while the LRU has spare room, so a far zoom does not flush the cache with level 0 columns
+const auto NearLevels = 4;
+// a few slots on top of the LRU capacity, for columns pinned by readers while their entry is evicted
+const auto ExtraSlots = 64;
 
-Spec::Spec(std::span<float> wav)
-  : wav(wav), input(fftw_alloc_complex(SpectrSize)), output(fftw_alloc_complex(SpectrSize)), running(true), thread(std::thread(&Spec::run, this))
+namespace
 {
-  memset(input, 0, SpectrSize * sizeof(fftw_complex));
-  memset(output, 0, SpectrSize * sizeof(fftw_complex));
-  plan = fftw_plan_dft_1d(SpectrSize, input, output, FFTW_FORWARD, FFTW_MEASURE);
+#if defined(MELONIX_FFTWF)
+  auto fftAllocReal(size_t n) -> FftReal * { return fftwf_alloc_real(n); }
+  auto fftAllocComplex(size_t n) -> FftComplex * { return fftwf_alloc_complex(n); }
+  auto fftFree(void *p) -> void { fftwf_free(p); }
+  auto fftPlan(FftReal *in, FftComplex *out, unsigned flags) -> FftPlan
+  {
+    return fftwf_plan_dft_r2c_1d(SpectrSize, in, out, flags);
+  }
+  auto fftExecute(FftPlan plan, FftReal *in, FftComplex *out) -> void { fftwf_execute_dft_r2c(plan, in, out); }
+  auto fftImportWisdom(const std::string &path) -> bool
+  {
+    return fftwf_import_wisdom_from_filename(path.c_str()) != 0;
+  }
+  auto fftExportWisdom(const std::string &path) -> bool
+  {
+    return fftwf_export_wisdom_to_filename(path.c_str()) != 0;
+  }
+#else
+  auto fftAllocReal(size_t n) -> FftReal * { return fftw_alloc_real(n); }
+  auto fftAllocComplex(size_t n) -> FftComplex * { return fftw_alloc_complex(n); }
+  auto fftFree(void *p) -> void { fftw_free(p); }
+  auto fftPlan(FftReal *in, FftComplex *out, unsigned flags) -> FftPlan
+  {
+    return fftw_plan_dft_r2c_1d(SpectrSize, in, out, flags);
+  }
+  auto fftExecute(FftPlan plan, FftReal *in, FftComplex *out) -> void { fftw_execute_dft_r2c(plan, in, out); }
+  auto fftImportWisdom(const std::string &path) -> bool
+  {
+    return fftw_import_wisdom_from_filename(path.c_str()) != 0;
+  }
+  auto fftExportWisdom(const std::string &path) -> bool
+  {
+    return fftw_export_wisdom_to_filename(path.c_str()) != 0;
+  }
+#endif
+
+  struct FftFree
+  {
+    auto operator()(void *p) const -> void { fftFree(p); }
+  };
+  using FftRealBuf = std::unique_ptr<FftReal[], FftFree>;
+  using FftComplexBuf = std::unique_ptr<FftComplex[], FftFree>;
+
+  // the input is real, so the r2c plan only produces the non-negative half of the spectrum
+  const auto OutputSize = SpectrSize / 2 + 1;
+
+  // the wisdom has the measured plans of the machine, without it every start measures again
+  auto wisdomPath() -> std::string
+  {
+    const auto home = getenv("HOME");
+    if (!home)
+      return {};
+#if defined(MELONIX_FFTWF)
+    return std::string{home} + "/.melonix-fftwf-wisdom";
+#else
+    return std::string{home} + "/.melonix-fftw-wisdom";
+#endif
+  }
+
+  // one plan for the whole process, shared by the workers of every Spec; it is never destroyed. FFTW
+  // planning is not thread safe so it is done once on scratch buffers, the FFTW allocators guarantee the
+  // same alignment for the worker buffers
+  auto sharedPlan() -> FftPlan
+  {
+    static const auto ret = []() {
+      auto input = FftRealBuf{fftAllocReal(SpectrSize)};
+      auto output = FftComplexBuf{fftAllocComplex(OutputSize)};
+      const auto path = wisdomPath();
+      if (!path.empty() && fftImportWisdom(path))
+        if (const auto plan = fftPlan(input.get(), output.get(), FFTW_MEASURE | FFTW_WISDOM_ONLY))
+          return plan;
+      PROFILE("spec/plan");
+      const auto plan = fftPlan(input.get(), output.get(), FFTW_MEASURE);
+      if (!path.empty() && fftExportWisdom(path))
+        LOG("FFTW wisdom saved", path);
+      return plan;
+    }();
+    return ret;
+  }
+
+  // every level 0 column is one hop, so the decay window before the hop is the same for all of them
+  auto decayWindow() -> const std::vector<float> &
+  {
+    static const auto ret = []() {
+      auto window = std::vector<float>(SpectrSize, 1.f);
+      for (auto p = 0; p < SpectrSize - Hop; ++p)
+        window[p] = expf(-DecayRate * (SpectrSize - Hop - p));
+      return window;
+    }();
+    return ret;
+  }
+} // namespace
+
+// slots are reference counted: one reference for the cache entry and one for every Column handle
+struct Spec::Shared
+{
+  std::mutex mutex;
+  // not value-initialized, the pages are committed only when columns are written into them
+  std::unique_ptr<float[]> slab{new float[static_cast<size_t>(MaxRanges + ExtraSlots) * SpectrSize / 2]};
+  std::vector<int> slotRefs = std::vector<int>(MaxRanges + ExtraSlots, 0);
+  std::vector<int> freeSlots;
+  Age age;
+
+  Shared()
+  {
+    freeSlots.reserve(MaxRanges + ExtraSlots);
+    for (auto i = MaxRanges + ExtraSlots - 1; i >= 0; --i)
+      freeSlots.push_back(i);
+  }
+};
+
+auto Spec::shared() -> Shared &
+{
+  static auto instance = Shared{};
+  return instance;
+}
+
+// every worker owns its FFT buffers and a scratch column per pyramid level, so a job never allocates
+struct Spec::Worker
+{
+  FftRealBuf input{fftAllocReal(SpectrSize)};
+  FftComplexBuf output{fftAllocComplex(OutputSize)};
+  // the job column and the stack of the levels below it
+  std::unique_ptr<float[]> scratch{new float[(MaxLevel + 2) * SpectrSize / 2]};
+
+  auto column(int idx) -> float * { return scratch.get() + idx * SpectrSize / 2; }
+};
+
+Spec::Column::~Column()
+{
+  release();
+}
+
+Spec::Column::Column(Column &&other) noexcept : spec(other.spec), slot(other.slot), ptr(other.ptr)
+{
+  other.spec = nullptr;
+  other.slot = -1;
+  other.ptr = nullptr;
 }
 
-auto Spec::getSpec(int start, int end) const -> std::vector<float>
+Spec::Column &Spec::Column::operator=(Column &&other) noexcept
+{
+  if (this == &other)
+    return *this;
+  release();
+  spec = other.spec;
+  slot = other.slot;
+  ptr = other.ptr;
+  other.spec = nullptr;
+  other.slot = -1;
+  other.ptr = nullptr;
+  return *this;
+}
+
+auto Spec::Column::release() -> void
+{
+  if (spec && slot >= 0)
+  {
+    std::lock_guard<std::mutex> lock(spec->mutex);
+    spec->releaseSlot(slot);
+  }
+  spec = nullptr;
+  slot = -1;
+  ptr = nullptr;
+}
+
+Spec::Spec(std::span<float> wav, std::function<void()> aOnJobDone, int aWorkers, BlockCache *aBlocks)
+  : wav(wav),
+    onJobDone(std::move(aOnJobDone)),
+    blocks(aBlocks),
+    uid([]() {
+      static auto next = std::atomic<uint64_t>{0};
+      return ++next;
+    }()),
+    available(wav.size()),
+    plan(sharedPlan()),
+    workers(std::max(1, aWorkers)),
+    lru(shared()),
+    mutex(lru.mutex)
+{
+  decayWindow();
+}
+
+auto Spec::defaultWorkers() -> int
+{
+  // the pool already leaves one core for the UI and the audio callback
+  return threadPool().size();
+}
+
+auto Spec::key(int start, int end) -> Range
+{
+  // pick the finest level which is still at least half of the requested range, so zooming out is a
+  // lookup into a coarser level instead of a new FFT for every pixel
+  auto level = 0;
+  while (level < MaxLevel && (Hop << (level + 1)) <= end - start)
+    ++level;
+  const auto width = Hop << level;
+  const auto center = start + (end - start) / 2;
+  const auto idx = center >= 0 ? center / width : -((width - 1 - center) / width);
+  return std::make_pair(level, idx);
+}
+
+auto Spec::samples(Range key) -> Range
+{
+  const auto width = Hop << key.first;
+  return std::make_pair(key.second * width, (key.second + 1) * width);
+}
+
+auto Spec::binCount() -> int
+{
+  return SpectrSize / 2;
+}
+
+auto Spec::setAvailable(size_t samples, bool isFinal) -> void
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  available = samples;
+  isComplete = isFinal;
+}
+
+auto Spec::getSpec(Range key) const -> Column
 {
-  const auto key = std::make_pair(start, end);
   std::lock_guard<std::mutex> lock(mutex);
   auto it = range2Spec.find(key);
   if (it != std::end(range2Spec))
   {
-    age.erase(it->second.age);
-    age.push_front(key);
-    it->second.age = std::begin(age);
-    return it->second.spec;
+    lru.age.splice(std::begin(lru.age), lru.age, it->second.age);
+    if (!it->second.data)
+      return {};
+    if (it->second.slot >= 0)
+      ++lru.slotRefs[it->second.slot];
+    return Column{this, it->second.slot, it->second.data};
   }
-  jobs.insert(key);
-  age.push_front(key);
-  range2Spec.insert(std::make_pair(key, S{{}, std::begin(age)}));
-  if (range2Spec.size() > MaxRanges)
+  if (diskCache)
   {
-    auto oldest = std::end(age);
-    --oldest;
-    range2Spec.erase(*oldest);
-    jobs.erase(*oldest);
-    age.pop_back();
+    // columns from the disk cache are used in place, they do not take a slab slot
+    const auto cached = diskCache->find(key);
+    if (!cached.empty())
+    {
+      lru.age.emplace_front(this, key);
+      range2Spec.insert(std::make_pair(key, S{cached.data(), -1, std::begin(lru.age)}));
+      evictOldest();
+      return Column{this, -1, cached.data()};
+    }
   }
+  // a column reaching into samples which are still decoding would be wrong, it is requested again later
+  if (!isComplete && samples(key).second > static_cast<int64_t>(available.load()))
+    return {};
+  const auto p = priority(key);
+  jobs.insert(std::make_pair(p, key));
+  schedule();
+  lru.age.emplace_front(this, key);
+  range2Spec.insert(
+    std::make_pair(key, S{nullptr, -1, std::begin(lru.age), p, true, std::chrono::steady_clock::now()}));
+  evictOldest();
   return {};
 }
 
-auto Spec::internalGetSpec(int start, int end) const -> std::vector<float>
+auto Spec::lookup(Range key) const -> Column
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  const auto it = range2Spec.find(key);
+  if (it == std::end(range2Spec) || !it->second.data)
+    return {};
+  if (it->second.slot >= 0)
+    ++lru.slotRefs[it->second.slot];
+  return Column{this, it->second.slot, it->second.data};
+}
+
+auto Spec::acquireSlot() const -> int
+{
+  if (lru.freeSlots.empty())
+    return -1;
+  const auto ret = lru.freeSlots.back();
+  lru.freeSlots.pop_back();
+  lru.slotRefs[ret] = 1;
+  return ret;
+}
+
+auto Spec::releaseSlot(int slot) const -> void
 {
-  auto p = 0;
-  for (auto i = end - SpectrSize; i < end; ++i, ++p)
+  if (--lru.slotRefs[slot] == 0)
+    lru.freeSlots.push_back(slot);
+}
+
+auto Spec::erase(Range key) const -> void
+{
+  const auto it = range2Spec.find(key);
+  if (it->second.isQueued)
+    jobs.erase(std::make_pair(it->second.priority, key));
+  if (it->second.slot >= 0)
+    releaseSlot(it->second.slot);
+  lru.age.erase(it->second.age);
+  range2Spec.erase(it);
+}
+
+auto Spec::evictOldest() const -> void
+{
+  // the oldest entry can belong to another Spec, a new track takes the memory of the ones which are not
+  // looked at
+  if (lru.age.size() <= MaxRanges)
+    return;
+  const auto oldest = lru.age.back();
+  oldest.first->erase(oldest.second);
+}
+
+auto Spec::priority(Range key) const -> int64_t
+{
+  const auto range = samples(key);
+  const auto mid = (int64_t{range.first} + range.second) / 2;
+  const auto center = (int64_t{focusStart} + focusEnd) / 2;
+  return std::min(std::abs(mid - center), std::abs(mid - focusCursor));
+}
+
+auto Spec::setFocus(int visibleStart, int visibleEnd, int cursor) -> void
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  if (visibleStart == focusStart && visibleEnd == focusEnd && cursor == focusCursor)
+    return;
+  focusStart = visibleStart;
+  focusEnd = visibleEnd;
+  focusCursor = cursor;
+
+  // keep a half screen of margin around the visible range, so small pans only demote jobs
+  const auto margin = (int64_t{visibleEnd} - visibleStart) / 2;
+  const auto keepStart = visibleStart - margin;
+  const auto keepEnd = visibleEnd + margin;
+
+  auto oldJobs = std::move(jobs);
+  jobs.clear();
+  for (const auto &job : oldJobs)
   {
-    input[p][1] = 0;
-    if ((i >= static_cast<int>(wav.size()) || i < 0))
+    const auto key = job.second;
+    auto it = range2Spec.find(key);
+    const auto range = samples(key);
+    if (range.second < keepStart || range.first > keepEnd)
     {
-      input[p][0] = 0;
+      // cancel the job, the placeholder goes away as well so the range is requested again once it is
+      // visible
+      lru.age.erase(it->second.age);
+      range2Spec.erase(it);
       continue;
     }
-    if (i >= start)
-      input[p][0] = wav[i];
-    else
-      input[p][0] = expf(-2.5e-4f * (start - i)) * wav[i];
+    it->second.priority = priority(key);
+    jobs.insert(std::make_pair(it->second.priority, key));
   }
-  fftw_execute(plan);
-  std::vector<float> ret;
-  for (auto i = 0U; i < SpectrSize / 2; i++)
-    ret.push_back(
-      static_cast<float>(sqrt(output[i][0] * output[i][0] + output[i][1] * output[i][1]) / SpectrSize));
-  return ret;
 }
 
-auto Spec::run() -> void
+auto Spec::internalGetSpec(int start, int end, Worker &worker, float *out) const -> void
+{
+  assert(end - start == Hop);
+  (void)start;
+  auto input = worker.input.get();
+  const auto first = end - SpectrSize;
+  // only the part of the window which overlaps the audio is multiplied, the rest is zero
+  const auto pBegin = std::clamp(-first, 0, SpectrSize);
+  const auto pEnd = std::clamp(static_cast<int>(available.load()) - first, pBegin, SpectrSize);
+  std::fill(input, input + pBegin, FftReal{0});
+  const auto pinFirst = static_cast<size_t>(first + pBegin);
+  const auto pin = blocks ? blocks->pin(pinFirst, static_cast<size_t>(first + pEnd)) : BlockCache::Pin{};
+  if (pEnd > pBegin)
+    applyWindow(wav.data() + first + pBegin, decayWindow().data() + pBegin, input + pBegin, pEnd - pBegin);
+  std::fill(input + pEnd, input + SpectrSize, FftReal{0});
+  fftExecute(plan, input, worker.output.get());
+  magnitudes(worker.output.get(), out, SpectrSize / 2, 1.f / SpectrSize);
+}
+
+auto Spec::computeColumn(Range key, float *out) const -> void
 {
-  while (running)
+  assert(key.first == 0);
+  thread_local auto worker = Worker{};
+  const auto range = samples(key);
+  internalGetSpec(range.first, range.second, worker, out);
+}
+
+auto Spec::schedule() const -> void
+{
+  // every task takes the job with the best priority when it starts, not the one it was posted for
+  for (; tasks < workers && static_cast<size_t>(tasks) < jobs.size(); ++tasks)
+    threadPool().post([this]() { runJob(); });
+}
+
+auto Spec::runJob() const -> void
+{
+  static auto &jobTimer = profiler().timer("spec/job");
+  // from the request of the column until it is stored, the time the view waits for it
+  static auto &latencyTimer = profiler().timer("spec/job latency");
+  static auto &queueGauge = profiler().gauge("spec/queue");
+  // the scratch buffers are shared by all Specs running on the same pool thread
+  thread_local auto worker = Worker{};
+
+  auto queued = std::chrono::steady_clock::time_point{};
+  const auto job = [&]() -> std::optional<Range> {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!running || jobs.empty())
+      return std::nullopt;
+    const auto key = jobs.begin()->second;
+    jobs.erase(jobs.begin());
+    queueGauge.set(static_cast<int64_t>(jobs.size()));
+    auto &s = range2Spec.find(key)->second;
+    s.isQueued = false;
+    queued = s.queued;
+    return key;
+  }();
+
+  if (job)
   {
-    const auto job = [&]() -> std::optional<Range> {
-      std::lock_guard<std::mutex> lock(mutex);
-      if (jobs.empty())
-        return std::nullopt;
-      auto key = *jobs.begin();
-      jobs.erase(key);
-      return key;
-    }();
+    {
+      const auto scope = ProfileScope{jobTimer};
+      compute(*job, worker.column(0), worker);
+    }
+    store(*job, worker.column(0), Keep::Job);
+    const auto latency = std::chrono::steady_clock::now() - queued;
+    latencyTimer.add(std::chrono::duration<double, std::milli>(latency).count());
+    if (onJobDone)
+      onJobDone();
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+  --tasks;
+  // one job per task, so the jobs of the other Specs and the other work on the pool get their turn
+  if (running)
+    schedule();
+  tasksCv.notify_all();
+}
 
-    if (!job)
+auto Spec::compute(Range key, float *out, Worker &worker) const -> void
+{
+  if (key.first == 0)
+  {
+    const auto range = samples(key);
+    internalGetSpec(range.first, range.second, worker, out);
+    return;
+  }
+
+  // the levels below the column are built bottom-up like a binary counter: the stack holds one finished
+  // column per level, and two neighbours of the same level are max-pooled into the next level, like the
+  // waveform picks; every column of every level is computed once and stored, so a column which is looked
+  // at later is pooled from the finer level instead of going down to level 0 again
+  struct Node
+  {
+    int level;
+    float *data;
+  };
+  auto stack = std::array<Node, MaxLevel + 1>{};
+  auto size = 0;
+  const auto first = key.second << key.first;
+  const auto count = 1 << key.first;
+  const auto keep = [&](int level) { return level >= key.first - NearLevels ? Keep::Near : Keep::Spare; };
+  for (auto pos = 0; pos < count;)
+  {
+    // the widest stored column starting here, the stack only ever holds columns of distinct levels
+    const auto dst = worker.column(size + 1);
+    auto level = std::min(std::countr_zero(static_cast<unsigned>(pos)), key.first - 1);
+    for (; level >= 0; --level)
+      if (const auto cached = lookup(std::make_pair(level, (first + pos) >> level)); !cached.empty())
+      {
+        memcpy(dst, cached.data(), SpectrSize / 2 * sizeof(float));
+        break;
+      }
+    if (level < 0)
     {
-      std::this_thread::sleep_for(std::chrono::milliseconds(20));
-      continue;
+      level = 0;
+      const auto range = samples(std::make_pair(0, first + pos));
+      internalGetSpec(range.first, range.second, worker, dst);
+      store(std::make_pair(0, first + pos), dst, keep(0));
+    }
+    pos += 1 << level;
+    stack[size++] = Node{level, dst};
+
+    while (size >= 2 && stack[size - 1].level == stack[size - 2].level)
+    {
+      auto &left = stack[size - 2];
+      const auto right = stack[size - 1].data;
+      const auto parent = left.level + 1;
+      const auto pooled = parent == key.first ? out : left.data;
+      for (auto i = 0; i < SpectrSize / 2; ++i)
+        pooled[i] = std::max(left.data[i], right[i]);
+      --size;
+      left = Node{parent, pooled};
+      if (parent < key.first)
+        store(std::make_pair(parent, (first + pos - (1 << parent)) >> parent), pooled, keep(parent));
     }
+  }
+}
+
+auto Spec::store(Range key, const float *spec, Keep keep) const -> void
+{
+  const auto slot = [&]() {
+    std::lock_guard<std::mutex> lock(mutex);
+    const auto it = range2Spec.find(key);
+    if (it == std::end(range2Spec))
+    {
+      // the job was cancelled or evicted while it was computed
+      if (keep == Keep::Job)
+        return -1;
+      // deep intermediate columns are kept only while the LRU has spare room
+      if (keep == Keep::Spare && lru.age.size() >= MaxRanges)
+        return -1;
+    }
+    else if (it->second.data)
+      return -1;
+    const auto ret = acquireSlot();
+    // every slot is pinned by readers, the pending entry is dropped so the column is requested again
+    // instead of staying empty forever
+    if (ret < 0 && it != std::end(range2Spec))
+      erase(key);
+    return ret;
+  }();
+  if (slot < 0)
+    return;
 
-    auto spec = internalGetSpec(job->first, job->second);
+  // the slot is not visible to anyone yet, so it is filled without holding the lock
+  const auto dst = lru.slab.get() + static_cast<size_t>(slot) * SpectrSize / 2;
+  memcpy(dst, spec, SpectrSize / 2 * sizeof(float));
 
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = range2Spec.find(key);
+  if (it == std::end(range2Spec))
+  {
+    if (keep == Keep::Job || (keep == Keep::Spare && lru.age.size() >= MaxRanges))
+    {
+      releaseSlot(slot);
+      return;
+    }
+    if (keep == Keep::Near)
     {
-      std::lock_guard<std::mutex> lock(mutex);
-      auto it = range2Spec.find(*job);
-      if (it == std::end(range2Spec))
-        continue;
-      it->second.spec = spec;
+      // the levels next to the job are what a zoom in looks at next, they take the place of the oldest entry
+      lru.age.emplace_front(this, key);
+      it = range2Spec.insert(std::make_pair(key, S{nullptr, -1, std::begin(lru.age)})).first;
+      evictOldest();
     }
+    else
+    {
+      // deep intermediate columns go to the back, so they never push out anything which is on the screen
+      lru.age.emplace_back(this, key);
+      it = range2Spec.insert(std::make_pair(key, S{nullptr, -1, std::prev(std::end(lru.age))})).first;
+    }
+  }
+  if (it->second.isQueued)
+  {
+    jobs.erase(std::make_pair(it->second.priority, key));
+    it->second.isQueued = false;
   }
+  if (it->second.data)
+  {
+    // somebody else was faster
+    releaseSlot(slot);
+    return;
+  }
+  it->second.data = dst;
+  it->second.slot = slot;
+}
+
+auto Spec::cacheKey() const -> uint64_t
+{
+  if (hash)
+    return *hash;
+  // FNV-1a over 64-bit words of the samples, mixed with everything that changes the column contents
+  const auto prime = uint64_t{0x100000001b3};
+  auto ret = uint64_t{0xcbf29ce484222325};
+  const auto mix = [&](uint64_t v) { ret = (ret ^ v) * prime; };
+  mix(SpectrSize);
+  mix(Hop);
+  mix(sizeof(FftReal));
+  {
+    auto decay = uint32_t{};
+    memcpy(&decay, &DecayRate, sizeof(decay));
+    mix(decay);
+  }
+  const auto decoded = wav.first(available);
+  mix(decoded.size());
+  const auto words = decoded.size() / 2;
+  const auto data = reinterpret_cast<const char *>(decoded.data());
+  for (auto i = 0U; i < words; ++i)
+  {
+    auto v = uint64_t{};
+    memcpy(&v, data + i * sizeof(v), sizeof(v));
+    mix(v);
+  }
+  if (decoded.size() % 2 != 0)
+  {
+    auto v = uint32_t{};
+    memcpy(&v, &decoded.back(), sizeof(v));
+    mix(v);
+  }
+  hash = ret;
+  return ret;
+}
+
+auto Spec::loadCache(const std::string &path) -> void
+{
+  if (!isComplete)
+    return;
+  auto file = std::make_unique<SpecFile>(path, cacheKey(), SpectrSize / 2);
+  std::lock_guard<std::mutex> lock(mutex);
+  diskCache = std::move(file);
+}
+
+auto Spec::saveCache(const std::string &path) const -> void
+{
+  if (!isComplete)
+    return;
+  const auto k = cacheKey();
+  std::lock_guard<std::mutex> lock(mutex);
+  // the most recently used columns go first, the columns of the old file which were not used during
+  // this session fill the rest
+  auto columns = std::vector<std::pair<Range, std::span<const float>>>{};
+  for (const auto &[owner, range] : lru.age)
+  {
+    if (owner != this)
+      continue;
+    const auto data = range2Spec.find(range)->second.data;
+    if (data)
+      columns.push_back(std::make_pair(range, std::span<const float>{data, SpectrSize / 2}));
+  }
+  if (diskCache)
+    for (const auto &range : diskCache->ranges())
+    {
+      if (columns.size() >= MaxRanges)
+        break;
+      if (range2Spec.find(range) == std::end(range2Spec))
+        columns.push_back(std::make_pair(range, diskCache->find(range)));
+    }
+  if (columns.empty())
+    return;
+  if (SpecFile::save(path, k, SpectrSize / 2, columns))
+    LOG("spectrum cache saved", path, "columns", columns.size());
 }
 
 Spec::~Spec()
 {
+  // the posted tasks hold this, they return right away once they see running is false
+  std::unique_lock<std::mutex> lock(mutex);
   running = false;
-  thread.join();
-  fftw_destroy_plan(plan);
-  fftw_free(input);
-  fftw_free(output);
+  tasksCv.wait(lock, [this]() { return tasks == 0; });
+  // the Column handles are gone, the entries give their slots back to the other Specs
+  while (!range2Spec.empty())
+    erase(std::begin(range2Spec)->first);
 }
@@ -1,39 +1,154 @@
 #pragma once
 #include "range.hpp"
+#include "sample-codec.hpp"
+#include "spec-file.hpp"
+#include "spec-kernels.hpp"
+#include <chrono>
+#include <condition_variable>
 #include <deque>
-#include <fftw3.h>
+#include <functional>
 #include <list>
+#include <memory>
+#include <optional>
+#include <set>
 #include <span>
-#include <thread>
-#include <unordered_set>
+#include <unordered_map>
 #include <vector>
 
 class Spec
 {
 public:
-  Spec(std::span<float> wav);
+  // read-only view of a spectrum column; the slab slot stays pinned while the handle is alive, so the
+  // column is never copied and never recycled under the reader
+  class Column
+  {
+  public:
+    Column() = default;
+    ~Column();
+    // disable copy
+    Column(const Column &) = delete;
+    Column &operator=(const Column &) = delete;
+    // moving
+    Column(Column &&other) noexcept;
+    Column &operator=(Column &&other) noexcept;
+
+    auto empty() const -> bool { return ptr == nullptr; }
+    auto data() const -> const float * { return ptr; }
+    auto size() const -> size_t { return empty() ? 0 : static_cast<size_t>(binCount()); }
+    auto operator[](size_t i) const -> float { return ptr[i]; }
+
+  private:
+    friend class Spec;
+    Column(const Spec *spec, int slot, const float *ptr) : spec(spec), slot(slot), ptr(ptr) {}
+    auto release() -> void;
+
+    const Spec *spec = nullptr;
+    int slot = -1;
+    const float *ptr = nullptr;
+  };
+
+  // onJobDone is called on a worker thread after every finished job, to wake up the UI; at most workers
+  // jobs run at once on the process-wide thread pool. The samples of a compressed project are pinned in
+  // blocks while a column reads them
+  Spec(std::span<float> wav,
+       std::function<void()> onJobDone = nullptr,
+       int workers = defaultWorkers(),
+       BlockCache *blocks = nullptr);
   ~Spec();
-  auto getSpec(int start, int end) const -> std::vector<float>;
+  // columns are addressed by (level, index), a level L column covers Hop * 2^L samples
+  static auto key(int start, int end) -> Range;
+  static auto samples(Range key) -> Range;
+  auto getSpec(Range key) const -> Column;
+  // computes a level 0 column on the calling thread, bypassing the workers and the cache; out holds
+  // binCount() values
+  auto computeColumn(Range key, float *out) const -> void;
+  static auto binCount() -> int;
+  // reprioritize pending jobs around the visible range and the playback cursor (all in samples), jobs
+  // too far outside of the visible range are cancelled
+  auto setFocus(int visibleStart, int visibleEnd, int cursor) -> void;
+  // the on-disk cache is keyed by the audio and the FFT settings, a cache computed for different audio
+  // is ignored and overwritten on the next save
+  auto loadCache(const std::string &path) -> void;
+  auto saveCache(const std::string &path) const -> void;
+
+  // while the file is decoding only the first samples of wav are valid, columns reaching past them are not
+  // computed and the disk cache is not used
+  auto setAvailable(size_t samples, bool isFinal) -> void;
+
+  static auto defaultWorkers() -> int;
+  // unique for the process, a Spec created at the address of a destroyed one has another id
+  auto id() const -> uint64_t { return uid; }
 
 private:
   std::span<float> wav;
-  mutable fftw_plan plan;
-  mutable fftw_complex *input;
-  mutable fftw_complex *output;
-  std::atomic<bool> running{false};
-  mutable std::mutex mutex;
-  mutable std::unordered_set<Range, pair_hash> jobs;
-  std::thread thread;
+  std::function<void()> onJobDone;
+  // nullptr unless the samples are a compressed chunk
+  BlockCache *blocks;
+  uint64_t uid;
+  std::atomic<size_t> available;
+  bool isComplete = true;
+  // the process wide plan, see sharedPlan
+  FftPlan plan;
+  int workers;
+  bool running = true;
+  // the columns of every Spec live in one slab allocated up front and share one LRU of MaxRanges
+  // entries, so the memory does not grow with the number of tracks; the lock of the LRU guards the
+  // state of every Spec
+  struct Shared;
+  static auto shared() -> Shared &;
+  Shared &lru;
+  std::mutex &mutex;
+  // signalled when a task posted to the thread pool is done
+  mutable std::condition_variable tasksCv;
+  // pending jobs ordered by priority, the lower the value the sooner the job runs
+  mutable std::set<std::pair<int64_t, Range>> jobs;
+  // tasks posted to the thread pool which have not returned yet, every task runs one job
+  mutable int tasks = 0;
+  int focusStart = 0;
+  int focusEnd = 0;
+  int focusCursor = 0;
+
+  // the entries of all Specs, the most recently used first
+  using Age = std::list<std::pair<const Spec *, Range>>;
 
   struct S
   {
-    std::vector<float> spec;
-    std::list<Range>::iterator age;
+    // points into the slab or into the mapped disk cache, nullptr while the column is not computed
+    const float *data = nullptr;
+    int slot = -1;
+    Age::iterator age;
+    int64_t priority = 0;
+    bool isQueued = false;
+    // when the job was queued, for the latency in the profiler
+    std::chrono::steady_clock::time_point queued = {};
   };
 
   mutable std::unordered_map<Range, S, pair_hash> range2Spec;
-  mutable std::list<Range> age;
+  std::unique_ptr<SpecFile> diskCache;
+  mutable std::optional<uint64_t> hash;
+
+  struct Worker;
+
+  // how store() keeps a column: a requested job; an intermediate level right below a job, kept like a
+  // requested column, so the views zoomed in from the job find it; or a deeper intermediate level, kept
+  // only while the LRU has spare room
+  enum class Keep
+  {
+    Job,
+    Near,
+    Spare
+  };
 
-  auto run() -> void;
-  auto internalGetSpec(int start, int end) const -> std::vector<float>;
+  auto acquireSlot() const -> int;
+  auto cacheKey() const -> uint64_t;
+  auto compute(Range key, float *out, Worker &) const -> void;
+  auto erase(Range key) const -> void;
+  auto evictOldest() const -> void;
+  auto internalGetSpec(int start, int end, Worker &, float *out) const -> void;
+  auto lookup(Range key) const -> Column;
+  auto priority(Range) const -> int64_t;
+  auto releaseSlot(int slot) const -> void;
+  auto runJob() const -> void;
+  auto schedule() const -> void;
+  auto store(Range key, const float *spec, Keep) const -> void;
 };
@@ -0,0 +1 @@
+#include "../grain-engine.cpp"
@@ -0,0 +1 @@
+#include "../grains.cpp"
@@ -0,0 +1,94 @@
+#include "../min-max-pyramid.hpp"
+#include "test.hpp"
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace
+{
+  auto noise(size_t n, unsigned seed) -> std::vector<float>
+  {
+    auto rng = std::mt19937{seed};
+    auto dist = std::uniform_real_distribution<float>{-1.f, 1.f};
+    auto ret = std::vector<float>(n);
+    for (auto &v : ret)
+      v = dist(rng);
+    return ret;
+  }
+
+  auto bruteForce(const std::vector<float> &wav, size_t start, size_t end) -> std::pair<float, float>
+  {
+    end = std::min(end, wav.size());
+    if (start >= end)
+      return {0.f, 0.f};
+    const auto [min, max] = std::minmax_element(wav.begin() + static_cast<ptrdiff_t>(start),
+                                                wav.begin() + static_cast<ptrdiff_t>(end));
+    return {*min, *max};
+  }
+
+  // ranges of every length up to a few blocks of the first stored level, then random ones up to the end
+  template <typename F>
+  auto forRanges(size_t n, unsigned seed, F &&f) -> void
+  {
+    for (auto start = size_t{0}; start < 40; ++start)
+      for (auto end = start; end < 80; ++end)
+        f(start, end);
+    auto rng = std::mt19937{seed};
+    auto dist = std::uniform_int_distribution<size_t>{0, n + 10};
+    for (auto i = 0; i < 2000; ++i)
+    {
+      const auto a = dist(rng);
+      const auto b = dist(rng);
+      f(std::min(a, b), std::max(a, b));
+    }
+    f(0, n);
+  }
+} // namespace
+
+auto testPyramidQuery() -> void
+{
+  const auto wav = noise(100'003, 5);
+  auto pyramid = MinMaxPyramid<float>{};
+  pyramid.extend(wav);
+  forRanges(wav.size(), 6, [&](size_t start, size_t end) {
+    CHECK(pyramid.minMax(start, end) == bruteForce(wav, start, end));
+  });
+}
+
+auto testPyramidQuantized() -> void
+{
+  const auto wav = noise(100'003, 7);
+  auto pyramid = MinMaxPyramid<int16_t>{};
+  pyramid.extend(wav);
+  // the min is rounded down and the max up, by less than a step of 16 bits
+  const auto step = 2.f / 32767.f;
+  forRanges(wav.size(), 8, [&](size_t start, size_t end) {
+    const auto [min, max] = pyramid.minMax(start, end);
+    const auto [expectedMin, expectedMax] = bruteForce(wav, start, end);
+    CHECK(min <= expectedMin && min > expectedMin - step);
+    CHECK(max >= expectedMax && max < expectedMax + step);
+  });
+}
+
+auto testPyramidExtend() -> void
+{
+  // the samples arrive in pieces the way the decoder writes them, into the buffer reserved up front and
+  // past it
+  const auto wav = noise(300'000, 9);
+  auto pyramid = MinMaxPyramid<float>{};
+  pyramid.reserve(200'000);
+  auto rng = std::mt19937{10};
+  auto dist = std::uniform_int_distribution<size_t>{1, 20'000};
+  for (auto size = size_t{0}; size < wav.size();)
+  {
+    size = std::min(wav.size(), size + dist(rng));
+    pyramid.extend({wav.data(), size});
+    // a query past the samples so far is clipped to them
+    CHECK(pyramid.minMax(0, wav.size()) == bruteForce(wav, 0, size));
+    CHECK(pyramid.minMax(size / 3, size - 1) == bruteForce(wav, size / 3, size - 1));
+  }
+  forRanges(wav.size(), 11, [&](size_t start, size_t end) {
+    CHECK(pyramid.minMax(start, end) == bruteForce(wav, start, end));
+  });
+}
@@ -0,0 +1 @@
+#include "../min-max-pyramid.cpp"
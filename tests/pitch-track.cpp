@@ -0,0 +1 @@
+#include "../pitch-track.cpp"
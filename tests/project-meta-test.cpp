@@ -0,0 +1,187 @@
+#include "../project-meta.hpp"
+#include "test.hpp"
+#include <ser/istrm.hpp>
+#include <ser/ser.hpp>
+
+namespace
+{
+  // the layouts of the older versions as they are in the files, written the way those versions wrote them
+  struct WriteV3
+  {
+    int sampleRate;
+    float brightness;
+    std::vector<Marker> markers;
+    float tempo;
+    GrainIndex grains;
+
+#define SER_PROP_LIST   \
+  SER_PROP(sampleRate); \
+  SER_PROP(brightness); \
+  SER_PROP(markers);    \
+  SER_PROP(tempo);      \
+  SER_PROP(grains);
+
+    SER_DEF_PROPS()
+#undef SER_PROP_LIST
+  };
+
+  struct WriteV4
+  {
+    int sampleRate;
+    float brightness;
+    std::vector<Marker> markers;
+    float tempo;
+    GrainIndex grains;
+    PitchTrack pitchTrack;
+
+#define SER_PROP_LIST   \
+  SER_PROP(sampleRate); \
+  SER_PROP(brightness); \
+  SER_PROP(markers);    \
+  SER_PROP(tempo);      \
+  SER_PROP(grains);     \
+  SER_PROP(pitchTrack);
+
+    SER_DEF_PROPS()
+#undef SER_PROP_LIST
+  };
+
+  auto grains(int count) -> GrainIndex
+  {
+    auto ret = GrainIndex{};
+    for (auto i = 0; i < count; ++i)
+      ret.push_back(Grain{i * 1500, 1500 + i % 3, i % 3});
+    return ret;
+  }
+
+  auto pitchTrack(size_t count) -> PitchTrack
+  {
+    auto ret = PitchTrack{};
+    ret.resize(count);
+    for (auto i = 0U; i < count; i += 2)
+      ret.set(i, 40.f + static_cast<float>(i) / 4.f);
+    return ret;
+  }
+
+  auto isSame(const GrainIndex &a, const GrainIndex &b) -> bool
+  {
+    if (a.size() != b.size())
+      return false;
+    for (auto i = 0U; i < a.size(); ++i)
+      if (a[i].start != b[i].start || a[i].size != b[i].size || a[i].deviation != b[i].deviation)
+        return false;
+    return true;
+  }
+
+  auto isSame(const PitchTrack &a, const PitchTrack &b) -> bool
+  {
+    if (a.size() != b.size())
+      return false;
+    for (auto i = 0U; i < a.size(); ++i)
+      if (a.note(i) != b.note(i))
+        return false;
+    return true;
+  }
+
+  auto isSame(const std::vector<Marker> &a, const std::vector<Marker> &b) -> bool
+  {
+    if (a.size() != b.size())
+      return false;
+    for (auto i = 0U; i < a.size(); ++i)
+      if (a[i].sample != b[i].sample || a[i].note != b[i].note || a[i].dTime != b[i].dTime ||
+          a[i].pitchBend != b[i].pitchBend)
+        return false;
+    return true;
+  }
+
+  template <typename T>
+  auto serialize(const T &v) -> std::string
+  {
+    OStrm st;
+    ::ser(st, v);
+    return st.str();
+  }
+
+  const auto Markers = std::vector<Marker>{{0, 60., 0., 0.}, {44100, 62.5, -.25, .5}};
+} // namespace
+
+auto testMetaV3() -> void
+{
+  // version 3 has no pitch track, the loaded track has none so it is detected again
+  const auto data = serialize(WriteV3{48000, 1.5f, Markers, 96.f, grains(10)});
+  auto sampleRate = 0;
+  auto brightness = 0.f;
+  auto tempo = 0.f;
+  auto tracks = std::vector<std::unique_ptr<Track>>{};
+  loadMeta(data, 3, MetaSettings{sampleRate, brightness, tempo}, "song", tracks);
+  CHECK(sampleRate == 48000 && brightness == 1.5f && tempo == 96.f);
+  CHECK(tracks.size() == 1);
+  if (tracks.size() != 1)
+    return;
+  CHECK(tracks[0]->name == "song");
+  CHECK(isSame(tracks[0]->markers, Markers));
+  CHECK(isSame(tracks[0]->grains, grains(10)));
+  CHECK(tracks[0]->pitchTrack.empty() && !tracks[0]->pitchTrack.isValid(tracks[0]->grains));
+}
+
+auto testMetaV4() -> void
+{
+  // version 4 has the pitch track of its single track
+  const auto data = serialize(WriteV4{44100, 2.f, Markers, 120.f, grains(10), pitchTrack(10)});
+  auto sampleRate = 0;
+  auto brightness = 0.f;
+  auto tempo = 0.f;
+  auto tracks = std::vector<std::unique_ptr<Track>>{};
+  loadMeta(data, 4, MetaSettings{sampleRate, brightness, tempo}, "song", tracks);
+  CHECK(sampleRate == 44100 && brightness == 2.f && tempo == 120.f);
+  CHECK(tracks.size() == 1);
+  if (tracks.size() != 1)
+    return;
+  CHECK(tracks[0]->name == "song");
+  CHECK(isSame(tracks[0]->markers, Markers));
+  CHECK(isSame(tracks[0]->grains, grains(10)));
+  CHECK(isSame(tracks[0]->pitchTrack, pitchTrack(10)) && tracks[0]->pitchTrack.isValid(tracks[0]->grains));
+}
+
+auto testMetaV5() -> void
+{
+  // the current version takes every track with its own settings and pitch track
+  auto sampleRate = 32000;
+  auto brightness = .5f;
+  auto tempo = 140.f;
+  auto tracks = std::vector<std::unique_ptr<Track>>{};
+  for (auto i = 0; i < 3; ++i)
+  {
+    tracks.push_back(std::make_unique<Track>());
+    auto &t = *tracks.back();
+    t.name = "stem " + std::to_string(i);
+    t.gain = .25f * static_cast<float>(i + 1);
+    t.isMuted = i == 1;
+    t.markers = i == 2 ? std::vector<Marker>{} : Markers;
+    t.grains = grains(5 + i);
+    // the second track was saved before its detection was done
+    if (i != 1)
+      t.pitchTrack = pitchTrack(t.grains.size());
+  }
+  const auto data = saveMeta(MetaSettings{sampleRate, brightness, tempo}, tracks);
+
+  auto loadedRate = 0;
+  auto loadedBrightness = 0.f;
+  auto loadedTempo = 0.f;
+  auto loaded = std::vector<std::unique_ptr<Track>>{};
+  loadMeta(data, 5, MetaSettings{loadedRate, loadedBrightness, loadedTempo}, "ignored", loaded);
+  CHECK(loadedRate == sampleRate && loadedBrightness == brightness && loadedTempo == tempo);
+  CHECK(loaded.size() == tracks.size());
+  if (loaded.size() != tracks.size())
+    return;
+  for (auto i = 0U; i < tracks.size(); ++i)
+  {
+    const auto &a = *tracks[i];
+    const auto &b = *loaded[i];
+    CHECK(a.name == b.name && a.gain == b.gain && a.isMuted == b.isMuted);
+    CHECK(isSame(a.markers, b.markers));
+    CHECK(isSame(a.grains, b.grains));
+    CHECK(isSame(a.pitchTrack, b.pitchTrack));
+  }
+  CHECK(loaded[1]->pitchTrack.empty());
+}
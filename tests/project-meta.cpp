@@ -0,0 +1 @@
+#include "../project-meta.cpp"
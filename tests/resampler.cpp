@@ -0,0 +1 @@
+#include "../resampler.cpp"
@@ -0,0 +1,107 @@
+#include "../sample-codec.hpp"
+#include "test.hpp"
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace
+{
+  const auto BlockSize = BlockCache::BlockSize;
+  // the sample count, the block size and the block count come before the block offsets
+  const auto ChunkHeaderSize = sizeof(uint64_t) + 2 * sizeof(uint32_t);
+
+  // 16-bit PCM noise, which is what the predictor encodes
+  auto pcm16(size_t n, unsigned seed) -> std::vector<float>
+  {
+    auto rng = std::mt19937{seed};
+    auto dist = std::uniform_int_distribution<int>{-2000, 2000};
+    auto ret = std::vector<float>(n);
+    for (auto &v : ret)
+      v = static_cast<float>(dist(rng)) / 32768.f;
+    return ret;
+  }
+
+  // all samples of the chunk, decompressed through a cache which keeps them all
+  auto decompress(std::span<const char> chunk) -> std::vector<float>
+  {
+    auto cache = BlockCache{nullptr, chunk, (compressedSampleCount(chunk) + BlockSize - 1) / BlockSize};
+    const auto pin = cache.pin(0, cache.size());
+    return std::vector<float>(cache.data(), cache.data() + cache.size());
+  }
+
+  auto isBitExact(const std::vector<float> &a, const std::vector<float> &b) -> bool
+  {
+    return a.size() == b.size() && memcmp(a.data(), b.data(), a.size() * sizeof(float)) == 0;
+  }
+} // namespace
+
+auto testCodecRoundTrip() -> void
+{
+  // two predicted blocks, a raw one in the middle and a short last block
+  auto wav = pcm16(3 * BlockSize + 123, 1);
+  auto rng = std::mt19937{2};
+  auto dist = std::uniform_real_distribution<float>{-1.f, 1.f};
+  for (auto i = BlockSize; i < 2 * BlockSize; ++i)
+    wav[i] = dist(rng);
+  const auto chunk = compressSamples(wav);
+  CHECK(compressedSampleCount(chunk) == wav.size());
+  CHECK(chunk.size() < wav.size() * sizeof(float));
+  CHECK(isBitExact(decompress(chunk), wav));
+}
+
+auto testCodecEscapes() -> void
+{
+  // quiet partitions with full scale spikes, the residuals of the spikes are far above the Rice parameter
+  auto wav = std::vector<float>(BlockSize + 5000, 0.f);
+  for (auto i = 0U; i < wav.size(); ++i)
+    wav[i] = static_cast<float>(static_cast<int>(i % 7) - 3) / 32768.f;
+  for (const auto i : {size_t{0}, size_t{1}, size_t{4095}, size_t{4096}, size_t{30000}, BlockSize - 1})
+    wav[i] = i % 2 == 0 ? 32767.f / 32768.f : -1.f;
+  // a ramp to the extremes and back, the second order residuals are as large as they get
+  for (auto i = 0U; i < 64; ++i)
+    wav[BlockSize + 100 + i] = i % 2 == 0 ? -1.f : 32767.f / 32768.f;
+  const auto chunk = compressSamples(wav);
+  CHECK(chunk.size() < wav.size() * sizeof(float));
+  CHECK(isBitExact(decompress(chunk), wav));
+}
+
+auto testCodecBlockBoundaries() -> void
+{
+  // the last block has a single sample, shorter than the warm-up of the predictor
+  const auto wav = pcm16(2 * BlockSize + 1, 3);
+  const auto chunk = compressSamples(wav);
+  // one block of budget, the blocks not pinned are evicted
+  auto cache = BlockCache{nullptr, chunk, 1};
+  CHECK(cache.size() == wav.size());
+  {
+    const auto pin = cache.pin(BlockSize - 10, BlockSize + 10);
+    CHECK(memcmp(cache.data() + BlockSize - 10, wav.data() + BlockSize - 10, 20 * sizeof(float)) == 0);
+    CHECK(cache.tryRead(BlockSize - 10, BlockSize + 10));
+    cache.endRead(BlockSize - 10, BlockSize + 10);
+    CHECK(!cache.tryRead(0, wav.size()));
+  }
+  // the unpinned blocks are over the budget, only the most recently used one stays
+  CHECK(!cache.tryRead(BlockSize - 1, BlockSize + 1));
+  {
+    const auto pin = cache.pin(wav.size() - 1, wav.size());
+    CHECK(cache.data()[wav.size() - 1] == wav.back());
+    CHECK(cache.tryRead(wav.size() - 1, wav.size()));
+    cache.endRead(wav.size() - 1, wav.size());
+  }
+}
+
+auto testCodecMalformed() -> void
+{
+  const auto wav = pcm16(BlockSize + 10, 4);
+  auto chunk = compressSamples(wav);
+  CHECK(compressedSampleCount(std::span<const char>{chunk}.first(8)) == 0);
+  CHECK(BlockCache(nullptr, std::span<const char>{chunk}.first(8), 1).size() == 0);
+  // the end of the second block points past the chunk, the block stays silent and the first one decodes
+  const auto end = uint64_t{chunk.size() + 1};
+  memcpy(chunk.data() + ChunkHeaderSize + 2 * sizeof(uint64_t), &end, sizeof(end));
+  const auto samples = decompress(chunk);
+  CHECK(samples.size() == wav.size());
+  CHECK(samples[BlockSize] == 0.f && samples[BlockSize + 9] == 0.f);
+  CHECK(memcmp(samples.data(), wav.data(), BlockSize * sizeof(float)) == 0);
+}
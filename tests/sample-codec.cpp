@@ -0,0 +1 @@
+#include "../sample-codec.cpp"
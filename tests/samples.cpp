@@ -0,0 +1 @@
+#include "../samples.cpp"
@@ -0,0 +1,109 @@
+#include "../save-wav.hpp"
+#include "test.hpp"
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace
+{
+  // RIFF and WAVE, the JUNK chunk reserving the ds64 room and the fmt chunk come before the data chunk
+  const auto DataChunkPos = size_t{12 + 8 + 28 + 8 + 16};
+
+  auto tempPath(const std::string &name) -> std::string
+  {
+    return (std::filesystem::temp_directory_path() / ("melonix-test-" + name + ".wav")).string();
+  }
+
+  auto readFile(const std::string &path) -> std::vector<char>
+  {
+    auto f = std::ifstream{path, std::ios::binary};
+    return std::vector<char>(std::istreambuf_iterator<char>{f}, std::istreambuf_iterator<char>{});
+  }
+
+  auto tag(const std::vector<char> &file, size_t pos) -> std::string
+  {
+    return pos + 4 <= file.size() ? std::string(file.data() + pos, 4) : std::string{};
+  }
+
+  // little endian
+  auto word(const std::vector<char> &file, size_t pos, int size) -> uint64_t
+  {
+    auto ret = uint64_t{0};
+    for (auto i = size - 1; i >= 0; --i)
+      ret = ret << 8 | static_cast<uint8_t>(file[pos + static_cast<size_t>(i)]);
+    return ret;
+  }
+
+  auto write(const std::string &path,
+             WavWriter::Format format,
+             const std::vector<float> &samples,
+             uint64_t maxRiffSize = std::numeric_limits<uint32_t>::max()) -> std::vector<char>
+  {
+    {
+      auto writer = WavWriter{path, 44100, format, maxRiffSize};
+      CHECK(writer.isOk());
+      // in uneven pieces, a few of them larger than the conversion buffer
+      for (auto pos = size_t{0}, n = size_t{1}; pos < samples.size(); pos += n, n = n * 7 + 1)
+        writer.write(std::span<const float>{samples}.subspan(pos, std::min(n, samples.size() - pos)));
+      CHECK(writer.close());
+    }
+    auto ret = readFile(path);
+    std::filesystem::remove(path);
+    return ret;
+  }
+} // namespace
+
+auto testWavPadByte() -> void
+{
+  // three 24 bit samples are an odd data chunk, the pad byte follows it and counts for the RIFF size only
+  const auto file = write(tempPath("pad"), WavWriter::Format::Pcm24, {.5f, -1.f, 1.f});
+  CHECK(file.size() == DataChunkPos + 8 + 9 + 1);
+  CHECK(tag(file, 0) == "RIFF" && word(file, 4, 4) == file.size() - 8 && tag(file, 8) == "WAVE");
+  CHECK(tag(file, 12) == "JUNK");
+  CHECK(tag(file, DataChunkPos) == "data" && word(file, DataChunkPos + 4, 4) == 9);
+  CHECK(word(file, DataChunkPos + 8, 3) == 4194304);
+  CHECK(word(file, DataChunkPos + 11, 3) == (0x1000000 - 8388607));
+  CHECK(word(file, DataChunkPos + 14, 3) == 8388607);
+  CHECK(file.back() == 0);
+}
+
+auto testWavRiff() -> void
+{
+  // more samples than the conversion buffer holds, the float samples are stored as they are
+  auto samples = std::vector<float>(500'000);
+  for (auto i = 0U; i < samples.size(); ++i)
+    samples[i] = static_cast<float>(i % 1000) / 1000.f - .5f;
+  const auto file = write(tempPath("riff"), WavWriter::Format::Float32, samples);
+  CHECK(file.size() == DataChunkPos + 8 + samples.size() * sizeof(float));
+  CHECK(tag(file, 0) == "RIFF" && word(file, 4, 4) == file.size() - 8);
+  CHECK(word(file, DataChunkPos + 4, 4) == samples.size() * sizeof(float));
+  CHECK(file.size() >= DataChunkPos + 8 &&
+        memcmp(file.data() + DataChunkPos + 8, samples.data(), samples.size() * sizeof(float)) == 0);
+}
+
+auto testWavRf64() -> void
+{
+  // the limit is lowered, a file over it gets the RF64 header with the real sizes in the ds64 chunk which
+  // takes the place of the JUNK chunk
+  const auto samples = std::vector<float>(1001, .25f);
+  const auto file = write(tempPath("rf64"), WavWriter::Format::Pcm16, samples, 1000);
+  const auto dataSize = samples.size() * 2;
+  CHECK(file.size() == DataChunkPos + 8 + dataSize);
+  CHECK(tag(file, 0) == "RF64" && word(file, 4, 4) == 0xFFFFFFFFU && tag(file, 8) == "WAVE");
+  CHECK(tag(file, 12) == "ds64" && word(file, 16, 4) == 28);
+  CHECK(word(file, 20, 8) == file.size() - 8);
+  CHECK(word(file, 28, 8) == dataSize);
+  CHECK(word(file, 36, 8) == samples.size());
+  CHECK(word(file, 44, 4) == 0);
+  CHECK(tag(file, 48) == "fmt ");
+  CHECK(tag(file, DataChunkPos) == "data" && word(file, DataChunkPos + 4, 4) == 0xFFFFFFFFU);
+  CHECK(word(file, DataChunkPos + 8, 2) == 8191);
+
+  // at the limit it stays RIFF
+  const auto atLimit = write(tempPath("rf64"), WavWriter::Format::Pcm16, samples, file.size() - 8);
+  CHECK(tag(atLimit, 0) == "RIFF" && tag(atLimit, 12) == "JUNK");
+}
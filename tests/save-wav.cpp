@@ -0,0 +1 @@
+#include "../save-wav.cpp"
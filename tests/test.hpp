@@ -0,0 +1,40 @@
+#pragma once
+
+// A test is a function listed in tests.cpp with the request it covers. CHECK logs the failed condition and
+// marks the running test as failed, the test goes on so one run shows all of its failures.
+auto fail(const char *file, int line, const char *condition) -> void;
+
+#define CHECK(condition)                    \
+  do                                        \
+  {                                         \
+    if (!(condition))                       \
+      fail(__FILE__, __LINE__, #condition); \
+  } while (false)
+
+// sample-codec-test.cpp
+auto testCodecRoundTrip() -> void;
+auto testCodecEscapes() -> void;
+auto testCodecBlockBoundaries() -> void;
+auto testCodecMalformed() -> void;
+
+// thread-pool-test.cpp
+auto testPoolCoversRange() -> void;
+auto testPoolSmallRanges() -> void;
+auto testPoolNested() -> void;
+auto testPoolBusyWorkers() -> void;
+auto testPoolPostOrder() -> void;
+
+// save-wav-test.cpp
+auto testWavPadByte() -> void;
+auto testWavRiff() -> void;
+auto testWavRf64() -> void;
+
+// min-max-pyramid-test.cpp
+auto testPyramidQuery() -> void;
+auto testPyramidQuantized() -> void;
+auto testPyramidExtend() -> void;
+
+// project-meta-test.cpp
+auto testMetaV3() -> void;
+auto testMetaV4() -> void;
+auto testMetaV5() -> void;
@@ -0,0 +1,71 @@
+// Headless tests of the modules which do not need a window, an audio device or the files of a user.
+//
+// The tested modules are the app's own sources: coddle builds all .cpp files of a directory into one
+// target, so the files without a -test suffix forward to the source in the parent directory.
+//
+//   tests [substring]
+//
+// runs every test, or the ones whose request or name contain the substring; the exit code is the number
+// of failed tests.
+#include "test.hpp"
+#include <cstdio>
+#include <cstring>
+#include <log/log.hpp>
+
+namespace
+{
+  struct Test
+  {
+    // the request whose behavior the test covers
+    const char *request;
+    const char *name;
+    void (*run)();
+  };
+
+  const Test tests[] = {
+    {"user-018", "codec round trip", testCodecRoundTrip},
+    {"user-018", "codec escapes", testCodecEscapes},
+    {"user-018", "codec block boundaries", testCodecBlockBoundaries},
+    {"user-018", "codec malformed chunks", testCodecMalformed},
+    {"user-019", "thread pool covers the range", testPoolCoversRange},
+    {"user-019", "thread pool small ranges", testPoolSmallRanges},
+    {"user-019", "thread pool nested loops", testPoolNested},
+    {"user-019", "thread pool busy workers", testPoolBusyWorkers},
+    {"user-019", "thread pool post order", testPoolPostOrder},
+    {"user-020", "wav pad byte", testWavPadByte},
+    {"user-020", "wav riff sizes", testWavRiff},
+    {"user-020", "wav rf64 switch", testWavRf64},
+    {"user-021", "pyramid query", testPyramidQuery},
+    {"user-021", "pyramid quantized query", testPyramidQuantized},
+    {"user-021", "pyramid incremental extend", testPyramidExtend},
+    {"user-029", "project meta version 3 without pitch track", testMetaV3},
+    {"user-029", "project meta version 4 with pitch track", testMetaV4},
+    {"user-030", "project meta version 5 with several tracks", testMetaV5},
+  };
+
+  auto failures = 0;
+} // namespace
+
+auto fail(const char *file, int line, const char *condition) -> void
+{
+  LOG("check failed", file, line, condition);
+  ++failures;
+}
+
+auto main(int argc, char **argv) -> int
+{
+  const auto filter = argc > 1 ? argv[1] : "";
+  auto failed = 0;
+  for (const auto &test : tests)
+  {
+    if (!strstr(test.request, filter) && !strstr(test.name, filter))
+      continue;
+    failures = 0;
+    test.run();
+    printf("[%s] %s: %s\n", test.request, test.name, failures == 0 ? "ok" : "FAILED");
+    fflush(stdout);
+    if (failures != 0)
+      ++failed;
+  }
+  return failed;
+}
@@ -0,0 +1,97 @@
+#include "../thread-pool.hpp"
+#include "test.hpp"
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+auto testPoolCoversRange() -> void
+{
+  auto pool = ThreadPool{3};
+  const auto n = size_t{100'003};
+  const auto minChunk = size_t{1000};
+  auto hits = std::make_unique<std::atomic<int>[]>(n);
+  auto mutex = std::mutex{};
+  auto ranges = std::vector<std::pair<size_t, size_t>>{};
+  pool.parallelFor(n, minChunk, [&](size_t begin, size_t end) {
+    for (auto i = begin; i < end; ++i)
+      ++hits[i];
+    std::lock_guard<std::mutex> lock(mutex);
+    ranges.emplace_back(begin, end);
+  });
+  auto isOnce = true;
+  for (auto i = size_t{0}; i < n; ++i)
+    isOnce = isOnce && hits[i] == 1;
+  CHECK(isOnce);
+  CHECK(ranges.size() > 1);
+  // only the range at the end can be shorter
+  for (const auto &[begin, end] : ranges)
+    CHECK(end - begin >= minChunk || end == n);
+}
+
+auto testPoolSmallRanges() -> void
+{
+  auto pool = ThreadPool{3};
+  // a single range runs on the calling thread, an empty one not at all
+  auto calls = 0;
+  auto thread = std::thread::id{};
+  pool.parallelFor(999, 1000, [&](size_t begin, size_t end) {
+    CHECK(begin == 0 && end == 999);
+    ++calls;
+    thread = std::this_thread::get_id();
+  });
+  CHECK(calls == 1 && thread == std::this_thread::get_id());
+  pool.parallelFor(0, 1, [&](size_t, size_t) { ++calls; });
+  CHECK(calls == 1);
+}
+
+auto testPoolNested() -> void
+{
+  // the outer ranges take all workers, the inner loops make progress on the calling threads
+  auto pool = ThreadPool{2};
+  auto sum = std::atomic<size_t>{0};
+  pool.parallelFor(16, 1, [&](size_t begin, size_t end) {
+    for (auto i = begin; i < end; ++i)
+      pool.parallelFor(1000, 10, [&](size_t b, size_t e) { sum += e - b; });
+  });
+  CHECK(sum == 16 * 1000);
+}
+
+auto testPoolBusyWorkers() -> void
+{
+  // every worker waits for the caller, which still gets its loop done on its own
+  auto pool = ThreadPool{2};
+  auto release = std::promise<void>{};
+  const auto released = release.get_future().share();
+  auto waiting = std::atomic<int>{0};
+  for (auto i = 0; i < pool.size(); ++i)
+    pool.post([&waiting, released]() {
+      ++waiting;
+      released.wait();
+    });
+  while (waiting < pool.size())
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  auto sum = std::atomic<size_t>{0};
+  pool.parallelFor(10'000, 100, [&](size_t begin, size_t end) { sum += end - begin; });
+  CHECK(sum == 10'000);
+  release.set_value();
+}
+
+auto testPoolPostOrder() -> void
+{
+  // with one worker the tasks run one after the other in the order they were posted
+  auto pool = ThreadPool{1};
+  auto order = std::vector<int>{};
+  auto done = std::promise<void>{};
+  for (auto i = 0; i < 100; ++i)
+    pool.post([&order, i]() { order.push_back(i); });
+  pool.post([&done]() { done.set_value(); });
+  done.get_future().wait();
+  auto isInOrder = order.size() == 100;
+  for (auto i = 0U; i < order.size(); ++i)
+    isInOrder = isInOrder && order[i] == static_cast<int>(i);
+  CHECK(isInOrder);
+}
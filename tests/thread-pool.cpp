@@ -0,0 +1 @@
+#include "../thread-pool.cpp"
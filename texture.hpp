@@ -1,12 +1,7 @@
 #pragma once
+#include "gl.hpp"
 #include <imgui/imgui.h>
 
-#if defined(IMGUI_IMPL_OPENGL_ES2)
-#include <SDL_opengles2.h>
-#else
-#include <SDL_opengl.h>
-#endif
-
 class Texture
 {
 public:
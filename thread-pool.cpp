@@ -0,0 +1,102 @@
+#include "thread-pool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+auto threadPool() -> ThreadPool &
+{
+  static auto instance = ThreadPool{static_cast<int>(std::thread::hardware_concurrency()) - 1};
+  return instance;
+}
+
+ThreadPool::ThreadPool(int workers)
+{
+  for (auto i = 0; i < std::max(1, workers); ++i)
+    threads.emplace_back(&ThreadPool::run, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    isStopping = true;
+  }
+  cv.notify_all();
+  for (auto &thread : threads)
+    thread.join();
+}
+
+auto ThreadPool::post(std::function<void()> task) -> void
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    tasks.push_back(std::move(task));
+  }
+  cv.notify_one();
+}
+
+auto ThreadPool::run() -> void
+{
+  for (;;)
+  {
+    auto task = std::function<void()>{};
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      cv.wait(lock, [this]() { return isStopping || !tasks.empty(); });
+      if (isStopping)
+        return;
+      task = std::move(tasks.front());
+      tasks.pop_front();
+    }
+    task();
+  }
+}
+
+auto ThreadPool::parallelFor(size_t n, size_t minChunk, const std::function<void(size_t, size_t)> &f)
+  -> void
+{
+  const auto chunk = std::max<size_t>({size_t{1}, minChunk, (n + threads.size()) / (threads.size() + 1)});
+  const auto chunks = (n + chunk - 1) / chunk;
+  if (chunks <= 1)
+  {
+    if (n > 0)
+      f(0, n);
+    return;
+  }
+
+  // the helpers can start after the caller returned, they only touch the shared batch then
+  struct Batch
+  {
+    const std::function<void(size_t, size_t)> *f;
+    size_t n;
+    size_t chunk;
+    size_t chunks;
+    std::atomic<size_t> next = 0;
+    std::atomic<size_t> done = 0;
+    std::mutex mutex;
+    std::condition_variable cv;
+
+    auto work() -> void
+    {
+      for (auto i = next++; i < chunks; i = next++)
+      {
+        (*f)(i * chunk, std::min(n, (i + 1) * chunk));
+        if (++done == chunks)
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          cv.notify_all();
+        }
+      }
+    }
+  };
+  const auto batch = std::make_shared<Batch>();
+  batch->f = &f;
+  batch->n = n;
+  batch->chunk = chunk;
+  batch->chunks = chunks;
+  for (auto i = size_t{1}; i < std::min(chunks, threads.size() + 1); ++i)
+    post([batch]() { batch->work(); });
+  batch->work();
+  std::unique_lock<std::mutex> lock(batch->mutex);
+  batch->cv.wait(lock, [&]() { return batch->done == chunks; });
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Worker threads started once for the whole process. The analysis passes, the export and the spectrum
+// jobs post their work here instead of starting threads per call.
+class ThreadPool
+{
+public:
+  explicit ThreadPool(int workers);
+  ~ThreadPool();
+  // disable copy
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  // runs the task on a worker, tasks run in the order they are posted
+  auto post(std::function<void()>) -> void;
+  // calls f(begin, end) for about equal ranges of [0, n), ranges are at least minChunk long; the caller
+  // takes ranges as well, so it makes progress even when all workers are busy and it can be nested
+  auto parallelFor(size_t n, size_t minChunk, const std::function<void(size_t, size_t)> &f) -> void;
+  auto size() const -> int { return static_cast<int>(threads.size()); }
+
+private:
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::deque<std::function<void()>> tasks;
+  bool isStopping = false;
+  std::vector<std::thread> threads;
+
+  auto run() -> void;
+};
+
+// one worker per core besides the calling thread
+auto threadPool() -> ThreadPool &;
@@ -0,0 +1,144 @@
+#include "time-map.hpp"
+#include <algorithm>
+
+TimeMap::TimeMap(std::vector<Marker> markers, int sampleRate, int sampleCount)
+  : sampleRate(sampleRate), sampleCount(sampleCount)
+{
+  samples.push_back(0);
+  times.push_back(0);
+  maxTimes.push_back(0);
+  pitchBends.push_back(0);
+  build(markers, 0);
+}
+
+TimeMap::TimeMap(const TimeMap &prev, size_t firstChanged, std::vector<Marker> markers)
+  : sampleRate(prev.sampleRate), sampleCount(prev.sampleCount)
+{
+  // knot k + 1 is the marker k, so the knots up to firstChanged are still valid
+  const auto keep = std::min(firstChanged, prev.samples.size() - 1) + 1;
+  samples.assign(std::begin(prev.samples), std::begin(prev.samples) + keep);
+  times.assign(std::begin(prev.times), std::begin(prev.times) + keep);
+  maxTimes.assign(std::begin(prev.maxTimes), std::begin(prev.maxTimes) + keep);
+  pitchBends.assign(std::begin(prev.pitchBends), std::begin(prev.pitchBends) + keep);
+  build(markers, keep - 1);
+}
+
+auto TimeMap::build(const std::vector<Marker> &markers, size_t firstChanged) -> void
+{
+  samples.reserve(markers.size() + 1);
+  times.reserve(markers.size() + 1);
+  maxTimes.reserve(markers.size() + 1);
+  pitchBends.reserve(markers.size() + 1);
+  for (auto i = firstChanged; i < markers.size(); ++i)
+  {
+    const auto &marker = markers[i];
+    const auto time = times.back() + 1.0 * (marker.sample - samples.back()) / sampleRate + marker.dTime;
+    samples.push_back(marker.sample);
+    times.push_back(time);
+    maxTimes.push_back(std::max(maxTimes.back(), time));
+    pitchBends.push_back(marker.pitchBend);
+  }
+  dur = sample2Time(sampleCount - 1);
+}
+
+auto TimeMap::sample2Time(int val) const -> double
+{
+  if (val <= 0)
+    return 1. * val / sampleRate;
+
+  // first knot at or after the sample, the knot before it is strictly before
+  const auto k = static_cast<size_t>(std::lower_bound(std::begin(samples) + 1, std::end(samples), val) -
+                                     std::begin(samples));
+  if (k == samples.size())
+    return times.back() + 1. * (val - samples.back()) / sampleRate;
+
+  return times[k - 1] + (val - samples[k - 1]) * (times[k] - times[k - 1]) / (samples[k] - samples[k - 1]);
+}
+
+auto TimeMap::findTime(double val) const -> size_t
+{
+  return static_cast<size_t>(std::lower_bound(std::begin(maxTimes) + 1, std::end(maxTimes), val) -
+                             std::begin(maxTimes));
+}
+
+auto TimeMap::segment2Sample(size_t k, double val) const -> int
+{
+  if (k == samples.size())
+    return static_cast<int>(samples.back() + (val - times.back()) * sampleRate);
+
+  return static_cast<int>(samples[k - 1] +
+                          (val - times[k - 1]) * (samples[k] - samples[k - 1]) / (times[k] - times[k - 1]));
+}
+
+auto TimeMap::segment2PitchBend(size_t k, double val) const -> float
+{
+  if (k == samples.size())
+  {
+    if (val > dur)
+      return 0;
+    return static_cast<float>(pitchBends.back() + (val - times.back()) * (0 - pitchBends.back()) /
+                                                    (dur - times.back()));
+  }
+
+  return static_cast<float>(pitchBends[k - 1] + (val - times[k - 1]) * (pitchBends[k] - pitchBends[k - 1]) /
+                                                  (times[k] - times[k - 1]));
+}
+
+auto TimeMap::time2Sample(double val) const -> int
+{
+  if (val <= 0)
+    return static_cast<int>(val * sampleRate);
+  return segment2Sample(findTime(val), val);
+}
+
+auto TimeMap::duration() const -> double
+{
+  return dur;
+}
+
+auto TimeMap::unchangedUntil(size_t firstChanged) const -> double
+{
+  // knots up to firstChanged are kept and a time up to their running maximum never reaches a later segment
+  if (firstChanged == 0)
+    return 0;
+  return maxTimes[std::min(firstChanged, maxTimes.size() - 1)];
+}
+
+auto TimeMap::time2PitchBend(double val) const -> float
+{
+  if (val <= 0)
+    return 0;
+  return segment2PitchBend(findTime(val), val);
+}
+
+TimeMap::Cursor::Cursor(const TimeMap &tm) : tm(tm) {}
+
+auto TimeMap::Cursor::seek(double val) -> size_t
+{
+  // the time is in the segment of knot k when maxTimes[k - 1] < val <= maxTimes[k], try the current and
+  // the next segment before falling back to the binary search
+  const auto &maxTimes = tm.maxTimes;
+  const auto inSegment = [&](size_t k) {
+    return maxTimes[k - 1] < val && (k == maxTimes.size() || val <= maxTimes[k]);
+  };
+  if (knot <= maxTimes.size() && inSegment(knot))
+    return knot;
+  if (knot < maxTimes.size() && inSegment(knot + 1))
+    return ++knot;
+  knot = tm.findTime(val);
+  return knot;
+}
+
+auto TimeMap::Cursor::time2Sample(double val) -> int
+{
+  if (val <= 0)
+    return static_cast<int>(val * tm.sampleRate);
+  return tm.segment2Sample(seek(val), val);
+}
+
+auto TimeMap::Cursor::time2PitchBend(double val) -> float
+{
+  if (val <= 0)
+    return 0;
+  return tm.segment2PitchBend(seek(val), val);
+}
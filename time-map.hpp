@@ -0,0 +1,53 @@
+#pragma once
+#include "marker.hpp"
+#include <vector>
+
+// immutable mapping between the original samples and the warped timeline, built from the markers
+//
+// The markers are turned into knots of a piecewise-linear function: knot 0 is the origin, knot k is the
+// marker k - 1 with its cumulative warped time and pitch bend. Queries are a binary search over the knots.
+class TimeMap
+{
+public:
+  // markers are sorted by sample
+  TimeMap(std::vector<Marker> markers, int sampleRate, int sampleCount);
+  // rebuilds only the knots from firstChanged on, the markers before it have to be the same as in prev
+  TimeMap(const TimeMap &prev, size_t firstChanged, std::vector<Marker> markers);
+  auto sample2Time(int) const -> double;
+  auto time2Sample(double) const -> int;
+  auto time2PitchBend(double) const -> float;
+  auto duration() const -> double;
+  // time up to which time2Sample and time2PitchBend give the same results as before an edit of the
+  // marker firstChanged
+  auto unchangedUntil(size_t firstChanged) const -> double;
+
+  // remembers the last segment, for queries with mostly increasing time like playback and export
+  class Cursor
+  {
+  public:
+    Cursor(const TimeMap &);
+    auto time2Sample(double) -> int;
+    auto time2PitchBend(double) -> float;
+
+  private:
+    const TimeMap &tm;
+    size_t knot = 1;
+    auto seek(double) -> size_t;
+  };
+
+private:
+  int sampleRate;
+  int sampleCount;
+  std::vector<int> samples;
+  std::vector<double> times;
+  // running maximum of times, markers with large negative dTime make times go back, the first segment
+  // containing the time is the first knot where the running maximum reaches it
+  std::vector<double> maxTimes;
+  std::vector<double> pitchBends;
+  double dur = 0;
+
+  auto build(const std::vector<Marker> &, size_t firstChanged) -> void;
+  auto findTime(double) const -> size_t;
+  auto segment2Sample(size_t knot, double) const -> int;
+  auto segment2PitchBend(size_t knot, double) const -> float;
+};
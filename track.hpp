@@ -0,0 +1,76 @@
+#pragma once
+#include "grain-engine.hpp"
+#include "grains.hpp"
+#include "marker.hpp"
+#include "min-max-pyramid.hpp"
+#include "pitch-track.hpp"
+#include "rcu.hpp"
+#include "ring-buffer.hpp"
+#include "sample-codec.hpp"
+#include "sample-loader.hpp"
+#include "samples.hpp"
+#include "spec.hpp"
+#include "time-map.hpp"
+#include <atomic>
+#include <memory>
+#include <ser/macro.hpp>
+#include <string>
+#include <vector>
+
+// One stem of the project, or one channel of an imported file: its samples, their analysis, the markers
+// warping them and the spectrum. All tracks share the sample rate and play on one timeline, the audio
+// callback mixes them.
+struct Track
+{
+  std::string name;
+  Samples wavData;
+  // blocks of compressed samples kept decompressed for the view, the playback and the pitch detection,
+  // declared after wavData so they are released before it
+  BlockCache::Pin viewPin;
+  BlockCache::Pin playbackPin;
+  BlockCache::Pin pitchPin;
+  // decoded samples, while the track is loading wavData is larger and only its first sampleCount are valid
+  int sampleCount = 0;
+  GrainIndex grains;
+  // detected pitch of the grains, empty until the detector is done
+  PitchTrack pitchTrack;
+  // the track grouped into notes
+  std::vector<NoteBlob> blobs;
+  // waveform min/max, quantized to 16 bit which is finer than the pixels
+  MinMaxPyramid<int16_t> picks;
+  std::vector<Marker> markers;
+  // markers as seen by the audio callback
+  Rcu<TimeMap> timeMap;
+  float gain = 1.f;
+  bool isMuted = false;
+  // gain and mute as seen by the audio callback
+  std::atomic<float> playbackGain = 1.f;
+
+  // rendered but not yet played samples, preallocated so the callback never allocates
+  RingBuffer<float> restWav{MaxGrainOutput};
+  double restWavCursor = 0.0;
+  // the last step rendered into restWav, a grain which did not fit is resumed from it
+  GrainStep restStep = {};
+
+  // decoder or decompressor writing into wavData, declared after it so it is stopped first; the tracks of
+  // the channels of one file share the decoder
+  std::shared_ptr<SampleLoader> loader;
+  // of the loader
+  size_t channel = 0;
+  // reads wavData, declared after it so it is stopped first
+  std::unique_ptr<Spec> spec;
+  // background pitch detection reading wavData
+  std::unique_ptr<PitchDetector> pitchDetector;
+
+  // the track's part of the metadata chunk, the samples are stored separately
+#define SER_PROP_LIST \
+  SER_PROP(name);     \
+  SER_PROP(gain);     \
+  SER_PROP(isMuted);  \
+  SER_PROP(markers);  \
+  SER_PROP(grains);   \
+  SER_PROP(pitchTrack);
+
+  SER_DEF_PROPS()
+#undef SER_PROP_LIST
+};
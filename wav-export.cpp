@@ -0,0 +1,177 @@
+#include "wav-export.hpp"
+#include "parallel-for.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <log/log.hpp>
+
+// output samples planned and rendered at once, the last grain can make a window longer
+static const auto WindowSize = size_t{1} << 20;
+// the resampler reads this far around a grain
+static const auto MaxTaps = size_t{32};
+
+struct WavExport::Voice
+{
+  Voice(Source aSource, int sampleRate, float bias)
+    : source(std::move(aSource)),
+      engine(source.wav, source.grains, sampleRate, bias, Resampler::Quality::High),
+      tmCursor(source.timeMap),
+      grainCursor(source.grains)
+  {
+  }
+
+  Source source;
+  GrainEngine engine;
+  TimeMap::Cursor tmCursor;
+  GrainIndex::Cursor grainCursor;
+  double cursor = 0.;
+  // the last planned step, the rest of a grain longer than MaxGrainOutput is planned next
+  GrainStep last = {};
+  bool isEnd = false;
+  // rendered but not yet mixed
+  std::vector<float> pending;
+  // reused for every window
+  std::vector<GrainStep> steps;
+  std::vector<size_t> offsets;
+};
+
+WavExport::WavExport(const std::string &aFileName,
+                     std::vector<Source> sources,
+                     int sampleRate,
+                     float bias,
+                     size_t aTailSilence,
+                     WavWriter::Format format)
+  : fileName(aFileName), writer(fileName + ".tmp", sampleRate, format), tailSilence(aTailSilence)
+{
+  for (auto &source : sources)
+  {
+    duration = std::max(duration, source.timeMap.duration());
+    voices.push_back(std::make_unique<Voice>(std::move(source), sampleRate, bias));
+  }
+  if (!writer.isOk())
+  {
+    done = true;
+    return;
+  }
+  thread = std::thread(&WavExport::run, this);
+}
+
+WavExport::~WavExport()
+{
+  isStopping = true;
+  if (thread.joinable())
+    thread.join();
+}
+
+auto WavExport::progress() const -> float
+{
+  if (duration <= 0.)
+    return isDone() ? 1.f : 0.f;
+  return static_cast<float>(std::clamp(renderedTime.load() / duration, 0., 1.));
+}
+
+auto WavExport::renderWindow(Voice &voice) -> void
+{
+  // the start of a grain depends on all grains before it, but only through their sizes
+  auto &engine = voice.engine;
+  auto &steps = voice.steps;
+  auto &offsets = voice.offsets;
+  steps.clear();
+  offsets.clear();
+  auto total = size_t{0};
+  while (total < WindowSize)
+  {
+    const auto step = engine.isPartial(voice.last)
+                        ? engine.resume(voice.last, MaxGrainOutput)
+                        : engine.plan(voice.tmCursor, voice.grainCursor, voice.cursor, MaxGrainOutput);
+    voice.last = step;
+    if (engine.isEnd(step) || step.size == 0)
+    {
+      voice.isEnd = true;
+      break;
+    }
+    steps.push_back(step);
+    offsets.push_back(total);
+    total += step.size;
+    voice.cursor += engine.duration(step);
+  }
+
+  // the samples the grains of the window read, with the resampler taps around them
+  const auto blocks = voice.source.blocks;
+  auto pin = BlockCache::Pin{};
+  if (blocks && !steps.empty())
+  {
+    auto first = blocks->size();
+    auto last = size_t{0};
+    for (const auto &step : steps)
+    {
+      const auto grain = voice.source.grains[step.grain];
+      first = std::min(first, static_cast<size_t>(grain.start));
+      last = std::max({last, static_cast<size_t>(grain.start + grain.size), step.next});
+    }
+    pin = blocks->pin(first - std::min(first, MaxTaps), last + MaxTaps);
+  }
+
+  const auto begin = voice.pending.size();
+  voice.pending.resize(begin + total);
+  const auto out = voice.pending.data() + begin;
+  parallelFor(steps.size(), 64, [&](size_t first, size_t last) {
+    for (auto i = first; i < last; ++i)
+      engine.render(steps[i], {std::span{out + offsets[i], steps[i].size}, std::span<float>{}});
+  });
+}
+
+auto WavExport::run() -> void
+{
+  // reused for every window
+  auto window = std::vector<float>{};
+  for (auto isEnd = false; !isEnd && !isStopping;)
+  {
+    // every track renders at least a window ahead, the mix is written a window at a time
+    for (auto &voice : voices)
+      while (!voice->isEnd && voice->pending.size() < WindowSize && !isStopping)
+        renderWindow(*voice);
+    isEnd = std::all_of(std::begin(voices), std::end(voices), [](const auto &v) { return v->isEnd; });
+    auto size = WindowSize;
+    if (isEnd)
+    {
+      size = 0;
+      for (const auto &voice : voices)
+        size = std::max(size, voice->pending.size());
+    }
+
+    window.assign(size + (isEnd ? tailSilence : 0), 0.f);
+    auto time = duration;
+    for (auto &voice : voices)
+    {
+      auto &pending = voice->pending;
+      const auto n = std::min(size, pending.size());
+      const auto gain = voice->source.gain;
+      for (auto i = size_t{0}; i < n; ++i)
+        window[i] += gain * pending[i];
+      pending.erase(std::begin(pending), std::begin(pending) + static_cast<ptrdiff_t>(n));
+      if (!voice->isEnd)
+        time = std::min(time, voice->cursor);
+    }
+    writer.write(window);
+    renderedTime = time;
+  }
+
+  if (isStopping)
+    LOG("export cancelled");
+  ok = !isStopping && writer.close();
+  // a cancelled or failed export leaves no truncated file behind, a complete one replaces the old file
+  const auto tmpPath = fileName + ".tmp";
+  std::error_code ec;
+  if (ok)
+  {
+    std::filesystem::rename(tmpPath, fileName, ec);
+    if (ec)
+    {
+      LOG("failed to rename", tmpPath, fileName, ec.message());
+      ok = false;
+    }
+  }
+  if (!ok)
+    std::filesystem::remove(tmpPath, ec);
+  done.store(true, std::memory_order_release);
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include "grain-engine.hpp"
+#include "grains.hpp"
+#include "sample-codec.hpp"
+#include "save-wav.hpp"
+#include "time-map.hpp"
+#include <atomic>
+#include <memory>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Renders the whole timeline to a wav file on a background thread, the tracks are mixed into it. The
+// grains of one window of output are planned serially per track, rendered in parallel on the process
+// thread pool and streamed to the file, so only the window is kept in memory.
+// It works on its own copy of the grains and the time maps, the UI can keep editing and playing.
+class WavExport
+{
+public:
+  // one track of the mix; wav has to stay valid until the export is destroyed, the samples of a
+  // compressed track are pinned for one window at a time
+  struct Source
+  {
+    std::span<const float> wav;
+    GrainIndex grains;
+    TimeMap timeMap;
+    float gain = 1.f;
+    BlockCache *blocks = nullptr;
+  };
+
+  // tailSilence samples are appended after the longest track; the file is written under a temporary name
+  // and only renamed to fileName once it is complete
+  WavExport(const std::string &fileName,
+            std::vector<Source>,
+            int sampleRate,
+            float bias,
+            size_t tailSilence,
+            WavWriter::Format);
+  // cancels an unfinished export
+  ~WavExport();
+  // disable copy
+  WavExport(const WavExport &) = delete;
+  WavExport &operator=(const WavExport &) = delete;
+
+  // from 0 to 1
+  auto progress() const -> float;
+  auto isDone() const -> bool { return done.load(std::memory_order_acquire); }
+  // only valid once isDone()
+  auto isOk() const -> bool { return ok; }
+
+private:
+  // a source and where its planning is, the engine refers to the grains so a voice never moves
+  struct Voice;
+  std::vector<std::unique_ptr<Voice>> voices;
+  // of the longest track
+  double duration = 0.;
+  std::string fileName;
+  WavWriter writer;
+  size_t tailSilence;
+  std::atomic<double> renderedTime = 0.;
+  std::atomic<bool> done = false;
+  std::atomic<bool> isStopping = false;
+  bool ok = false;
+  std::thread thread;
+
+  auto renderWindow(Voice &) -> void;
+  auto run() -> void;
+};